@@ -0,0 +1,1290 @@
+// World rendering kernels for CLProgram.
+
+// CLProgram prepends these defines before building the program:
+// - WORLD_WIDTH, WORLD_HEIGHT, WORLD_DEPTH: world dimensions in voxels.
+// - DAY_LENGTH: game time seconds in a day.
+// - OCCUPANCY_SMALL_BRICK, OCCUPANCY_LARGE_BRICK, OCCUPANCY_LARGE_OFFSET: the two
+//   occupancy brick sizes, and where the large bricks start in the occupancy buffer.
+// - VOXEL_TRIANGLES_LOCAL: voxel triangles are in voxel-local coordinates.
+// - PACKET_WIDTH, PACKET_HEIGHT, PACKET_CELL_CACHE, PACKET_TRIANGLE_CACHE: packet
+//   dimensions and local cache sizes of intersectPacket.
+// - LIGHT_CELL_SIZE: voxels along each side of a light grid cell.
+// - MAX_SHADOW_RAYS, VISIBILITY_SAMPLES, MAX_VISIBILITY_SAMPLES: the shadow ray budget
+//   per hit, and the visibility cache's sample counts.
+// - AMBIENT_OCCLUSION_SAMPLES, AMBIENT_OCCLUSION_SCALE: rays per ambient occlusion
+//   sample, and pixels per sample along each side.
+// - ANTI_ALIAS_THRESHOLD: luma contrast below which the anti-alias pass copies a pixel.
+
+// The screen dimensions are kernel arguments, so the program isn't built again when
+// the window is resized. Every kernel returns for work-items outside the width and
+// height arguments.
+
+// CLProgram checks this before building the program, so a kernel with different
+// arguments isn't used by mistake. It must be changed along with any change to the
+// arguments or buffer layouts.
+#define KERNEL_INTERFACE_VERSION 14
+
+#define WORLD_SIZE ((int3)(WORLD_WIDTH, WORLD_HEIGHT, WORLD_DEPTH))
+
+// Distance used for "nothing was hit" and for axes a ray doesn't move along. Infinity
+// isn't safe with -cl-fast-relaxed-math.
+#define FAR_DISTANCE 1.0e30f
+
+// Determinants and directions smaller than this are treated as zero.
+#define RAY_EPSILON 1.0e-6f
+
+// How far a hit point is moved into its surface to find its voxel, and off it to start
+// shadow and ambient occlusion rays.
+#define SURFACE_BIAS 1.0e-3f
+
+// Triangle index of pixels that hit nothing.
+#define NO_TRIANGLE (-1)
+
+#define PALETTE_LENGTH 256
+
+// Brightness of walls (surfaces facing sideways) compared to floors and ceilings, so
+// corners are easy to see without any lights.
+#define WALL_SHADE 0.75f
+
+// Sky colors at midnight and noon, until the sky is drawn from world data.
+#define NIGHT_SKY_COLOR ((float3)(8.0f, 8.0f, 24.0f) / 255.0f)
+#define DAY_SKY_COLOR ((float3)(112.0f, 148.0f, 196.0f) / 255.0f)
+
+// Light grid cells, and the visibility cache entries of each cell light.
+#define LIGHT_CELLS_X ((WORLD_WIDTH + LIGHT_CELL_SIZE - 1) / LIGHT_CELL_SIZE)
+#define LIGHT_CELLS_Y ((WORLD_HEIGHT + LIGHT_CELL_SIZE - 1) / LIGHT_CELL_SIZE)
+#define LIGHT_CELL_VOXELS (LIGHT_CELL_SIZE * LIGHT_CELL_SIZE * LIGHT_CELL_SIZE)
+
+// Lit rays are counted in the low bits of a visibility entry, and blocked rays in the
+// high bits.
+#define VISIBILITY_LIT_MASK 0xFFFFu
+#define VISIBILITY_BLOCKED_SHIFT 16
+
+// How far ambient occlusion rays look for something in the way, and how dark a fully
+// occluded sample gets.
+#define AMBIENT_OCCLUSION_RADIUS 1.0f
+#define AMBIENT_OCCLUSION_STRENGTH 0.75f
+
+// Most an edge pixel is blended with its neighbors by the anti-alias pass.
+#define ANTI_ALIAS_BLEND 0.75f
+
+// How much the post-process pass darkens the corners of the screen.
+#define VIGNETTE_STRENGTH 0.25f
+
+// Rays in a packet of intersectPacket. The first packet's cell cache also holds two
+// counters for the whole work-group at its end.
+#define PACKET_SIZE (PACKET_WIDTH * PACKET_HEIGHT)
+
+#if (PACKET_SIZE + 2) > PACKET_CELL_CACHE
+#error "The packet cell cache is too small for a packet."
+#endif
+
+// These structs must match the sizes in CLProgram.cpp.
+typedef struct
+{
+	float3 eye, forward, right, up;
+	float zoom;
+} Camera;
+
+typedef struct
+{
+	float gameTime;
+	int nightPalette, dayPalette; // Palette slots in the palette buffer.
+	float daylight; // 0 at midnight, 1 at noon.
+} GameTime;
+
+typedef struct
+{
+	int offset; // Texels before the texture in the texture atlas.
+	short width, height;
+} TextureRef;
+
+// The nearest hit of a ray so far.
+typedef struct
+{
+	float t; // Distance along the ray. FAR_DISTANCE if nothing was hit.
+	float2 uv; // Texture coordinates, wrapped to [0, 1).
+	int triangle; // NO_TRIANGLE if nothing was hit.
+} Hit;
+
+// A ray's walk through the voxel grid, one cell at a time.
+typedef struct
+{
+	int3 cell, step;
+	float3 tNext; // Distance to the next cell boundary on each axis.
+	float3 tDelta; // Distance between cell boundaries on each axis.
+	float tEntry; // Distance where the ray entered the current cell.
+	float tEnd; // Distance where the walk stops.
+} Traversal;
+
+// A light whose visibility isn't settled in the cache, with what it adds to the shade.
+typedef struct
+{
+	float3 point, add;
+	float weight, guess;
+	int entry; // Visibility cache entry.
+} ShadowCandidate;
+
+int getVoxelIndex(int3 cell)
+{
+	return cell.x + (cell.y * WORLD_WIDTH) + (cell.z * WORLD_WIDTH * WORLD_HEIGHT);
+}
+
+bool isInWorld(int3 cell)
+{
+	return all(cell >= (int3)(0)) && all(cell < WORLD_SIZE);
+}
+
+// Gets the index of the brick holding a cell in one level of the occupancy buffer.
+int getBrickIndex(int3 cell, int brickSize, int levelOffset)
+{
+	const int levelWidth = (WORLD_WIDTH + brickSize - 1) / brickSize;
+	const int levelHeight = (WORLD_HEIGHT + brickSize - 1) / brickSize;
+	const int3 brick = cell / brickSize;
+	return levelOffset + brick.x + (brick.y * levelWidth) +
+		(brick.z * levelWidth * levelHeight);
+}
+
+// Gets the index of the light grid cell holding a voxel.
+int getLightCellIndex(int3 cell)
+{
+	const int3 lightCell = cell / LIGHT_CELL_SIZE;
+	return lightCell.x + (lightCell.y * LIGHT_CELLS_X) +
+		(lightCell.z * LIGHT_CELLS_X * LIGHT_CELLS_Y);
+}
+
+// Gets the visibility cache entry of a voxel for one of its cell's lights (an index
+// into the cell light IDs).
+int getVisibilityIndex(int cellLight, int3 cell)
+{
+	const int3 cellVoxel = cell % LIGHT_CELL_SIZE;
+	return (cellLight * LIGHT_CELL_VOXELS) + cellVoxel.x +
+		(cellVoxel.y * LIGHT_CELL_SIZE) + (cellVoxel.z * LIGHT_CELL_SIZE * LIGHT_CELL_SIZE);
+}
+
+// Gets the direction of the camera ray through the center of a pixel.
+float3 getCameraDirection(__global const Camera *camera, int x, int y, int width,
+	int height)
+{
+	const float aspect = (float)width / (float)height;
+	const float screenX = aspect * (((2.0f * ((float)x + 0.5f)) / (float)width) - 1.0f);
+	const float screenY = 1.0f - ((2.0f * ((float)y + 0.5f)) / (float)height);
+	return normalize((camera->forward * camera->zoom) + (camera->up * screenY) +
+		(camera->right * screenX));
+}
+
+float3 getSkyColor(__global const GameTime *gameTime)
+{
+	return mix(NIGHT_SKY_COLOR, DAY_SKY_COLOR, gameTime->daylight);
+}
+
+float3 getPaletteColor(__global const uchar4 *palettes, int slot, uchar index)
+{
+	return convert_float4(palettes[(slot * PALETTE_LENGTH) + index]).xyz / 255.0f;
+}
+
+int toARGB(float3 color)
+{
+	const uint3 rgb = convert_uint3(clamp(color, 0.0f, 1.0f) * 255.0f);
+	return (int)(0xFF000000u | (rgb.x << 16) | (rgb.y << 8) | rgb.z);
+}
+
+float getLuma(float3 color)
+{
+	return dot(color, (float3)(0.299f, 0.587f, 0.114f));
+}
+
+// Integer hash for picking sample directions, so each pixel has its own fixed pattern.
+uint hashUint(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return x;
+}
+
+float toUnitFloat(uint x)
+{
+	return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Gets the wrapped texture coordinates of a point on a triangle.
+float2 getTexCoord(int triangle, float u, float v, __global const float2 *uvs)
+{
+	const float2 uv1 = uvs[triangle * 3];
+	const float2 uv2 = uvs[(triangle * 3) + 1];
+	const float2 uv3 = uvs[(triangle * 3) + 2];
+	const float2 texCoord = uv1 + ((uv2 - uv1) * u) + ((uv3 - uv1) * v);
+	return texCoord - floor(texCoord);
+}
+
+// Gets the palette index of a texel. Index 0 is transparent.
+uchar getTexel(TextureRef textureRef, float2 texCoord, __global const uchar *textures)
+{
+	const int width = textureRef.width;
+	const int height = textureRef.height;
+	const int texelX = min((int)(texCoord.x * (float)width), width - 1);
+	const int texelY = min((int)(texCoord.y * (float)height), height - 1);
+	return textures[textureRef.offset + texelX + (texelY * width)];
+}
+
+// Gets a triangle's normal, turned toward the side the ray came from.
+float3 getFacingNormal(__global const float4 *normals, int triangle, float3 direction)
+{
+	const float3 normal = normals[triangle].xyz;
+	return (dot(normal, direction) > 0.0f) ? -normal : normal;
+}
+
+// Gets the voxel a hit belongs to. The hit point is on the voxel's surface, so it's
+// moved into the surface a little first.
+int3 getHitCell(float3 point, float3 normal)
+{
+	return clamp(convert_int3(floor(point - (normal * SURFACE_BIAS))), (int3)(0),
+		WORLD_SIZE - (int3)(1));
+}
+
+// Moller-Trumbore intersection of a ray with a triangle given by its first point and
+// edges. Returns the distance along the ray, with the hit's barycentric coordinates in
+// u and v, or a negative distance for a miss.
+float intersectTriangle(float3 p1, float3 e1, float3 e2, float3 origin, float3 direction,
+	float *u, float *v)
+{
+	const float3 p = cross(direction, e2);
+	const float det = dot(e1, p);
+	if (fabs(det) < RAY_EPSILON)
+	{
+		return -1.0f;
+	}
+
+	const float invDet = 1.0f / det;
+	const float3 s = origin - p1;
+	*u = dot(s, p) * invDet;
+	if ((*u < 0.0f) || (*u > 1.0f))
+	{
+		return -1.0f;
+	}
+
+	const float3 q = cross(s, e1);
+	*v = dot(direction, q) * invDet;
+	if ((*v < 0.0f) || ((*u + *v) > 1.0f))
+	{
+		return -1.0f;
+	}
+
+	return dot(e2, q) * invDet;
+}
+
+// Makes a triangle the nearest hit if the ray hits an opaque texel of it closer than
+// the current hit. Returns whether it did.
+bool testTriangle(int triangle, float3 p1, float3 e1, float3 e2, float3 origin,
+	float3 direction, __global const float2 *uvs, __global const TextureRef *texRefs,
+	__global const uchar *textures, Hit *hit)
+{
+	float u, v;
+	const float t = intersectTriangle(p1, e1, e2, origin, direction, &u, &v);
+	if ((t <= RAY_EPSILON) || (t >= hit->t))
+	{
+		return false;
+	}
+
+	// The texture is only read for a closer candidate, to check for transparency.
+	const float2 texCoord = getTexCoord(triangle, u, v, uvs);
+	if (getTexel(texRefs[triangle], texCoord, textures) == 0)
+	{
+		return false;
+	}
+
+	hit->t = t;
+	hit->uv = texCoord;
+	hit->triangle = triangle;
+	return true;
+}
+
+// Tests a ray against the triangles of a voxel.
+void intersectVoxel(int2 voxelRef, int3 cell, float3 origin, float3 direction,
+	__global const float4 *positions, __global const float4 *edges,
+	__global const float2 *uvs, __global const TextureRef *texRefs,
+	__global const uchar *textures, Hit *hit)
+{
+#ifdef VOXEL_TRIANGLES_LOCAL
+	const float3 localOrigin = origin - convert_float3(cell);
+#else
+	const float3 localOrigin = origin;
+#endif
+
+	for (int i = voxelRef.x; i < (voxelRef.x + voxelRef.y); ++i)
+	{
+		testTriangle(i, positions[i].xyz, edges[i * 2].xyz, edges[(i * 2) + 1].xyz,
+			localOrigin, direction, uvs, texRefs, textures, hit);
+	}
+}
+
+// Tests a ray against the sprites listed in a voxel. Sprites are in world coordinates,
+// and a sprite hit only counts up to where the ray leaves the voxel, since the sprite
+// is also tested in the other voxels it reaches.
+void intersectSprites(int voxelIndex, float tExit, float3 origin, float3 direction,
+	__global const int2 *spriteRefs, __global const int *spriteIndices,
+	int spriteTriangleOffset, __global const float4 *positions,
+	__global const float4 *edges, __global const float2 *uvs,
+	__global const TextureRef *texRefs, __global const uchar *textures, Hit *hit)
+{
+	const int2 spriteRef = spriteRefs[voxelIndex];
+	if (spriteRef.y == 0)
+	{
+		return;
+	}
+
+	Hit spriteHit;
+	spriteHit.t = fmin(hit->t, tExit);
+	spriteHit.uv = (float2)(0.0f);
+	spriteHit.triangle = NO_TRIANGLE;
+
+	for (int i = spriteRef.x; i < (spriteRef.x + spriteRef.y); ++i)
+	{
+		const int first = spriteTriangleOffset + (spriteIndices[i] * 2);
+		for (int j = first; j < (first + 2); ++j)
+		{
+			testTriangle(j, positions[j].xyz, edges[j * 2].xyz, edges[(j * 2) + 1].xyz,
+				origin, direction, uvs, texRefs, textures, &spriteHit);
+		}
+	}
+
+	if (spriteHit.triangle != NO_TRIANGLE)
+	{
+		*hit = spriteHit;
+	}
+}
+
+// Gets the distance to the next cell boundary along one axis.
+float getNextBoundary(float origin, float direction, int cell)
+{
+	if (direction > RAY_EPSILON)
+	{
+		return ((float)(cell + 1) - origin) / direction;
+	}
+	else if (direction < -RAY_EPSILON)
+	{
+		return ((float)cell - origin) / direction;
+	}
+	else
+	{
+		return FAR_DISTANCE;
+	}
+}
+
+int getStep(float direction)
+{
+	return (direction > RAY_EPSILON) ? 1 : ((direction < -RAY_EPSILON) ? -1 : 0);
+}
+
+float getDelta(float direction)
+{
+	return (fabs(direction) > RAY_EPSILON) ? (1.0f / fabs(direction)) : FAR_DISTANCE;
+}
+
+// Starts a traversal in the given cell, which the ray enters at the given distance.
+void startTraversal(Traversal *trav, float3 origin, float3 direction, int3 cell,
+	float tEntry, float tEnd)
+{
+	trav->cell = cell;
+	trav->step = (int3)(getStep(direction.x), getStep(direction.y), getStep(direction.z));
+	trav->tNext = (float3)(
+		getNextBoundary(origin.x, direction.x, cell.x),
+		getNextBoundary(origin.y, direction.y, cell.y),
+		getNextBoundary(origin.z, direction.z, cell.z));
+	trav->tDelta = (float3)(getDelta(direction.x), getDelta(direction.y),
+		getDelta(direction.z));
+	trav->tEntry = tEntry;
+	trav->tEnd = tEnd;
+}
+
+// Gets the distance where the ray leaves the current cell.
+float getTraversalExit(const Traversal *trav)
+{
+	return fmin(trav->tNext.x, fmin(trav->tNext.y, trav->tNext.z));
+}
+
+// Moves a traversal to the next cell along the ray. Returns false once the ray leaves
+// the world or goes past its end.
+bool stepTraversal(Traversal *trav)
+{
+	const float3 tNext = trav->tNext;
+	if ((tNext.x < tNext.y) && (tNext.x < tNext.z))
+	{
+		trav->tEntry = tNext.x;
+		trav->cell.x += trav->step.x;
+		trav->tNext.x += trav->tDelta.x;
+	}
+	else if (tNext.y < tNext.z)
+	{
+		trav->tEntry = tNext.y;
+		trav->cell.y += trav->step.y;
+		trav->tNext.y += trav->tDelta.y;
+	}
+	else
+	{
+		trav->tEntry = tNext.z;
+		trav->cell.z += trav->step.z;
+		trav->tNext.z += trav->tDelta.z;
+	}
+
+	return (trav->tEntry <= trav->tEnd) && isInWorld(trav->cell);
+}
+
+// Gets the distance where the ray leaves a range of cells along one axis.
+float getBrickExit(float origin, float direction, int brickMin, int brickMax)
+{
+	if (direction > RAY_EPSILON)
+	{
+		return ((float)brickMax - origin) / direction;
+	}
+	else if (direction < -RAY_EPSILON)
+	{
+		return ((float)brickMin - origin) / direction;
+	}
+	else
+	{
+		return FAR_DISTANCE;
+	}
+}
+
+// Moves a traversal past the whole brick holding its cell, to the first cell after it
+// along the ray. Returns false once the ray leaves the world or goes past its end.
+bool skipBrick(Traversal *trav, float3 origin, float3 direction, int brickSize)
+{
+	const int3 brickMin = (trav->cell / brickSize) * brickSize;
+	const int3 brickMax = brickMin + (int3)(brickSize);
+	const float3 tExit = (float3)(
+		getBrickExit(origin.x, direction.x, brickMin.x, brickMax.x),
+		getBrickExit(origin.y, direction.y, brickMin.y, brickMax.y),
+		getBrickExit(origin.z, direction.z, brickMin.z, brickMax.z));
+
+	// The ray is at the far side of the brick on the exit axis. On the other axes, it's
+	// still inside the brick.
+	const float t = fmax(fmin(tExit.x, fmin(tExit.y, tExit.z)), trav->tEntry);
+	int3 cell = clamp(convert_int3(floor(origin + (direction * t))), brickMin,
+		brickMax - (int3)(1));
+	if ((tExit.x < tExit.y) && (tExit.x < tExit.z))
+	{
+		cell.x = (trav->step.x > 0) ? brickMax.x : (brickMin.x - 1);
+	}
+	else if (tExit.y < tExit.z)
+	{
+		cell.y = (trav->step.y > 0) ? brickMax.y : (brickMin.y - 1);
+	}
+	else
+	{
+		cell.z = (trav->step.z > 0) ? brickMax.z : (brickMin.z - 1);
+	}
+
+	startTraversal(trav, origin, direction, cell, t, trav->tEnd);
+	return (t <= trav->tEnd) && isInWorld(cell);
+}
+
+// Moves a traversal on from its cell to the first cell that isn't in an empty brick.
+// Returns false once the ray leaves the world or goes past its end.
+bool findOccupiedCell(Traversal *trav, float3 origin, float3 direction,
+	__global const ushort *occupancy)
+{
+	while (true)
+	{
+		if (occupancy[getBrickIndex(trav->cell, OCCUPANCY_LARGE_BRICK,
+			OCCUPANCY_LARGE_OFFSET)] == 0)
+		{
+			if (!skipBrick(trav, origin, direction, OCCUPANCY_LARGE_BRICK))
+			{
+				return false;
+			}
+		}
+		else if (occupancy[getBrickIndex(trav->cell, OCCUPANCY_SMALL_BRICK, 0)] == 0)
+		{
+			if (!skipBrick(trav, origin, direction, OCCUPANCY_SMALL_BRICK))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			return true;
+		}
+	}
+}
+
+// Moves a traversal on from its cell to the first cell with triangles or sprites.
+// Returns false once the ray leaves the world or goes past its end.
+bool findCandidateCell(Traversal *trav, float3 origin, float3 direction,
+	__global const int2 *voxelRefs, __global const int2 *spriteRefs,
+	__global const ushort *occupancy)
+{
+	while (findOccupiedCell(trav, origin, direction, occupancy))
+	{
+		const int voxelIndex = getVoxelIndex(trav->cell);
+		if ((voxelRefs[voxelIndex].y > 0) || (spriteRefs[voxelIndex].y > 0))
+		{
+			return true;
+		}
+
+		if (!stepTraversal(trav))
+		{
+			return false;
+		}
+	}
+
+	return false;
+}
+
+// Clips a ray to the world's box, so only cells that exist are visited. Returns false
+// if the ray misses the world.
+bool clipToWorld(float3 origin, float3 direction, float *tStart, float *tEnd)
+{
+	const float3 size = convert_float3(WORLD_SIZE);
+	float start = 0.0f;
+	float end = FAR_DISTANCE;
+
+	if (fabs(direction.x) < RAY_EPSILON)
+	{
+		if ((origin.x < 0.0f) || (origin.x >= size.x))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		const float t1 = -origin.x / direction.x;
+		const float t2 = (size.x - origin.x) / direction.x;
+		start = fmax(start, fmin(t1, t2));
+		end = fmin(end, fmax(t1, t2));
+	}
+
+	if (fabs(direction.y) < RAY_EPSILON)
+	{
+		if ((origin.y < 0.0f) || (origin.y >= size.y))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		const float t1 = -origin.y / direction.y;
+		const float t2 = (size.y - origin.y) / direction.y;
+		start = fmax(start, fmin(t1, t2));
+		end = fmin(end, fmax(t1, t2));
+	}
+
+	if (fabs(direction.z) < RAY_EPSILON)
+	{
+		if ((origin.z < 0.0f) || (origin.z >= size.z))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		const float t1 = -origin.z / direction.z;
+		const float t2 = (size.z - origin.z) / direction.z;
+		start = fmax(start, fmin(t1, t2));
+		end = fmin(end, fmax(t1, t2));
+	}
+
+	*tStart = start;
+	*tEnd = end;
+	return start < end;
+}
+
+// Starts a camera ray's traversal where it enters the world.
+void startCameraTraversal(Traversal *trav, float3 origin, float3 direction, float tStart,
+	float tEnd)
+{
+	const int3 cell = clamp(convert_int3(floor(origin + (direction * tStart))), (int3)(0),
+		WORLD_SIZE - (int3)(1));
+	startTraversal(trav, origin, direction, cell, tStart, tEnd);
+}
+
+// Traces a camera ray through the world and gets its nearest hit and the voxel it's in.
+Hit traceRay(float3 origin, float3 direction, __global const int2 *voxelRefs,
+	__global const int2 *spriteRefs, __global const int *spriteIndices,
+	int spriteTriangleOffset, __global const ushort *occupancy,
+	__global const float4 *positions, __global const float4 *edges,
+	__global const float2 *uvs, __global const TextureRef *texRefs,
+	__global const uchar *textures, int3 *hitCell)
+{
+	Hit hit;
+	hit.t = FAR_DISTANCE;
+	hit.uv = (float2)(0.0f);
+	hit.triangle = NO_TRIANGLE;
+	*hitCell = (int3)(0);
+
+	float tStart, tEnd;
+	if (!clipToWorld(origin, direction, &tStart, &tEnd))
+	{
+		return hit;
+	}
+
+	// Voxel triangles stay inside their voxel, so the first hit in a voxel is the
+	// nearest one.
+	Traversal trav;
+	startCameraTraversal(&trav, origin, direction, tStart, tEnd);
+	while (findCandidateCell(&trav, origin, direction, voxelRefs, spriteRefs, occupancy))
+	{
+		const int voxelIndex = getVoxelIndex(trav.cell);
+		intersectVoxel(voxelRefs[voxelIndex], trav.cell, origin, direction, positions,
+			edges, uvs, texRefs, textures, &hit);
+		intersectSprites(voxelIndex, getTraversalExit(&trav), origin, direction,
+			spriteRefs, spriteIndices, spriteTriangleOffset, positions, edges, uvs,
+			texRefs, textures, &hit);
+
+		if (hit.triangle != NO_TRIANGLE)
+		{
+			*hitCell = trav.cell;
+			break;
+		}
+
+		if (!stepTraversal(&trav))
+		{
+			break;
+		}
+	}
+
+	return hit;
+}
+
+// Returns whether a voxel triangle is in the way of a ray before the given distance.
+// Sprites don't block rays. Without textures (null uvs), every triangle blocks rays,
+// otherwise transparent texels let them through.
+bool isOccluded(float3 origin, float3 direction, float distance,
+	__global const int2 *voxelRefs, __global const ushort *occupancy,
+	__global const float4 *positions, __global const float4 *edges,
+	__global const float2 *uvs, __global const TextureRef *texRefs,
+	__global const uchar *textures)
+{
+	const int3 startCell = convert_int3(floor(origin));
+	if (!isInWorld(startCell))
+	{
+		return false;
+	}
+
+	Traversal trav;
+	startTraversal(&trav, origin, direction, startCell, 0.0f, distance);
+	while (findOccupiedCell(&trav, origin, direction, occupancy))
+	{
+		const int2 voxelRef = voxelRefs[getVoxelIndex(trav.cell)];
+		if (voxelRef.y > 0)
+		{
+#ifdef VOXEL_TRIANGLES_LOCAL
+			const float3 localOrigin = origin - convert_float3(trav.cell);
+#else
+			const float3 localOrigin = origin;
+#endif
+
+			Hit hit;
+			hit.t = distance;
+			hit.uv = (float2)(0.0f);
+			hit.triangle = NO_TRIANGLE;
+
+			for (int i = voxelRef.x; i < (voxelRef.x + voxelRef.y); ++i)
+			{
+				const float3 p1 = positions[i].xyz;
+				const float3 e1 = edges[i * 2].xyz;
+				const float3 e2 = edges[(i * 2) + 1].xyz;
+				if (uvs != 0)
+				{
+					if (testTriangle(i, p1, e1, e2, localOrigin, direction, uvs, texRefs,
+						textures, &hit))
+					{
+						return true;
+					}
+				}
+				else
+				{
+					float u, v;
+					const float t = intersectTriangle(p1, e1, e2, localOrigin, direction,
+						&u, &v);
+					if ((t > RAY_EPSILON) && (t < distance))
+					{
+						return true;
+					}
+				}
+			}
+		}
+
+		if (!stepTraversal(&trav))
+		{
+			return false;
+		}
+	}
+
+	return false;
+}
+
+// Shades a hit with its texel for the time of day and the lights in its light cell.
+// With shadows, the lights that matter most and that the visibility cache isn't sure
+// about get shadow rays, up to the budget, and the rest use the cache's guess.
+float3 shadeHit(int3 cell, float3 point, float3 normal, int triangle, float2 texCoord,
+	float ambient, __global const GameTime *gameTime, __global const uchar4 *palettes,
+	__global const TextureRef *texRefs, __global const uchar *textures,
+	__global const float4 *lights, __global const int2 *lightRefs,
+	__global const int *lightIndices, __global uint *visibility,
+	__global const int2 *voxelRefs, __global const ushort *occupancy,
+	__global const float4 *positions, __global const float4 *edges,
+	__global const float2 *uvs)
+{
+	const uchar texel = getTexel(texRefs[triangle], texCoord, textures);
+	const float3 color = mix(getPaletteColor(palettes, gameTime->nightPalette, texel),
+		getPaletteColor(palettes, gameTime->dayPalette, texel), gameTime->daylight);
+
+	float3 shade = (float3)((WALL_SHADE + ((1.0f - WALL_SHADE) * fabs(normal.y))) *
+		ambient);
+
+#if MAX_SHADOW_RAYS > 0
+	ShadowCandidate candidates[MAX_SHADOW_RAYS];
+	int candidateCount = 0;
+#endif
+
+	// Light fades to nothing at its radius.
+	const int2 lightRef = lightRefs[getLightCellIndex(cell)];
+	for (int i = lightRef.x; i < (lightRef.x + lightRef.y); ++i)
+	{
+		const int lightID = lightIndices[i];
+		const float4 lightPoint = lights[lightID * 2];
+		const float3 toLight = lightPoint.xyz - point;
+		const float radius = lightPoint.w;
+		const float distanceSquared = dot(toLight, toLight);
+		if ((distanceSquared >= (radius * radius)) || (distanceSquared < RAY_EPSILON))
+		{
+			continue;
+		}
+
+		const float distance = sqrt(distanceSquared);
+		const float facing = dot(normal, toLight) / distance;
+		if (facing <= 0.0f)
+		{
+			continue;
+		}
+
+		const float falloff = 1.0f - (distance / radius);
+		const float3 add = lights[(lightID * 2) + 1].xyz * (facing * falloff * falloff);
+		float guess = 1.0f;
+
+#if MAX_SHADOW_RAYS > 0
+		// Use the share of lit shadow rays so far. A light the cache is sure about
+		// doesn't need tracing, and the others compete for the shadow ray budget.
+		const int entry = getVisibilityIndex(i, cell);
+		const uint samples = visibility[entry];
+		const int litCount = (int)(samples & VISIBILITY_LIT_MASK);
+		const int blockedCount = (int)(samples >> VISIBILITY_BLOCKED_SHIFT);
+		if ((litCount + blockedCount) > 0)
+		{
+			guess = (float)litCount / (float)(litCount + blockedCount);
+		}
+
+		const bool settled =
+			((litCount >= VISIBILITY_SAMPLES) && (blockedCount == 0)) ||
+			((blockedCount >= VISIBILITY_SAMPLES) && (litCount == 0));
+		const float weight = add.x + add.y + add.z;
+		if (!settled && ((candidateCount < MAX_SHADOW_RAYS) ||
+			(weight > candidates[candidateCount - 1].weight)))
+		{
+			// Insertion into the few candidates kept, dropping the least important.
+			int slot = min(candidateCount, MAX_SHADOW_RAYS - 1);
+			while ((slot > 0) && (candidates[slot - 1].weight < weight))
+			{
+				candidates[slot] = candidates[slot - 1];
+				slot--;
+			}
+
+			candidates[slot].point = lightPoint.xyz;
+			candidates[slot].add = add;
+			candidates[slot].weight = weight;
+			candidates[slot].guess = guess;
+			candidates[slot].entry = entry;
+			candidateCount = min(candidateCount + 1, MAX_SHADOW_RAYS);
+		}
+#endif
+
+		shade += add * guess;
+	}
+
+#if MAX_SHADOW_RAYS > 0
+	// Trace the candidates' shadow rays, replacing their guesses, and count what each
+	// ray saw in the cache.
+	const float3 origin = point + (normal * SURFACE_BIAS);
+	for (int i = 0; i < candidateCount; ++i)
+	{
+		const float3 toLight = candidates[i].point - origin;
+		const float distance = length(toLight);
+		const bool blocked = (distance > RAY_EPSILON) && isOccluded(origin,
+			toLight / distance, distance, voxelRefs, occupancy, positions, edges, uvs,
+			texRefs, textures);
+
+		shade += candidates[i].add * ((blocked ? 0.0f : 1.0f) - candidates[i].guess);
+
+		const uint oldSamples = visibility[candidates[i].entry];
+		if ((int)((oldSamples & VISIBILITY_LIT_MASK) +
+			(oldSamples >> VISIBILITY_BLOCKED_SHIFT)) < MAX_VISIBILITY_SAMPLES)
+		{
+			atomic_add(&visibility[candidates[i].entry],
+				blocked ? (1u << VISIBILITY_BLOCKED_SHIFT) : 1u);
+		}
+	}
+#endif
+
+	return fmin(color * shade, (float3)(1.0f));
+}
+
+// Writes a camera ray's hit to the screen buffers. The normal is turned toward the
+// camera, so later passes don't need the ray.
+void writeHit(int index, Hit hit, float3 origin, float3 direction,
+	__global const float4 *normals, __global float *depthBuffer,
+	__global float3 *normalBuffer, __global float3 *viewBuffer,
+	__global float3 *pointBuffer, __global float2 *uvBuffer,
+	__global int *triangleIndexBuffer)
+{
+	depthBuffer[index] = hit.t;
+	viewBuffer[index] = direction;
+	uvBuffer[index] = hit.uv;
+	triangleIndexBuffer[index] = hit.triangle;
+
+	if (hit.triangle != NO_TRIANGLE)
+	{
+		normalBuffer[index] = getFacingNormal(normals, hit.triangle, direction);
+		pointBuffer[index] = origin + (direction * hit.t);
+	}
+	else
+	{
+		normalBuffer[index] = (float3)(0.0f);
+		pointBuffer[index] = origin;
+	}
+}
+
+__kernel void intersect(__global const Camera *camera, __global const int2 *voxelRefs,
+	__global const int2 *spriteRefs, __global const float4 *positions,
+	__global const uchar *textures, __global float *depthBuffer,
+	__global float3 *normalBuffer, __global float3 *viewBuffer,
+	__global float3 *pointBuffer, __global float2 *uvBuffer,
+	__global int *triangleIndexBuffer, int width, int height,
+	__global const ushort *occupancy, __global const float4 *edges, __global const float4 *normals,
+	__global const float2 *uvs, __global const TextureRef *texRefs,
+	__global const int *spriteIndices, int spriteTriangleOffset)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	if ((x >= width) || (y >= height))
+	{
+		return;
+	}
+
+	const int index = x + (y * width);
+	const float3 origin = camera->eye;
+	const float3 direction = getCameraDirection(camera, x, y, width, height);
+
+	int3 hitCell;
+	const Hit hit = traceRay(origin, direction, voxelRefs, spriteRefs, spriteIndices,
+		spriteTriangleOffset, occupancy, positions, edges, uvs, texRefs, textures,
+		&hitCell);
+
+	writeHit(index, hit, origin, direction, normals, depthBuffer, normalBuffer,
+		viewBuffer, pointBuffer, uvBuffer, triangleIndexBuffer);
+}
+
+// Like intersect, but each 4x4 packet of rays shares the cells it walks through. At
+// each step, every ray puts the cell it's about to test in its packet's cell cache.
+// When the whole packet is in the same cell, its rays load that voxel's triangles into
+// the packet's triangle cache together and test them from there. Rays that don't agree
+// test their own cells from global memory. Every work-item reaches every barrier, so
+// finished rays (and padding outside the screen) keep taking part until the whole
+// work-group is done.
+__kernel void intersectPacket(__global const Camera *camera,
+	__global const int2 *voxelRefs, __global const int2 *spriteRefs,
+	__global const float4 *positions, __global const uchar *textures,
+	__global float *depthBuffer, __global float3 *normalBuffer,
+	__global float3 *viewBuffer, __global float3 *pointBuffer, __global float2 *uvBuffer,
+	__global int *triangleIndexBuffer, int width, int height,
+	__global const ushort *occupancy, __local int *cellCache,
+	__local float4 *triangleCache,
+	__global const float4 *edges, __global const float4 *normals,
+	__global const float2 *uvs, __global const TextureRef *texRefs,
+	__global const int *spriteIndices, int spriteTriangleOffset)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	const bool inScreen = (x < width) && (y < height);
+
+	const int localX = get_local_id(0);
+	const int localY = get_local_id(1);
+	const bool isFirstItem = (localX == 0) && (localY == 0);
+	const int packetsX = get_local_size(0) / PACKET_WIDTH;
+	const int packet = (localX / PACKET_WIDTH) + ((localY / PACKET_HEIGHT) * packetsX);
+	const int lane = (localX % PACKET_WIDTH) + ((localY % PACKET_HEIGHT) * PACKET_WIDTH);
+	__local int *packetCells = cellCache + (packet * PACKET_CELL_CACHE);
+	__local float4 *packetTriangles = triangleCache + (packet * PACKET_TRIANGLE_CACHE * 3);
+
+	// Work-group counters: the most triangles of any packet's shared cell this step,
+	// and whether any ray still has cells to test.
+	__local int *groupTriangles = cellCache + (PACKET_CELL_CACHE - 1);
+	__local int *groupActive = cellCache + (PACKET_CELL_CACHE - 2);
+
+	const int index = x + (y * width);
+	const float3 origin = camera->eye;
+	const float3 direction = inScreen ?
+		getCameraDirection(camera, x, y, width, height) : (float3)(0.0f, 0.0f, 1.0f);
+
+	Hit hit;
+	hit.t = FAR_DISTANCE;
+	hit.uv = (float2)(0.0f);
+	hit.triangle = NO_TRIANGLE;
+	int3 hitCell = (int3)(0);
+
+	Traversal trav;
+	bool active = false;
+	float tStart, tEnd;
+	if (inScreen && clipToWorld(origin, direction, &tStart, &tEnd))
+	{
+		startCameraTraversal(&trav, origin, direction, tStart, tEnd);
+		active = findCandidateCell(&trav, origin, direction, voxelRefs, spriteRefs,
+			occupancy);
+	}
+
+	if (isFirstItem)
+	{
+		*groupTriangles = 0;
+		*groupActive = 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	while (true)
+	{
+		// Share the cell this ray is about to test, or -1 if it's done.
+		const int voxelIndex = active ? getVoxelIndex(trav.cell) : -1;
+		packetCells[lane] = voxelIndex;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		bool coherent = voxelIndex >= 0;
+		for (int i = 0; i < PACKET_SIZE; ++i)
+		{
+			coherent = coherent && (packetCells[i] == voxelIndex);
+		}
+
+		const int2 voxelRef = active ? voxelRefs[voxelIndex] : (int2)(0);
+		if (coherent)
+		{
+			atomic_max(groupTriangles, voxelRef.y);
+		}
+
+		if (active)
+		{
+			atomic_max(groupActive, 1);
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		const int chunkLimit = *groupTriangles;
+		const bool anyActive = *groupActive != 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		// The counters are only touched again after the next step's first barrier.
+		if (isFirstItem)
+		{
+			*groupTriangles = 0;
+			*groupActive = 0;
+		}
+
+		if (!anyActive)
+		{
+			break;
+		}
+
+#ifdef VOXEL_TRIANGLES_LOCAL
+		const float3 localOrigin = active ? (origin - convert_float3(trav.cell)) : origin;
+#else
+		const float3 localOrigin = origin;
+#endif
+		const float oldT = hit.t;
+
+		// Coherent packets go through their cell's triangles one cache-full at a time.
+		// Every work-item runs the same number of chunks.
+		for (int first = 0; first < chunkLimit; first += PACKET_TRIANGLE_CACHE)
+		{
+			const int chunkCount = coherent ?
+				min(voxelRef.y - first, PACKET_TRIANGLE_CACHE) : 0;
+			for (int i = lane; i < chunkCount; i += PACKET_SIZE)
+			{
+				const int triangle = voxelRef.x + first + i;
+				packetTriangles[i * 3] = positions[triangle];
+				packetTriangles[(i * 3) + 1] = edges[triangle * 2];
+				packetTriangles[(i * 3) + 2] = edges[(triangle * 2) + 1];
+			}
+
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			for (int i = 0; i < chunkCount; ++i)
+			{
+				testTriangle(voxelRef.x + first + i, packetTriangles[i * 3].xyz,
+					packetTriangles[(i * 3) + 1].xyz, packetTriangles[(i * 3) + 2].xyz,
+					localOrigin, direction, uvs, texRefs, textures, &hit);
+			}
+
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+
+		if (active)
+		{
+			if (!coherent)
+			{
+				intersectVoxel(voxelRef, trav.cell, origin, direction, positions, edges,
+					uvs, texRefs, textures, &hit);
+			}
+
+			intersectSprites(voxelIndex, getTraversalExit(&trav), origin, direction,
+				spriteRefs, spriteIndices, spriteTriangleOffset, positions, edges, uvs,
+				texRefs, textures, &hit);
+
+			if (hit.t < oldT)
+			{
+				hitCell = trav.cell;
+				active = false;
+			}
+			else
+			{
+				active = stepTraversal(&trav) && findCandidateCell(&trav, origin,
+					direction, voxelRefs, spriteRefs, occupancy);
+			}
+		}
+	}
+
+	if (inScreen)
+	{
+		writeHit(index, hit, origin, direction, normals, depthBuffer, normalBuffer,
+			viewBuffer, pointBuffer, uvBuffer, triangleIndexBuffer);
+	}
+}
+
+// Traces ambient occlusion rays from the hit of each sample's top-left pixel. Samples
+// are one pixel, or 2x2 pixels at half resolution, and the occlusion grid is indexed
+// with the traced width rounded up to whole samples. Occlusion rays ignore
+// transparency.
+__kernel void ambientOcclusion(__global const int2 *voxelRefs,
+	__global const ushort *occupancy, __global const float4 *positions,
+	__global const float4 *edges, __global const float3 *pointBuffer,
+	__global const float3 *normalBuffer, __global const float *depthBuffer,
+	__global float *occlusion, int width, int height)
+{
+	const int sampleX = get_global_id(0);
+	const int sampleY = get_global_id(1);
+	const int x = sampleX * AMBIENT_OCCLUSION_SCALE;
+	const int y = sampleY * AMBIENT_OCCLUSION_SCALE;
+	if ((x >= width) || (y >= height))
+	{
+		return;
+	}
+
+	const int sampleWidth = (width + AMBIENT_OCCLUSION_SCALE - 1) / AMBIENT_OCCLUSION_SCALE;
+	const int sampleIndex = sampleX + (sampleY * sampleWidth);
+	const int index = x + (y * width);
+	if (depthBuffer[index] >= FAR_DISTANCE)
+	{
+		occlusion[sampleIndex] = 1.0f;
+		return;
+	}
+
+	// Cosine-weighted directions around the normal.
+	const float3 normal = normalBuffer[index];
+	const float3 tangent = normalize((fabs(normal.x) > 0.5f) ?
+		cross(normal, (float3)(0.0f, 1.0f, 0.0f)) : cross(normal, (float3)(1.0f, 0.0f, 0.0f)));
+	const float3 bitangent = cross(normal, tangent);
+	const float3 origin = pointBuffer[index] + (normal * SURFACE_BIAS);
+	const uint seed = hashUint((uint)x + ((uint)y * 65536u));
+
+	int blocked = 0;
+	for (int i = 0; i < AMBIENT_OCCLUSION_SAMPLES; ++i)
+	{
+		const float r1 = toUnitFloat(hashUint(seed + (uint)(i * 2)));
+		const float r2 = toUnitFloat(hashUint(seed + (uint)((i * 2) + 1)));
+		const float phi = 2.0f * M_PI_F * r1;
+		const float sinTheta = sqrt(r2);
+		const float cosTheta = sqrt(1.0f - r2);
+		const float3 direction = (tangent * (cos(phi) * sinTheta)) +
+			(bitangent * (sin(phi) * sinTheta)) + (normal * cosTheta);
+
+		if (isOccluded(origin, direction, AMBIENT_OCCLUSION_RADIUS, voxelRefs, occupancy,
+			positions, edges, 0, 0, 0))
+		{
+			blocked++;
+		}
+	}
+
+	occlusion[sampleIndex] = 1.0f - (AMBIENT_OCCLUSION_STRENGTH *
+		((float)blocked / (float)AMBIENT_OCCLUSION_SAMPLES));
+}
+
+__kernel void rayTrace(__global const int2 *voxelRefs, __global const int2 *spriteRefs,
+	__global const int2 *lightRefs, __global const float4 *positions,
+	__global const float4 *lights, __global const uchar *textures,
+	__global const GameTime *gameTime, __global const float *depthBuffer,
+	__global const float3 *normalBuffer, __global const float3 *viewBuffer,
+	__global const float3 *pointBuffer, __global const float2 *uvBuffer,
+	__global const int *triangleIndexBuffer, __global float3 *colorBuffer, int width,
+	int height, __global const ushort *occupancy, __global const uchar4 *palettes,
+	__global const float4 *edges, __global const float4 *normals,
+	__global const float2 *uvs, __global const TextureRef *texRefs,
+	__global const int *lightIndices, __global const int *spriteIndices,
+	int spriteTriangleOffset, __global uint *visibility,
+	__global const float *occlusion)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	if ((x >= width) || (y >= height))
+	{
+		return;
+	}
+
+	const int index = x + (y * width);
+	const int triangle = triangleIndexBuffer[index];
+	if (triangle == NO_TRIANGLE)
+	{
+		colorBuffer[index] = getSkyColor(gameTime);
+		return;
+	}
+
+	const float3 normal = normalBuffer[index];
+	const float3 point = pointBuffer[index];
+
+#if AMBIENT_OCCLUSION_SAMPLES > 0
+	const int sampleWidth = (width + AMBIENT_OCCLUSION_SCALE - 1) / AMBIENT_OCCLUSION_SCALE;
+	const float ambient = occlusion[(x / AMBIENT_OCCLUSION_SCALE) +
+		((y / AMBIENT_OCCLUSION_SCALE) * sampleWidth)];
+#else
+	const float ambient = 1.0f;
+#endif
+
+	colorBuffer[index] = shadeHit(getHitCell(point, normal), point, normal, triangle,
+		uvBuffer[index], ambient, gameTime, palettes, texRefs, textures, lights, lightRefs,
+		lightIndices, visibility, voxelRefs, occupancy, positions, edges, uvs);
+}
+
+// FXAA-style filter. Pixels with little luma contrast against their neighbors are
+// copied as they are. Edge pixels are blended with the neighbors across the edge,
+// more so for thin features that stand out from all of their neighbors.
+__kernel void antiAlias(__global const float3 *colorBuffer, __global float3 *filteredBuffer,
+	int width, int height)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	if ((x >= width) || (y >= height))
+	{
+		return;
+	}
+
+	const int index = x + (y * width);
+	const float3 center = colorBuffer[index];
+	const float3 north = colorBuffer[x + (max(y - 1, 0) * width)];
+	const float3 south = colorBuffer[x + (min(y + 1, height - 1) * width)];
+	const float3 west = colorBuffer[max(x - 1, 0) + (y * width)];
+	const float3 east = colorBuffer[min(x + 1, width - 1) + (y * width)];
+
+	const float lumaCenter = getLuma(center);
+	const float lumaNorth = getLuma(north);
+	const float lumaSouth = getLuma(south);
+	const float lumaWest = getLuma(west);
+	const float lumaEast = getLuma(east);
+	const float lumaMin = fmin(lumaCenter,
+		fmin(fmin(lumaNorth, lumaSouth), fmin(lumaWest, lumaEast)));
+	const float lumaMax = fmax(lumaCenter,
+		fmax(fmax(lumaNorth, lumaSouth), fmax(lumaWest, lumaEast)));
+	const float contrast = lumaMax - lumaMin;
+	if (contrast < ANTI_ALIAS_THRESHOLD)
+	{
+		filteredBuffer[index] = center;
+		return;
+	}
+
+	// A horizontal edge changes the most going up and down.
+	const bool horizontal = fabs(lumaNorth + lumaSouth - (2.0f * lumaCenter)) >=
+		fabs(lumaWest + lumaEast - (2.0f * lumaCenter));
+	const float3 across = horizontal ? ((north + south) * 0.5f) : ((west + east) * 0.5f);
+
+	const float subpixel = clamp(fabs(((lumaNorth + lumaSouth + lumaWest + lumaEast) *
+		0.25f) - lumaCenter) / contrast, 0.0f, 1.0f);
+	const float blend = smoothstep(0.0f, 1.0f, subpixel);
+	filteredBuffer[index] = mix(center, across, blend * blend * ANTI_ALIAS_BLEND);
+}
+
+// Darkens the corners of the screen a little.
+__kernel void postProcess(__global float3 *colorBuffer, int width, int height)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	if ((x >= width) || (y >= height))
+	{
+		return;
+	}
+
+	const int index = x + (y * width);
+	const float2 offset = (float2)(((float)x + 0.5f) / (float)width,
+		((float)y + 0.5f) / (float)height) - (float2)(0.5f);
+
+	// The squared distance is 0.5 in the corners.
+	const float vignette = 1.0f - (VIGNETTE_STRENGTH * 2.0f * dot(offset, offset));
+	colorBuffer[index] = clamp(colorBuffer[index] * vignette, 0.0f, 1.0f);
+}
+
+__kernel void convertToRGB(__global const float3 *colorBuffer, __global int *output,
+	int width, int height)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	if ((x >= width) || (y >= height))
+	{
+		return;
+	}
+
+	const int index = x + (y * width);
+	output[index] = toARGB(colorBuffer[index]);
+}
+
+// Intersection, shading, and RGB conversion of a pixel in one pass. Nothing between
+// them goes through global memory, so there's no ambient occlusion, anti-aliasing,
+// post-processing, or frame reuse.
+__kernel void fusedRender(__global const Camera *camera, __global const int2 *voxelRefs,
+	__global const int2 *spriteRefs, __global const int2 *lightRefs,
+	__global const float4 *positions, __global const float4 *lights,
+	__global const uchar *textures, __global const GameTime *gameTime,
+	__global int *output, int width, int height, __global const ushort *occupancy,
+	__global const uchar4 *palettes, __global const float4 *edges,
+	__global const float4 *normals, __global const float2 *uvs,
+	__global const TextureRef *texRefs, __global const int *lightIndices,
+	__global const int *spriteIndices, int spriteTriangleOffset,
+	__global uint *visibility)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	if ((x >= width) || (y >= height))
+	{
+		return;
+	}
+
+	const float3 origin = camera->eye;
+	const float3 direction = getCameraDirection(camera, x, y, width, height);
+
+	int3 hitCell;
+	const Hit hit = traceRay(origin, direction, voxelRefs, spriteRefs, spriteIndices,
+		spriteTriangleOffset, occupancy, positions, edges, uvs, texRefs, textures,
+		&hitCell);
+
+	float3 color;
+	if (hit.triangle == NO_TRIANGLE)
+	{
+		color = getSkyColor(gameTime);
+	}
+	else
+	{
+		const float3 normal = getFacingNormal(normals, hit.triangle, direction);
+		color = shadeHit(hitCell, origin + (direction * hit.t), normal, hit.triangle,
+			hit.uv, 1.0f, gameTime, palettes, texRefs, textures, lights, lightRefs,
+			lightIndices, visibility, voxelRefs, occupancy, positions, edges, uvs);
+	}
+
+	output[x + (y * width)] = toARGB(color);
+}
@@ -7,14 +7,33 @@
 #include "Game.h"
 
 #include "GameState.h"
+#include "Options.h"
+#include "OptionsParser.h"
+#include "../Math/Float3.h"
+#include "../Media/TextureManager.h"
+#include "../Rendering/CLProgram.h"
+#include "../Utilities/Debug.h"
+
+#include "components/vfs/manager.hpp"
+
+namespace
+{
+	// Headless frames show the same world and starting view as a new character, but 
+	// at noon so they aren't dark.
+	const int HEADLESS_WORLD_WIDTH = 32;
+	const int HEADLESS_WORLD_HEIGHT = 5;
+	const int HEADLESS_WORLD_DEPTH = 32;
+	const Float3d HEADLESS_EYE = Float3d(1.50, 1.70, 1.50);
+	const Float3d HEADLESS_DIRECTION = Float3d(1.0, 0.0, 1.0).normalized();
+	const double HEADLESS_GAME_TIME = 12.0 * 60.0;
+}
 
 const int Game::MIN_FPS = 15;
-const int Game::DEFAULT_FPS = 60;
 
 Game::Game()
 {
 	this->gameState = std::unique_ptr<GameState>(new GameState());
-	this->targetFPS = Game::DEFAULT_FPS;
+	this->targetFPS = this->gameState->getOptions().getTargetFPS();
 }
 
 Game::~Game()
@@ -57,3 +76,40 @@ void Game::loop()
 		this->gameState->render();
 	}
 }
+
+bool Game::renderHeadless(int frameCount, const std::string &filename)
+{
+	assert(frameCount > 0);
+
+#ifdef HAVE_OPENCL
+	Debug::mention("Game", "Rendering " + std::to_string(frameCount) +
+		" headless frames.");
+
+	// Use the same options file and data path as the game, without the window.
+	std::unique_ptr<Options> options = OptionsParser::parse();
+	VFS::Manager::get().initialize(std::string(options->getDataPath()));
+
+	if (!CLProgram::hasCompatibleKernel())
+	{
+		return false;
+	}
+
+	TextureManager textureManager;
+	CLProgram clProgram(options->getScreenWidth(), options->getScreenHeight(),
+		HEADLESS_WORLD_WIDTH, HEADLESS_WORLD_HEIGHT, HEADLESS_WORLD_DEPTH,
+		*options.get(), textureManager);
+	clProgram.updateCamera(HEADLESS_EYE, HEADLESS_DIRECTION, options->getVerticalFOV());
+	clProgram.updateGameTime(HEADLESS_GAME_TIME);
+
+	for (int i = 0; i < frameCount; ++i)
+	{
+		clProgram.render();
+	}
+
+	return clProgram.saveFrame(filename);
+#else
+	static_cast<void>(filename);
+	Debug::mention("Game", "Headless frames need the OpenCL renderer.");
+	return false;
+#endif
+}
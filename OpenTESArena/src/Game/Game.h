@@ -2,6 +2,7 @@
 #define GAME_H
 
 #include <memory>
+#include <string>
 
 // This class manages the primary game loop and updates the game state each frame.
 // The actual game properties, current panel, and things relevant to the game are 
@@ -13,7 +14,6 @@ class Game
 {
 private:
     static const int MIN_FPS;
-	static const int DEFAULT_FPS;
 
 	std::unique_ptr<GameState> gameState;
 	int targetFPS;
@@ -25,6 +25,11 @@ public:
 	~Game();
 
 	void loop();
+
+	// Renders frames of the test world with a headless OpenCL program and saves the 
+	// last one as a binary PPM image. No window or audio is opened, so it works on 
+	// machines without a display. Returns whether it succeeded.
+	static bool renderHeadless(int frameCount, const std::string &filename);
 };
 
 #endif
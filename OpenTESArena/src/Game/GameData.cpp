@@ -4,19 +4,19 @@
 
 #include "../Entities/EntityManager.h"
 #include "../Entities/Player.h"
-#include "../Rendering/CLProgram.h"
+#include "../Rendering/WorldRenderer.h"
 #include "../Utilities/Debug.h"
 
 GameData::GameData(std::unique_ptr<Player> player, 
 	std::unique_ptr<EntityManager> entityManager,
-	std::unique_ptr<CLProgram> clProgram, double gameTime,
+	std::unique_ptr<WorldRenderer> worldRenderer, double gameTime,
 	int worldWidth, int worldHeight, int worldDepth)
 {
 	Debug::mention("GameData", "Initializing.");
 
 	this->player = std::move(player);
 	this->entityManager = std::move(entityManager);
-	this->clProgram = std::move(clProgram);
+	this->worldRenderer = std::move(worldRenderer);
 	this->gameTime = gameTime;
 	this->worldWidth = worldWidth;
 	this->worldHeight = worldHeight;
@@ -38,9 +38,9 @@ EntityManager &GameData::getEntityManager() const
 	return *this->entityManager.get();
 }
 
-CLProgram &GameData::getCLProgram() const
+WorldRenderer &GameData::getWorldRenderer() const
 {
-	return *this->clProgram.get();
+	return *this->worldRenderer.get();
 }
 
 double GameData::getGameTime() const
@@ -11,16 +11,16 @@
 // the character resources). Whichever entry points into the "game" there are, they
 // need to load data into the game data object.
 
-class CLProgram;
 class EntityManager;
 class Player;
+class WorldRenderer;
 
 class GameData
 {
 private:
 	std::unique_ptr<Player> player;
 	std::unique_ptr<EntityManager> entityManager;
-	std::unique_ptr<CLProgram> clProgram;
+	std::unique_ptr<WorldRenderer> worldRenderer;
 	double gameTime;
 	int worldWidth, worldHeight, worldDepth;
 	// province... location... voxels... weather...
@@ -29,13 +29,13 @@ private:
 public:
 	GameData(std::unique_ptr<Player> player,
 		std::unique_ptr<EntityManager> entityManager,
-		std::unique_ptr<CLProgram> clProgram, double gameTime,
+		std::unique_ptr<WorldRenderer> worldRenderer, double gameTime,
 		int worldWidth, int worldHeight, int worldDepth);
 	~GameData();
 
 	Player &getPlayer() const;
 	EntityManager &getEntityManager() const;
-	CLProgram &getCLProgram() const;
+	WorldRenderer &getWorldRenderer() const;
 	double getGameTime() const;
 	int getWorldWidth() const;
 	int getWorldHeight() const;
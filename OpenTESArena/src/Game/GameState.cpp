@@ -13,8 +13,8 @@
 #include "../Media/MusicName.h"
 #include "../Media/TextureManager.h"
 #include "../Media/TextureName.h"
-#include "../Rendering/CLProgram.h"
 #include "../Rendering/Renderer.h"
+#include "../Rendering/WorldRenderer.h"
 #include "../Utilities/Debug.h"
 
 #include "components/vfs/manager.hpp"
@@ -115,14 +115,8 @@ void GameState::resizeWindow(int width, int height)
 	
 	if (this->gameDataIsActive())
 	{
-		// Rebuild OpenCL program with new dimensions.		
-		this->gameData->getCLProgram() = std::move(CLProgram(
-			width, height,
-			this->gameData->getWorldWidth(),
-			this->gameData->getWorldHeight(),
-			this->gameData->getWorldDepth(),
-			this->getTextureManager(),
-			this->getRenderer()));
+		// Give the OpenCL program's screen buffers the new dimensions.
+		this->gameData->getWorldRenderer().resize(width, height, this->getRenderer());
 	}
 }
 
@@ -2,13 +2,22 @@
 
 #include "Options.h"
 
+#include "../Rendering/LightGrid.h"
 #include "../Utilities/Debug.h"
 
 Options::Options(std::string &&dataPath, int screenWidth, int screenHeight, bool fullscreen,
-    double verticalFOV, double letterboxAspect, double cursorScale, double hSensitivity, 
-	double vSensitivity, std::string &&soundfont, double musicVolume, double soundVolume, 
-	int soundChannels, bool skipIntro)
-    : dataPath(std::move(dataPath)), soundfont(std::move(soundfont))
+    double verticalFOV, double letterboxAspect, double cursorScale, int framesInFlight,
+	bool fusedRenderKernel, bool packetTraversal, std::string &&clPlatform,
+	std::string &&clDevice, int splitFrameBands, bool kernelProfiling,
+	std::string &&kernelProfileFile, bool softwareRenderer, int renderThreads,
+	int targetFPS, bool resolutionScaling, double minResolutionScale, bool frameReuse,
+	int shadowRays, int ambientOcclusionSamples, bool halfResolutionAO,
+	bool antiAliasing, bool postProcessing, double hSensitivity, double vSensitivity,
+	std::string &&soundfont, double musicVolume, double soundVolume, int soundChannels,
+	bool skipIntro)
+    : clPlatform(std::move(clPlatform)), clDevice(std::move(clDevice)), 
+	kernelProfileFile(std::move(kernelProfileFile)), dataPath(std::move(dataPath)),
+	soundfont(std::move(soundfont))
 {
 	// Make sure each of the values is in a valid range.
 	Debug::check(screenWidth > 0, "Options", "Screen width must be positive.");
@@ -17,6 +26,18 @@ Options::Options(std::string &&dataPath, int screenWidth, int screenHeight, bool
 		"Field of view must be between 0.0 and 180.0 exclusive.");
 	Debug::check(letterboxAspect > 0.0, "Options", "Letterbox aspect must be positive.");
 	Debug::check(cursorScale > 0.0, "Options", "Cursor scale must be positive.");
+	Debug::check((framesInFlight >= 1) && (framesInFlight <= 3), "Options",
+		"Frames in flight must be between 1 and 3.");
+	Debug::check(splitFrameBands >= 1, "Options", "Must have at least one frame band.");
+	Debug::check(renderThreads >= 0, "Options", "Render threads must not be negative.");
+	Debug::check(targetFPS > 0, "Options", "Target FPS must be positive.");
+	Debug::check((minResolutionScale > 0.0) && (minResolutionScale <= 1.0), "Options",
+		"Minimum resolution scale must be greater than 0.0 and at most 1.0.");
+	Debug::check((shadowRays >= 0) && (shadowRays <= LightGrid::MAX_SHADOW_RAYS), "Options",
+		"Shadow rays must be between 0 and " + std::to_string(LightGrid::MAX_SHADOW_RAYS) +
+		".");
+	Debug::check((ambientOcclusionSamples >= 0) && (ambientOcclusionSamples <= 64),
+		"Options", "Ambient occlusion samples must be between 0 and 64.");
 	Debug::check(hSensitivity > 0.0, "Options", "Horizontal sensitivity must be positive.");
 	Debug::check(vSensitivity > 0.0, "Options", "Vertical sensitivity must be positive.");
 	Debug::check((musicVolume >= 0.0) && (musicVolume <= 1.0), "Options", 
@@ -31,6 +52,22 @@ Options::Options(std::string &&dataPath, int screenWidth, int screenHeight, bool
 	this->verticalFOV = verticalFOV;
 	this->letterboxAspect = letterboxAspect;
 	this->cursorScale = cursorScale;
+	this->framesInFlight = framesInFlight;
+	this->fusedRenderKernel = fusedRenderKernel;
+	this->packetTraversal = packetTraversal;
+	this->splitFrameBands = splitFrameBands;
+	this->kernelProfiling = kernelProfiling;
+	this->softwareRenderer = softwareRenderer;
+	this->renderThreads = renderThreads;
+	this->targetFPS = targetFPS;
+	this->resolutionScaling = resolutionScaling;
+	this->minResolutionScale = minResolutionScale;
+	this->frameReuse = frameReuse;
+	this->shadowRays = shadowRays;
+	this->ambientOcclusionSamples = ambientOcclusionSamples;
+	this->halfResolutionAO = halfResolutionAO;
+	this->antiAliasing = antiAliasing;
+	this->postProcessing = postProcessing;
 	this->hSensitivity = hSensitivity;
 	this->vSensitivity = vSensitivity;
 	this->musicVolume = musicVolume;
@@ -74,6 +111,101 @@ double Options::getCursorScale() const
 	return this->cursorScale;
 }
 
+int Options::getFramesInFlight() const
+{
+	return this->framesInFlight;
+}
+
+bool Options::usesFusedRenderKernel() const
+{
+	return this->fusedRenderKernel;
+}
+
+bool Options::usesPacketTraversal() const
+{
+	return this->packetTraversal;
+}
+
+const std::string &Options::getCLPlatform() const
+{
+	return this->clPlatform;
+}
+
+const std::string &Options::getCLDevice() const
+{
+	return this->clDevice;
+}
+
+int Options::getSplitFrameBands() const
+{
+	return this->splitFrameBands;
+}
+
+bool Options::usesKernelProfiling() const
+{
+	return this->kernelProfiling;
+}
+
+const std::string &Options::getKernelProfileFile() const
+{
+	return this->kernelProfileFile;
+}
+
+bool Options::usesSoftwareRenderer() const
+{
+	return this->softwareRenderer;
+}
+
+int Options::getRenderThreadCount() const
+{
+	return this->renderThreads;
+}
+
+int Options::getTargetFPS() const
+{
+	return this->targetFPS;
+}
+
+bool Options::usesResolutionScaling() const
+{
+	return this->resolutionScaling;
+}
+
+double Options::getMinResolutionScale() const
+{
+	return this->minResolutionScale;
+}
+
+bool Options::usesFrameReuse() const
+{
+	return this->frameReuse;
+}
+
+int Options::getShadowRayCount() const
+{
+	return this->shadowRays;
+}
+
+int Options::getAmbientOcclusionSamples() const
+{
+	return this->ambientOcclusionSamples;
+}
+
+bool Options::usesHalfResolutionAO() const
+{
+	return this->halfResolutionAO;
+}
+
+bool Options::usesAntiAliasing() const
+{
+	return this->antiAliasing;
+}
+
+bool Options::usesPostProcessing() const
+{
+	return this->postProcessing;
+}
+
 double Options::getHorizontalSensitivity() const
 {
 	return this->hSensitivity;
@@ -151,6 +283,119 @@ void Options::setCursorScale(double cursorScale)
 	this->cursorScale = cursorScale;
 }
 
+void Options::setFramesInFlight(int framesInFlight)
+{
+	assert(framesInFlight >= 1);
+	assert(framesInFlight <= 3);
+
+	this->framesInFlight = framesInFlight;
+}
+
+void Options::setFusedRenderKernel(bool fusedRenderKernel)
+{
+	this->fusedRenderKernel = fusedRenderKernel;
+}
+
+void Options::setPacketTraversal(bool packetTraversal)
+{
+	this->packetTraversal = packetTraversal;
+}
+
+void Options::setCLPlatform(std::string platform)
+{
+	this->clPlatform = std::move(platform);
+}
+
+void Options::setCLDevice(std::string device)
+{
+	this->clDevice = std::move(device);
+}
+
+void Options::setSplitFrameBands(int bands)
+{
+	assert(bands >= 1);
+
+	this->splitFrameBands = bands;
+}
+
+void Options::setKernelProfiling(bool kernelProfiling)
+{
+	this->kernelProfiling = kernelProfiling;
+}
+
+void Options::setKernelProfileFile(std::string filename)
+{
+	this->kernelProfileFile = std::move(filename);
+}
+
+void Options::setSoftwareRenderer(bool softwareRenderer)
+{
+	this->softwareRenderer = softwareRenderer;
+}
+
+void Options::setRenderThreadCount(int count)
+{
+	assert(count >= 0);
+
+	this->renderThreads = count;
+}
+
+void Options::setTargetFPS(int fps)
+{
+	assert(fps > 0);
+
+	this->targetFPS = fps;
+}
+
+void Options::setResolutionScaling(bool resolutionScaling)
+{
+	this->resolutionScaling = resolutionScaling;
+}
+
+void Options::setMinResolutionScale(double scale)
+{
+	assert(scale > 0.0);
+	assert(scale <= 1.0);
+
+	this->minResolutionScale = scale;
+}
+
+void Options::setFrameReuse(bool frameReuse)
+{
+	this->frameReuse = frameReuse;
+}
+
+void Options::setShadowRayCount(int count)
+{
+	assert(count >= 0);
+	assert(count <= 8);
+
+	this->shadowRays = count;
+}
+
+void Options::setAmbientOcclusionSamples(int samples)
+{
+	assert(samples >= 0);
+	assert(samples <= 64);
+
+	this->ambientOcclusionSamples = samples;
+}
+
+void Options::setHalfResolutionAO(bool halfResolutionAO)
+{
+	this->halfResolutionAO = halfResolutionAO;
+}
+
+void Options::setAntiAliasing(bool antiAliasing)
+{
+	this->antiAliasing = antiAliasing;
+}
+
+void Options::setPostProcessing(bool postProcessing)
+{
+	this->postProcessing = postProcessing;
+}
+
 void Options::setHorizontalSensitivity(double hSensitivity)
 {
 	this->hSensitivity = hSensitivity;
@@ -15,6 +15,24 @@ private:
 	double verticalFOV; // In degrees.
 	double letterboxAspect;
 	double cursorScale;
+	int framesInFlight; // Frames the renderer may have queued before showing one.
+	bool fusedRenderKernel; // Whether to render in one kernel instead of three passes.
+	bool packetTraversal; // Whether to intersect primary rays in packets.
+	std::string clPlatform, clDevice; // "Any", an index, or part of a name.
+	int splitFrameBands; // Horizontal bands rendered by separate command queues.
+	bool kernelProfiling; // Whether to time each stage of a frame.
+	std::string kernelProfileFile; // Where to save stage times on exit. Empty for nowhere.
+	bool softwareRenderer; // Whether to draw the world on the CPU instead of with OpenCL.
+	int renderThreads; // Software renderer threads. 0 for one per hardware thread.
+	int targetFPS; // Frames per second the game loop aims for.
+	bool resolutionScaling; // Whether to trace fewer pixels when frames run long.
+	double minResolutionScale; // Smallest fraction of the screen width and height traced.
+	bool frameReuse; // Whether to skip tracing frames when the view hasn't changed.
+	int shadowRays; // Most shadow rays per pixel. 0 for no shadows.
+	int ambientOcclusionSamples; // Ambient occlusion rays per pixel. 0 for none.
+	bool halfResolutionAO; // Whether to trace ambient occlusion for every 2x2 pixels.
+	bool antiAliasing; // Whether to smooth edges after shading.
+	bool postProcessing; // Whether to run the post-process pass.
 
 	// Input.
 	double hSensitivity, vSensitivity;
@@ -29,9 +47,15 @@ private:
 	bool skipIntro;
 public:
 	Options(std::string &&dataPath, int screenWidth, int screenHeight, bool fullscreen,
-        double verticalFOV, double letterboxAspect, double cursorScale, double hSensitivity, 
-		double vSensitivity, std::string &&soundfont, double musicVolume, double soundVolume,
-        int soundChannels, bool skipIntro);
+        double verticalFOV, double letterboxAspect, double cursorScale, int framesInFlight,
+		bool fusedRenderKernel, bool packetTraversal, std::string &&clPlatform,
+		std::string &&clDevice, int splitFrameBands, bool kernelProfiling,
+		std::string &&kernelProfileFile, bool softwareRenderer, int renderThreads,
+		int targetFPS, bool resolutionScaling, double minResolutionScale, bool frameReuse,
+		int shadowRays, int ambientOcclusionSamples, bool halfResolutionAO,
+		bool antiAliasing, bool postProcessing, double hSensitivity, double vSensitivity,
+		std::string &&soundfont, double musicVolume, double soundVolume, int soundChannels,
+		bool skipIntro);
 	~Options();
 
 	int getScreenWidth() const;
@@ -40,6 +64,25 @@ public:
 	double getVerticalFOV() const;
 	double getLetterboxAspect() const;
 	double getCursorScale() const;
+	int getFramesInFlight() const;
+	bool usesFusedRenderKernel() const;
+	bool usesPacketTraversal() const;
+	const std::string &getCLPlatform() const;
+	const std::string &getCLDevice() const;
+	int getSplitFrameBands() const;
+	bool usesKernelProfiling() const;
+	const std::string &getKernelProfileFile() const;
+	bool usesSoftwareRenderer() const;
+	int getRenderThreadCount() const;
+	int getTargetFPS() const;
+	bool usesResolutionScaling() const;
+	double getMinResolutionScale() const;
+	bool usesFrameReuse() const;
+	int getShadowRayCount() const;
+	int getAmbientOcclusionSamples() const;
+	bool usesHalfResolutionAO() const;
+	bool usesAntiAliasing() const;
+	bool usesPostProcessing() const;
 	double getHorizontalSensitivity() const;
 	double getVerticalSensitivity() const;
 	const std::string &getSoundfont() const;
@@ -55,6 +98,25 @@ public:
 	void setVerticalFOV(double fov);
 	void setLetterboxAspect(double aspect);
 	void setCursorScale(double cursorScale);
+	void setFramesInFlight(int framesInFlight);
+	void setFusedRenderKernel(bool fusedRenderKernel);
+	void setPacketTraversal(bool packetTraversal);
+	void setCLPlatform(std::string platform);
+	void setCLDevice(std::string device);
+	void setSplitFrameBands(int bands);
+	void setKernelProfiling(bool kernelProfiling);
+	void setKernelProfileFile(std::string filename);
+	void setSoftwareRenderer(bool softwareRenderer);
+	void setRenderThreadCount(int count);
+	void setTargetFPS(int fps);
+	void setResolutionScaling(bool resolutionScaling);
+	void setMinResolutionScale(double scale);
+	void setFrameReuse(bool frameReuse);
+	void setShadowRayCount(int count);
+	void setAmbientOcclusionSamples(int samples);
+	void setHalfResolutionAO(bool halfResolutionAO);
+	void setAntiAliasing(bool antiAliasing);
+	void setPostProcessing(bool postProcessing);
 	void setHorizontalSensitivity(double hSensitivity);
 	void setVerticalSensitivity(double vSensitivity);
     void setSoundfont(std::string sfont);
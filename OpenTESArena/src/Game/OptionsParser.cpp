@@ -14,6 +14,25 @@ const std::string OptionsParser::FULLSCREEN_KEY = "Fullscreen";
 const std::string OptionsParser::VERTICAL_FOV_KEY = "VerticalFieldOfView";
 const std::string OptionsParser::LETTERBOX_ASPECT_KEY = "LetterboxAspect";
 const std::string OptionsParser::CURSOR_SCALE_KEY = "CursorScale";
+const std::string OptionsParser::FRAMES_IN_FLIGHT_KEY = "FramesInFlight";
+const std::string OptionsParser::FUSED_RENDER_KERNEL_KEY = "FusedRenderKernel";
+const std::string OptionsParser::PACKET_TRAVERSAL_KEY = "PacketTraversal";
+const std::string OptionsParser::CL_PLATFORM_KEY = "CLPlatform";
+const std::string OptionsParser::CL_DEVICE_KEY = "CLDevice";
+const std::string OptionsParser::SPLIT_FRAME_BANDS_KEY = "SplitFrameBands";
+const std::string OptionsParser::KERNEL_PROFILING_KEY = "KernelProfiling";
+const std::string OptionsParser::KERNEL_PROFILE_FILE_KEY = "KernelProfileFile";
+const std::string OptionsParser::SOFTWARE_RENDERER_KEY = "SoftwareRenderer";
+const std::string OptionsParser::RENDER_THREADS_KEY = "RenderThreads";
+const std::string OptionsParser::TARGET_FPS_KEY = "TargetFPS";
+const std::string OptionsParser::RESOLUTION_SCALING_KEY = "ResolutionScaling";
+const std::string OptionsParser::MIN_RESOLUTION_SCALE_KEY = "MinResolutionScale";
+const std::string OptionsParser::FRAME_REUSE_KEY = "FrameReuse";
+const std::string OptionsParser::SHADOW_RAYS_KEY = "ShadowRays";
+const std::string OptionsParser::AMBIENT_OCCLUSION_SAMPLES_KEY = "AmbientOcclusionSamples";
+const std::string OptionsParser::HALF_RESOLUTION_AO_KEY = "HalfResolutionAO";
+const std::string OptionsParser::ANTI_ALIASING_KEY = "AntiAliasing";
+const std::string OptionsParser::POST_PROCESSING_KEY = "PostProcessing";
 const std::string OptionsParser::H_SENSITIVITY_KEY = "HorizontalSensitivity";
 const std::string OptionsParser::V_SENSITIVITY_KEY = "VerticalSensitivity";
 const std::string OptionsParser::MUSIC_VOLUME_KEY = "MusicVolume";
@@ -39,6 +58,35 @@ std::unique_ptr<Options> OptionsParser::parse()
 	double letterboxAspect = textMap.getDouble(OptionsParser::LETTERBOX_ASPECT_KEY);
 	double cursorScale = textMap.getDouble(OptionsParser::CURSOR_SCALE_KEY);
 
+	// Renderer settings are newer than most options files, so each one that's missing
+	// gets a default that renders like before it was added.
+	int framesInFlight = textMap.getInteger(OptionsParser::FRAMES_IN_FLIGHT_KEY, 1);
+	bool fusedRenderKernel = textMap.getBoolean(
+		OptionsParser::FUSED_RENDER_KERNEL_KEY, false);
+	bool packetTraversal = textMap.getBoolean(OptionsParser::PACKET_TRAVERSAL_KEY, false);
+	std::string clPlatform = textMap.getString(OptionsParser::CL_PLATFORM_KEY, "Any");
+	std::string clDevice = textMap.getString(OptionsParser::CL_DEVICE_KEY, "Any");
+	int splitFrameBands = textMap.getInteger(OptionsParser::SPLIT_FRAME_BANDS_KEY, 1);
+	bool kernelProfiling = textMap.getBoolean(OptionsParser::KERNEL_PROFILING_KEY, false);
+	std::string kernelProfileFile = textMap.getString(
+		OptionsParser::KERNEL_PROFILE_FILE_KEY, "");
+	bool softwareRenderer = textMap.getBoolean(
+		OptionsParser::SOFTWARE_RENDERER_KEY, false);
+	int renderThreads = textMap.getInteger(OptionsParser::RENDER_THREADS_KEY, 0);
+	int targetFPS = textMap.getInteger(OptionsParser::TARGET_FPS_KEY, 60);
+	bool resolutionScaling = textMap.getBoolean(
+		OptionsParser::RESOLUTION_SCALING_KEY, false);
+	double minResolutionScale = textMap.getDouble(
+		OptionsParser::MIN_RESOLUTION_SCALE_KEY, 0.5);
+	bool frameReuse = textMap.getBoolean(OptionsParser::FRAME_REUSE_KEY, false);
+	int shadowRays = textMap.getInteger(OptionsParser::SHADOW_RAYS_KEY, 0);
+	int ambientOcclusionSamples = textMap.getInteger(
+		OptionsParser::AMBIENT_OCCLUSION_SAMPLES_KEY, 0);
+	bool halfResolutionAO = textMap.getBoolean(
+		OptionsParser::HALF_RESOLUTION_AO_KEY, false);
+	bool antiAliasing = textMap.getBoolean(OptionsParser::ANTI_ALIASING_KEY, false);
+	bool postProcessing = textMap.getBoolean(OptionsParser::POST_PROCESSING_KEY, false);
+
 	// Input.
 	double hSensitivity = textMap.getDouble(OptionsParser::H_SENSITIVITY_KEY);
 	double vSensitivity = textMap.getDouble(OptionsParser::V_SENSITIVITY_KEY);
@@ -55,8 +103,12 @@ std::unique_ptr<Options> OptionsParser::parse()
 	
 	return std::unique_ptr<Options>(new Options(std::move(dataPath),
 		screenWidth, screenHeight, fullscreen, verticalFOV, letterboxAspect,
-		cursorScale, hSensitivity, vSensitivity, std::move(soundfont), 
-		musicVolume, soundVolume, soundChannels, skipIntro));
+		cursorScale, framesInFlight, fusedRenderKernel, packetTraversal, std::move(clPlatform),
+		std::move(clDevice), splitFrameBands, kernelProfiling, std::move(kernelProfileFile),
+		softwareRenderer, renderThreads, targetFPS, resolutionScaling, minResolutionScale,
+		frameReuse, shadowRays, ambientOcclusionSamples, halfResolutionAO, antiAliasing,
+		postProcessing, hSensitivity, vSensitivity, std::move(soundfont), musicVolume, soundVolume,
+		soundChannels, skipIntro));
 }
 
 void OptionsParser::save(const Options &options)
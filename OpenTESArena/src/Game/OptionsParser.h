@@ -21,6 +21,25 @@ private:
 	static const std::string VERTICAL_FOV_KEY;
 	static const std::string LETTERBOX_ASPECT_KEY;
 	static const std::string CURSOR_SCALE_KEY;
+	static const std::string FRAMES_IN_FLIGHT_KEY;
+	static const std::string FUSED_RENDER_KERNEL_KEY;
+	static const std::string PACKET_TRAVERSAL_KEY;
+	static const std::string CL_PLATFORM_KEY;
+	static const std::string CL_DEVICE_KEY;
+	static const std::string SPLIT_FRAME_BANDS_KEY;
+	static const std::string KERNEL_PROFILING_KEY;
+	static const std::string KERNEL_PROFILE_FILE_KEY;
+	static const std::string SOFTWARE_RENDERER_KEY;
+	static const std::string RENDER_THREADS_KEY;
+	static const std::string TARGET_FPS_KEY;
+	static const std::string RESOLUTION_SCALING_KEY;
+	static const std::string MIN_RESOLUTION_SCALE_KEY;
+	static const std::string FRAME_REUSE_KEY;
+	static const std::string SHADOW_RAYS_KEY;
+	static const std::string AMBIENT_OCCLUSION_SAMPLES_KEY;
+	static const std::string HALF_RESOLUTION_AO_KEY;
+	static const std::string ANTI_ALIASING_KEY;
+	static const std::string POST_PROCESSING_KEY;
 
 	// Input.
 	static const std::string H_SENSITIVITY_KEY;
@@ -15,6 +15,7 @@
 #include "../Entities/Player.h"
 #include "../Game/GameData.h"
 #include "../Game/GameState.h"
+#include "../Game/Options.h"
 #include "../Math/Constants.h"
 #include "../Math/Int2.h"
 #include "../Media/Color.h"
@@ -28,6 +29,7 @@
 #include "../Media/TextureSequenceName.h"
 #include "../Rendering/CLProgram.h"
 #include "../Rendering/Renderer.h"
+#include "../Rendering/SoftwareRenderer.h"
 
 ChooseAttributesPanel::ChooseAttributesPanel(GameState *gameState,
 	const CharacterClass &charClass, const std::string &name, CharacterGenderName gender,
@@ -103,7 +105,7 @@ ChooseAttributesPanel::ChooseAttributesPanel(GameState *gameState,
 		{
 			// Make placeholders here for the game data. They'll be more informed
 			// in the future once the player has a place in the world and the options
-			// menu has settings for the CLProgram.
+			// menu has settings for the world renderer.
 			std::unique_ptr<EntityManager> entityManager(new EntityManager());
 
 			Float3d position = Float3d(1.50, 1.70, 1.50); // Arbitrary player height.
@@ -123,16 +125,37 @@ ChooseAttributesPanel::ChooseAttributesPanel(GameState *gameState,
 			int worldHeight = 5;
 			int worldDepth = 32;
 
-			std::unique_ptr<CLProgram> clProgram(new CLProgram(
-				gameState->getRenderer().getWindowDimensions().getX(),
-				gameState->getRenderer().getWindowDimensions().getY(),
-				worldWidth, worldHeight, worldDepth,
-				gameState->getTextureManager(),
-				gameState->getRenderer()));
+			// Use the OpenCL renderer unless it's unavailable, its kernel is out of
+			// date, or the options ask for the software renderer.
+			const Int2 windowDimensions = gameState->getRenderer().getWindowDimensions();
+			std::unique_ptr<WorldRenderer> worldRenderer;
+
+#ifdef HAVE_OPENCL
+			if (!gameState->getOptions().usesSoftwareRenderer() &&
+				CLProgram::hasCompatibleKernel())
+			{
+				worldRenderer = std::unique_ptr<WorldRenderer>(new CLProgram(
+					windowDimensions.getX(), windowDimensions.getY(),
+					worldWidth, worldHeight, worldDepth,
+					gameState->getOptions(),
+					gameState->getTextureManager(),
+					gameState->getRenderer()));
+			}
+#endif
+
+			if (worldRenderer.get() == nullptr)
+			{
+				worldRenderer = std::unique_ptr<WorldRenderer>(new SoftwareRenderer(
+					windowDimensions.getX(), windowDimensions.getY(),
+					worldWidth, worldHeight, worldDepth,
+					gameState->getOptions(),
+					gameState->getTextureManager(),
+					gameState->getRenderer()));
+			}
 
 			double gameTime = 0.0; // In seconds. Also affects sun position.
 			std::unique_ptr<GameData> gameData(new GameData(
-				std::move(player), std::move(entityManager), std::move(clProgram),
+				std::move(player), std::move(entityManager), std::move(worldRenderer),
 				gameTime, worldWidth, worldHeight, worldDepth));
 
 			// Set the game data before constructing the game world panel.
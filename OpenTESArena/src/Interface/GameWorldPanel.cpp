@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
 
 #include "SDL.h"
@@ -12,6 +14,9 @@
 #include "TextBox.h"
 #include "WorldMapPanel.h"
 #include "../Entities/CoordinateFrame.h"
+#include "../Entities/Entity.h"
+#include "../Entities/EntityManager.h"
+#include "../Entities/EntityType.h"
 #include "../Entities/Player.h"
 #include "../Game/GameData.h"
 #include "../Game/GameState.h"
@@ -29,10 +34,30 @@
 #include "../Media/TextureFile.h"
 #include "../Media/TextureManager.h"
 #include "../Media/TextureName.h"
-#include "../Rendering/CLProgram.h"
 #include "../Rendering/Renderer.h"
+#include "../Rendering/WorldRenderer.h"
 #include "../Utilities/Debug.h"
 
+namespace
+{
+	// Entity types drawn as sprites that turn to face the camera. Doors don't turn, 
+	// and the player isn't drawn.
+	const std::array<EntityType, 5> SPRITE_ENTITY_TYPES =
+	{
+		EntityType::Container,
+		EntityType::Doodad,
+		EntityType::NonPlayer,
+		EntityType::Projectile,
+		EntityType::Transition
+	};
+
+	// Sprite size (in voxels) and texture index of entities, until entities have 
+	// sprites of their own.
+	const double ENTITY_SPRITE_WIDTH = 0.6;
+	const double ENTITY_SPRITE_HEIGHT = 0.9;
+	const int ENTITY_SPRITE_TEXTURE = 0;
+}
+
 GameWorldPanel::GameWorldPanel(GameState *gameState)
 	: Panel(gameState)
 {
@@ -284,11 +309,37 @@ void GameWorldPanel::tick(double dt, bool &running)
 	auto &player = gameData->getPlayer();
 	player.tick(this->getGameState(), dt);
 
-	// Update CLProgram members that are refreshed each frame.
+	// Update world renderer members that are refreshed each frame.
 	double verticalFOV = this->getGameState()->getOptions().getVerticalFOV();
-	auto &clProgram = gameData->getCLProgram();
-	clProgram.updateCamera(player.getPosition(), player.getDirection(), verticalFOV);
-	clProgram.updateGameTime(gameData->getGameTime());
+	auto &worldRenderer = gameData->getWorldRenderer();
+	worldRenderer.updateCamera(player.getPosition(), player.getDirection(), verticalFOV);
+	worldRenderer.updateGameTime(gameData->getGameTime());
+
+	// Keep entities' sprites where the entities are. Only sprites that changed are 
+	// written again.
+	auto &entityManager = gameData->getEntityManager();
+	std::vector<int> spriteEntityIDs;
+	for (const auto entityType : SPRITE_ENTITY_TYPES)
+	{
+		for (const auto *entity : entityManager.getEntities(entityType))
+		{
+			worldRenderer.setSprite(entity->getID(), entity->getPosition(),
+				ENTITY_SPRITE_WIDTH, ENTITY_SPRITE_HEIGHT, ENTITY_SPRITE_TEXTURE);
+			spriteEntityIDs.push_back(entity->getID());
+		}
+	}
+
+	// Remove the sprites of entities that are gone since the last tick.
+	std::sort(spriteEntityIDs.begin(), spriteEntityIDs.end());
+	for (const int id : this->spriteEntityIDs)
+	{
+		if (!std::binary_search(spriteEntityIDs.begin(), spriteEntityIDs.end(), id))
+		{
+			worldRenderer.removeSprite(id);
+		}
+	}
+
+	this->spriteEntityIDs = std::move(spriteEntityIDs);
 }
 
 void GameWorldPanel::render(Renderer &renderer)
@@ -298,8 +349,8 @@ void GameWorldPanel::render(Renderer &renderer)
 	// Clear original frame buffer.
 	renderer.clearOriginal();
 
-	// Draw game world using OpenCL rendering.
-	this->getGameState()->getGameData()->getCLProgram().render(renderer);
+	// Draw game world using OpenCL or software rendering.
+	this->getGameState()->getGameData()->getWorldRenderer().render(renderer);
 
 	// Set screen palette.
 	auto &textureManager = this->getGameState()->getTextureManager();
@@ -1,6 +1,8 @@
 #ifndef GAME_WORLD_PANEL_H
 #define GAME_WORLD_PANEL_H
 
+#include <vector>
+
 #include "Panel.h"
 
 // When the GameWorldPanel is active, the game world is ticking.
@@ -22,6 +24,7 @@ private:
 	std::unique_ptr<TextBox> playerNameTextBox;
 	std::unique_ptr<Button> automapButton, characterSheetButton, logbookButton, 
 		pauseButton, worldMapButton;
+	std::vector<int> spriteEntityIDs; // Sorted IDs of entities given sprites last tick.
 protected:
 	virtual void handleEvents(bool &running) override;
 	virtual void handleMouse(double dt) override;
@@ -1,4 +1,6 @@
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
 #include "SDL.h"
 
@@ -6,9 +8,19 @@
 
 int main(int argc, char *argv[])
 {
-	// It shouldn't be taking any command line arguments; it loads from text files.
-	static_cast<void>(argc);
-	static_cast<void>(argv);
+	// Settings are loaded from text files. The only command line arguments are for
+	// rendering frames without a window, i.e., "--headless-frames 60 frame.ppm".
+	if ((argc == 4) && (std::string(argv[1]) == "--headless-frames"))
+	{
+		const int frameCount = std::atoi(argv[2]);
+		if (frameCount <= 0)
+		{
+			std::cerr << "The frame count must be positive." << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		return Game::renderHeadless(frameCount, argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
 	Game g;
 	g.loop();
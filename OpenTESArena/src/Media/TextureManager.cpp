@@ -313,6 +313,12 @@ namespace
 const std::string TextureManager::PATH = "data/textures/";
 
 TextureManager::TextureManager(Renderer &renderer)
+	: TextureManager(&renderer) { }
+
+TextureManager::TextureManager()
+	: TextureManager(nullptr) { }
+
+TextureManager::TextureManager(Renderer *renderer)
 	: renderer(renderer)
 {
 	Debug::mention("Texture Manager", "Initializing.");
@@ -361,7 +367,9 @@ SDL_Surface *TextureManager::loadPNG(const std::string &fullPath)
 		"Could not open texture \"" + fullPath + "\".");
 
 	// Try to optimize the SDL_Surface.
-	auto *optSurface = SDL_ConvertSurface(unOptSurface, this->renderer.getFormat(), 0);
+	Debug::check(this->renderer != nullptr, "Texture Manager",
+		"Surfaces need a renderer (\"" + fullPath + "\").");
+	auto *optSurface = SDL_ConvertSurface(unOptSurface, this->renderer->getFormat(), 0);
 	SDL_FreeSurface(unOptSurface);
 	Debug::check(optSurface != nullptr, "Texture Manager",
 		"Could not optimize texture \"" + fullPath + "\".");
@@ -369,7 +377,8 @@ SDL_Surface *TextureManager::loadPNG(const std::string &fullPath)
 	return optSurface;
 }
 
-SDL_Surface *TextureManager::loadIMG(const std::string &filename, PaletteName paletteName)
+std::vector<uint8_t> TextureManager::loadIMGIndices(const std::string &filename,
+	int &outWidth, int &outHeight, Palette &builtInPalette, bool &hasBuiltInPalette)
 {
 	VFS::IStreamPtr stream = VFS::Manager::get().open(filename.c_str());
 	Debug::check(stream != nullptr, "Texture Manager",
@@ -410,8 +419,7 @@ SDL_Surface *TextureManager::loadIMG(const std::string &filename, PaletteName pa
 	/*Debug::check(stream->gcount() == static_cast<std::streamsize>(srcdata.size()),
 		"Texture Manager", "Could not read texture \"" + filename + "\" data.");*/
 
-	Palette custompal;
-	bool hasBuiltInPalette = (flags & 0x0100) > 0;
+	hasBuiltInPalette = (flags & 0x0100) > 0;
 
 	if (hasBuiltInPalette)
 	{
@@ -434,10 +442,10 @@ SDL_Surface *TextureManager::loadIMG(const std::string &filename, PaletteName pa
 		uint8_t r = std::min<uint8_t>(*(iter++), 63) * 255 / 63;
 		uint8_t g = std::min<uint8_t>(*(iter++), 63) * 255 / 63;
 		uint8_t b = std::min<uint8_t>(*(iter++), 63) * 255 / 63;
-		custompal[0] = Color(r, g, b, 0);
+		builtInPalette[0] = Color(r, g, b, 0);
 
 		/* Remaining are solid, so give them 255 alpha. */
-		std::generate(custompal.begin() + 1, custompal.end(),
+		std::generate(builtInPalette.begin() + 1, builtInPalette.end(),
 			[&iter]() -> Color
 		{
 			uint8_t r = std::min<uint8_t>(*(iter++), 63) * 255 / 63;
@@ -446,58 +454,22 @@ SDL_Surface *TextureManager::loadIMG(const std::string &filename, PaletteName pa
 			return Color(r, g, b, 255);
 		});
 	}
-	else 
-	{
-		// Don't try to use a built-in palette is there isn't one.
-		Debug::check(paletteName != PaletteName::BuiltIn, "Texture Manager",
-			"File \"" + filename + "\" does not have a built-in palette.");
-	}
 
-	const Palette &paletteRef = (hasBuiltInPalette && (paletteName == PaletteName::BuiltIn)) ?
-		custompal : this->palettes.at(paletteName);
+	outWidth = width;
+	outHeight = height;
 
 	if ((flags & 0x00FF) == 0x0000)
 	{
 		// Uncompressed IMG.
 		assert(srcdata.size() == (width * height));
-
-		// Create temporary ARGB surface.
-		SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height,
-			Surface::DEFAULT_BPP, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-
-		uint32_t *pixels = static_cast<uint32_t*>(surface->pixels);
-		std::transform(srcdata.begin(), srcdata.end(), pixels,
-			[&paletteRef](uint8_t col) -> uint32_t
-		{
-			return paletteRef[col].toARGB();
-		});
-
-		auto *optSurface = SDL_ConvertSurface(surface, this->renderer.getFormat(), 0);
-		SDL_FreeSurface(surface);
-
-		return optSurface;
+		return srcdata;
 	}
 	else if ((flags & 0x00FF) == 0x0004)
 	{
 		// Type 4 compression.
 		std::vector<uint8_t> decomp(width * height);
 		decode04Type(srcdata.begin(), srcdata.end(), decomp);
-
-		// Create temporary ARGB surface.
-		SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height,
-			Surface::DEFAULT_BPP, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-
-		uint32_t *pixels = static_cast<uint32_t*>(surface->pixels);
-		std::transform(decomp.begin(), decomp.end(), pixels,
-			[&paletteRef](uint8_t col) -> uint32_t
-		{
-			return paletteRef[col].toARGB();
-		});
-
-		auto *optSurface = SDL_ConvertSurface(surface, this->renderer.getFormat(), 0);
-		SDL_FreeSurface(surface);
-
-		return optSurface;
+		return decomp;
 	}
 	else if ((flags & 0x00FF) == 0x0008)
 	{
@@ -507,22 +479,7 @@ SDL_Surface *TextureManager::loadIMG(const std::string &filename, PaletteName pa
 		// Type 8 compression.
 		std::vector<uint8_t> decomp(width * height);
 		decode08Type(srcdata.begin() + 2, srcdata.end(), decomp);
-
-		// Create temporary ARGB surface.
-		SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height,
-			Surface::DEFAULT_BPP, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
-
-		uint32_t *pixels = static_cast<uint32_t*>(surface->pixels);
-		std::transform(decomp.begin(), decomp.end(), pixels,
-			[&paletteRef](uint8_t col) -> uint32_t
-		{
-			return paletteRef[col].toARGB();
-		});
-
-		auto *optSurface = SDL_ConvertSurface(surface, this->renderer.getFormat(), 0);
-		SDL_FreeSurface(surface);
-
-		return optSurface;
+		return decomp;
 	}
 	else
 	{
@@ -546,32 +503,53 @@ SDL_Surface *TextureManager::loadIMG(const std::string &filename, PaletteName pa
 		// involves either two or three (maybe four?) 64x64 wall textures packed 
 		// together vertically.
 
-		width = 64;
-		height = 64;
-		srclen = width * height;
-		srcdata = std::vector<uint8_t>(srclen);
+		outWidth = 64;
+		outHeight = 64;
+		srcdata = std::vector<uint8_t>(outWidth * outHeight);
 
 		// Re-read the file in one big 4096 byte chunk.
 		// To do: use the original stream in this method.
 		VFS::IStreamPtr myStream = VFS::Manager::get().open(filename.c_str());
 		myStream->read(reinterpret_cast<char*>(srcdata.data()), srcdata.size());
+		return srcdata;
+	}
+}
 
-		// Create temporary ARGB surface.
-		SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height,
-			Surface::DEFAULT_BPP, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+SDL_Surface *TextureManager::loadIMG(const std::string &filename, PaletteName paletteName)
+{
+	int width, height;
+	Palette custompal;
+	bool hasBuiltInPalette;
+	std::vector<uint8_t> indices = this->loadIMGIndices(
+		filename, width, height, custompal, hasBuiltInPalette);
 
-		uint32_t *pixels = static_cast<uint32_t*>(surface->pixels);
-		std::transform(srcdata.begin(), srcdata.end(), pixels,
-			[&paletteRef](uint8_t col) -> uint32_t
-		{
-			return paletteRef[col].toARGB();
-		});
+	if (!hasBuiltInPalette)
+	{
+		// Don't try to use a built-in palette is there isn't one.
+		Debug::check(paletteName != PaletteName::BuiltIn, "Texture Manager",
+			"File \"" + filename + "\" does not have a built-in palette.");
+	}
+
+	const Palette &paletteRef = (hasBuiltInPalette && (paletteName == PaletteName::BuiltIn)) ?
+		custompal : this->palettes.at(paletteName);
 
-		auto *optSurface = SDL_ConvertSurface(surface, this->renderer.getFormat(), 0);
-		SDL_FreeSurface(surface);
+	// Create temporary ARGB surface.
+	SDL_Surface *surface = SDL_CreateRGBSurface(0, width, height,
+		Surface::DEFAULT_BPP, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
 
-		return optSurface;
-	}
+	uint32_t *pixels = static_cast<uint32_t*>(surface->pixels);
+	std::transform(indices.begin(), indices.end(), pixels,
+		[&paletteRef](uint8_t col) -> uint32_t
+	{
+		return paletteRef[col].toARGB();
+	});
+
+	Debug::check(this->renderer != nullptr, "Texture Manager",
+		"Surfaces need a renderer (\"" + filename + "\").");
+	auto *optSurface = SDL_ConvertSurface(surface, this->renderer->getFormat(), 0);
+	SDL_FreeSurface(surface);
+
+	return optSurface;
 }
 
 void TextureManager::initPalette(Palette &palette, PaletteName paletteName)
@@ -711,7 +689,7 @@ SDL_Texture *TextureManager::getTexture(const std::string &filename,
 		// Make a texture from the surface. It's okay if the surface isn't used except
 		// for, say, texture dimensions (instead of doing SDL_QueryTexture()).
 		const Surface &surface = this->getSurface(filename, paletteName);		
-		SDL_Texture *texture = this->renderer.createTextureFromSurface(surface);
+		SDL_Texture *texture = this->renderer->createTextureFromSurface(surface);
 		
 		// Add the new texture and return it.
 		auto iter = this->textures.emplace(std::make_pair(namePair, texture)).first;
@@ -724,6 +702,30 @@ SDL_Texture *TextureManager::getTexture(const std::string &filename)
 	return this->getTexture(filename, this->activePalette);
 }
 
+std::vector<uint8_t> TextureManager::getIndices(const std::string &filename,
+	int &width, int &height)
+{
+	Palette builtInPalette;
+	bool hasBuiltInPalette;
+	return this->loadIMGIndices(filename, width, height, builtInPalette, hasBuiltInPalette);
+}
+
+const std::array<Color, 256> &TextureManager::getPalette(PaletteName paletteName)
+{
+	// Error if the palette name is "built-in".
+	assert(paletteName != PaletteName::BuiltIn);
+
+	auto paletteIter = this->palettes.find(paletteName);
+	if (paletteIter == this->palettes.end())
+	{
+		Palette palette;
+		this->initPalette(palette, paletteName);
+		paletteIter = this->palettes.insert(std::make_pair(paletteName, palette)).first;
+	}
+
+	return paletteIter->second;
+}
+
 void TextureManager::setPalette(PaletteName paletteName)
 {
 	// Error if the palette name is "built-in".
@@ -757,13 +759,13 @@ void TextureManager::reloadTextures(Renderer &renderer)
 {
 	// This assignment isn't completely necessary. The renderer shouldn't need to 
 	// be destroyed and reinitialized on window resize events.
-	this->renderer = renderer;
+	this->renderer = &renderer;
 
 	for (auto &pair : this->textures)
 	{
 		SDL_DestroyTexture(pair.second);
 		const std::string &filename = pair.first.first;
 		const Surface &surface = this->getSurface(filename);
-		this->textures.at(pair.first) = this->renderer.createTextureFromSurface(surface);
+		this->textures.at(pair.first) = this->renderer->createTextureFromSurface(surface);
 	}
 }
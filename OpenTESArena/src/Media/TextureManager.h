@@ -3,8 +3,10 @@
 
 #include <array>
 #include <map>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "../Interface/Surface.h"
 #include "Color.h"
@@ -51,17 +53,31 @@ private:
 	std::map<PaletteName, Palette> palettes;
 	std::unordered_map<std::pair<std::string, PaletteName>, Surface> surfaces;
 	std::unordered_map<std::pair<std::string, PaletteName>, SDL_Texture*> textures;
-	Renderer &renderer;
+	Renderer *renderer; // Null when there's no window to make surfaces and textures for.
 	PaletteName activePalette;
 
 	SDL_Surface *loadPNG(const std::string &fullPath);
+
+	// Reads the 8-bit palette indices of an IMG file, along with its dimensions and
+	// its built-in palette if it has one.
+	std::vector<uint8_t> loadIMGIndices(const std::string &filename, int &width,
+		int &height, Palette &builtInPalette, bool &hasBuiltInPalette);
 	SDL_Surface *loadIMG(const std::string &filename, PaletteName paletteName);
 	// Perhaps methods like "loadDFA" and "loadCIF" would return a vector of surfaces.
 
 	// Initialize the given palette with a certain palette from file.
 	void initPalette(Palette &palette, PaletteName paletteName);
+
+	// Constructor for either mode. Without a renderer, only palettes and palette 
+	// indices can be loaded.
+	TextureManager(Renderer *renderer);
 public:
 	TextureManager(Renderer &renderer);
+
+	// Constructor for headless use (i.e., rendering frames without a window). Only 
+	// getIndices() and getPalette() work, since surfaces and textures need the 
+	// renderer's pixel format.
+	TextureManager();
 	~TextureManager();
 
 	TextureManager &operator =(TextureManager &&textureManager);
@@ -75,6 +91,13 @@ public:
 	SDL_Texture *getTexture(const std::string &filename, PaletteName paletteName);
 	SDL_Texture *getTexture(const std::string &filename);
 
+	// Gets the 8-bit palette indices of an IMG file, for renderers that look up 
+	// colors themselves (i.e., for palette swapping on the GPU).
+	std::vector<uint8_t> getIndices(const std::string &filename, int &width, int &height);
+
+	// Gets the colors of a palette, loading it from file if necessary.
+	const std::array<Color, 256> &getPalette(PaletteName paletteName);
+
 	// Sets the palette for subsequent surfaces and textures. If a requested image 
 	// is not currently loaded for the active palette, it is loaded from file.
 	void setPalette(PaletteName paletteName);
@@ -1,51 +1,366 @@
+#ifdef HAVE_OPENCL
+
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
 
 #include "SDL.h"
 
 #include "CLProgram.h"
+#include "RenderProfiler.h"
 
 #include "../Entities/Directable.h"
-#include "../Interface/Surface.h"
+#include "../Game/Options.h"
 #include "../Math/Constants.h"
 #include "../Math/Float2.h"
 #include "../Math/Float3.h"
-#include "../Math/Float4.h"
-#include "../Math/Random.h"
 #include "../Math/Triangle.h"
+#include "../Media/Color.h"
 #include "../Media/PaletteName.h"
 #include "../Media/TextureManager.h"
 #include "../Rendering/Renderer.h"
 #include "../Utilities/Debug.h"
 #include "../Utilities/File.h"
+#include "../Utilities/KvpTextMap.h"
+#include "../Utilities/String.h"
+#include "../World/Voxel.h"
+#include "../World/VoxelType.h"
 
 namespace
 {
+	// Program binaries are cached next to the kernel source, and are named after a hash
+	// of everything that affects them.
+	const std::string PROGRAM_BINARY_PREFIX = "kernel-";
+	const std::string PROGRAM_BINARY_EXTENSION = ".bin";
+
+	// The tuning file remembers the best tile size for the last device used.
+	const std::string TUNING_FILENAME = "options/tuning.txt";
+	const std::string TUNING_DEVICE_KEY = "Device";
+	const std::string TUNING_TILE_WIDTH_KEY = "TileWidth";
+	const std::string TUNING_TILE_HEIGHT_KEY = "TileHeight";
+
+	// Tile sizes to try for the render kernels, and how many frames each one is timed.
+	// Sizes larger than what the device or kernels allow are skipped.
+	const std::vector<std::pair<int, int>> TILE_CANDIDATES =
+	{
+		{ 8, 8 }, { 16, 8 }, { 8, 16 }, { 16, 16 }, { 32, 8 }, { 32, 4 }
+	};
+
+	const int TUNING_FRAMES_PER_CANDIDATE = 4;
+
+	// Dimensions of a packet of primary rays in the packet intersect kernel, and how
+	// many voxel cells and triangles each packet keeps in local memory at once.
+	const int PACKET_WIDTH = 4;
+	const int PACKET_HEIGHT = 4;
+	const int PACKET_CELL_CACHE = 32;
+	const int PACKET_TRIANGLE_CACHE = 16;
+
+	// Platform and device option value that keeps the default choice.
+	const std::string ANY_SELECTION = "Any";
+
+	// Bands that rendered nothing in the last frame still get this share of the screen,
+	// so they're measured again. The rest of a band's new share moves toward its timed
+	// share by the response fraction each frame, so one slow frame doesn't throw the
+	// bands around.
+	const double MIN_BAND_SHARE = 0.05;
+	const double BAND_SHARE_RESPONSE = 0.5;
+
+	// With resolution scaling, the kernels get this share of a frame at the target frame
+	// rate. The rest is left for the game and for presenting.
+	const double RESOLUTION_BUDGET_SHARE = 0.75;
+
+	// Kernel times are smoothed by this fraction each frame, so one slow frame doesn't
+	// drop the resolution. The scale only goes back up once frames are comfortably under
+	// budget, so it doesn't flip back and forth between two sizes.
+	const double FRAME_TIME_RESPONSE = 0.2;
+	const double RESOLUTION_UPSCALE_HEADROOM = 0.85;
+
+	// Largest changes to the resolution scale in one frame. Going down is quicker than
+	// going up, since a long frame is worse than a blurry one. Smaller changes than the
+	// minimum are ignored.
+	const double MAX_SCALE_DECREASE = 0.1;
+	const double MAX_SCALE_INCREASE = 0.02;
+	const double MIN_SCALE_CHANGE = 0.01;
+
+	// With frame reuse, a still frame is shaded again once the day/night blend has moved
+	// by one step of an 8-bit color, or once this many seconds of game time have passed
+	// so time-based effects keep moving.
+	const double RESHADE_DAYLIGHT_STEP = 1.0 / 256.0;
+	const double RESHADE_INTERVAL = 0.1;
+
+	// Frames of stage times the profiler keeps, and the stage names that aren't kernels.
+	const int PROFILE_WINDOW_SIZE = 300;
+	const std::string PROFILE_READ_BACK_STAGE = "readBack";
+	const std::string PROFILE_TEXTURE_UPDATE_STAGE = "textureUpdate";
+
+	// Gets the milliseconds between the start and end of a profiled command.
+	double getEventMilliseconds(const cl::Event &event)
+	{
+		const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		return (end > start) ? (static_cast<double>(end - start) / 1.0e6) : 0.0;
+	}
+
+	// Picks a platform or device from a list of names with an option value. "Any" gives
+	// -1 so the caller can use its default, a number is an index into the list, and 
+	// anything else is the first name containing it.
+	int selectByName(const std::string &selection, const std::vector<std::string> &names,
+		const std::string &kind)
+	{
+		if (selection == ANY_SELECTION)
+		{
+			return -1;
+		}
+
+		const bool isIndex = (selection.size() > 0) &&
+			std::all_of(selection.begin(), selection.end(), 
+				[](char c) { return (c >= '0') && (c <= '9'); });
+
+		if (isIndex)
+		{
+			const int index = std::stoi(selection);
+			Debug::check(index < static_cast<int>(names.size()), "CLProgram",
+				"No OpenCL " + kind + " at index " + selection + ".");
+			return index;
+		}
+
+		for (int i = 0; i < static_cast<int>(names.size()); ++i)
+		{
+			if (names.at(i).find(selection) != std::string::npos)
+			{
+				return i;
+			}
+		}
+
+		Debug::crash("CLProgram", "No OpenCL " + kind + " named \"" + selection + "\".");
+		return -1;
+	}
+
+	// Number of colors in a palette.
+	const int PALETTE_LENGTH = 256;
+
+	// Palettes kept on the device, in the order of their slots in the palette buffer.
+	const std::array<PaletteName, 3> DEVICE_PALETTES =
+	{
+		PaletteName::Default, PaletteName::Daytime, PaletteName::Dreary
+	};
+
+	// Length of a day in game time seconds. Game time zero is midnight.
+	const double DAY_LENGTH = 24.0 * 60.0;
+
+	// Gets the slot of a palette in the palette buffer.
+	int getPaletteSlot(PaletteName paletteName)
+	{
+		const auto iter = std::find(DEVICE_PALETTES.begin(), DEVICE_PALETTES.end(),
+			paletteName);
+		Debug::check(iter != DEVICE_PALETTES.end(), "CLProgram",
+			"Palette is not available on the device.");
+
+		return static_cast<int>(std::distance(DEVICE_PALETTES.begin(), iter));
+	}
+
+	// Voxel widths of the small and large occupancy bricks.
+	const int OCCUPANCY_SMALL_BRICK = 4;
+	const int OCCUPANCY_LARGE_BRICK = 16;
+
+	// Gets the number of bricks needed to cover a world dimension.
+	int getBrickCount(int size, int brickSize)
+	{
+		return (size + brickSize - 1) / brickSize;
+	}
+
+	// Rounds a global work size up to a multiple of the tile size.
+	cl::size_type padToTile(int size, int tile)
+	{
+		return static_cast<cl::size_type>(((size + tile - 1) / tile) * tile);
+	}
+
+	// 64-bit FNV-1a hash, for naming cached program binaries.
+	uint64_t getFnv1aHash(const std::string &text)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (const char c : text)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
 	// These sizes are intended to match those of the .cl file structs. OpenCL 
 	// aligns structs to multiples of 8 bytes. Additional padding is sometimes 
 	// necessary to match struct alignment.
 	const cl::size_type SIZEOF_CAMERA = (sizeof(cl_float3) * 4) + sizeof(cl_float) + 12;
-	const cl::size_type SIZEOF_LIGHT = sizeof(cl_float3) * 2;
+	const cl::size_type SIZEOF_GAME_TIME = sizeof(cl_float) + (sizeof(cl_int) * 2) +
+		sizeof(cl_float);
+
+	// The uniform block holds the camera followed by the game time.
+	const cl::size_type UNIFORM_CAMERA_OFFSET = 0;
+	const cl::size_type UNIFORM_GAME_TIME_OFFSET = UNIFORM_CAMERA_OFFSET + SIZEOF_CAMERA;
+	const cl::size_type SIZEOF_UNIFORMS = UNIFORM_GAME_TIME_OFFSET + SIZEOF_GAME_TIME;
+	const cl::size_type SIZEOF_LIGHT = sizeof(cl_float4) * 2;
 	const cl::size_type SIZEOF_LIGHT_REF = sizeof(cl_int) * 2;
 	const cl::size_type SIZEOF_SPRITE_REF = sizeof(cl_int) * 2;
-	const cl::size_type SIZEOF_TEXTURE_REF = sizeof(cl_int) + (sizeof(cl_short) * 2);
-	const cl::size_type SIZEOF_TRIANGLE = (sizeof(cl_float3) * 4) +
-		(sizeof(cl_float2) * 3) + SIZEOF_TEXTURE_REF;
 	const cl::size_type SIZEOF_VOXEL_REF = sizeof(cl_int) * 2;
+
+	// Packets only cache what the intersection test reads: each triangle's position
+	// and edges.
+	const cl::size_type SIZEOF_PACKET_TRIANGLE =
+		TrianglePacker::getStride(TriangleStream::Positions) +
+		TrianglePacker::getStride(TriangleStream::Edges);
+
+	// Gets the local memory the packet caches of a work-group need with the given tile
+	// size, or zero if the tile isn't made of whole packets.
+	cl::size_type getPacketCacheBytes(const std::pair<int, int> &tileSize)
+	{
+		if (((tileSize.first % PACKET_WIDTH) != 0) ||
+			((tileSize.second % PACKET_HEIGHT) != 0))
+		{
+			return 0;
+		}
+
+		const cl::size_type packetCount = (tileSize.first / PACKET_WIDTH) *
+			(tileSize.second / PACKET_HEIGHT);
+		return packetCount * ((sizeof(cl_int) * PACKET_CELL_CACHE) +
+			(SIZEOF_PACKET_TRIANGLE * PACKET_TRIANGLE_CACHE));
+	}
+
+	// Kernel argument of each triangle stream, in TrianglePacker::STREAMS order. The
+	// positions take the place of the old array-of-structs triangle buffer, and the
+	// other streams come after each kernel's existing arguments (after the packet
+	// caches, for the packet variant of the intersect kernel).
+	const std::array<int, 5> FUSED_RENDER_TRIANGLE_ARGS = { 4, 13, 14, 15, 16 };
+	const std::array<int, 5> INTERSECT_TRIANGLE_ARGS = { 3, 14, 15, 16, 17 };
+	const std::array<int, 5> INTERSECT_PACKET_TRIANGLE_ARGS = { 3, 16, 17, 18, 19 };
+	const std::array<int, 5> RAY_TRACE_TRIANGLE_ARGS = { 3, 18, 19, 20, 21 };
+
+	// The kernel source defines its interface version, which must match this one. It 
+	// changes whenever kernel arguments or buffer layouts change, so a kernel.cl from 
+	// an older data download isn't built and run with the wrong arguments. Kernels 
+	// from before the version existed count as version 0.
+	const std::string KERNEL_INTERFACE_VERSION_NAME = "KERNEL_INTERFACE_VERSION";
+	const int KERNEL_INTERFACE_VERSION = 14;
+
+	// Number of triangles the triangle buffer starts with. It grows as needed, so this
+	// only needs to be big enough to avoid a few reallocations for small worlds.
+	const int INITIAL_TRIANGLE_CAPACITY = 1024;
+
+	// Number of lights and cell light IDs the light buffers start with. They grow as
+	// needed, like the triangle buffers.
+	const int INITIAL_LIGHT_CAPACITY = 64;
+	const int INITIAL_LIGHT_INDEX_CAPACITY = 1024;
+
+	// Kernel argument of the cell light IDs, after each kernel's existing arguments.
+	const int FUSED_RENDER_LIGHT_INDEX_ARG = 17;
+	const int RAY_TRACE_LIGHT_INDEX_ARG = 22;
+
+	// Kernel argument of the visibility cache, after the sprite arguments.
+	const int FUSED_RENDER_VISIBILITY_ARG = 20;
+	const int RAY_TRACE_VISIBILITY_ARG = 25;
+
+	// Kernel argument of the ambient occlusion grid in rayTrace, and of the triangle
+	// positions and edges in ambientOcclusion (the only streams it reads).
+	const int RAY_TRACE_OCCLUSION_ARG = 26;
+	const std::array<int, 2> AMBIENT_OCCLUSION_TRIANGLE_ARGS = { 2, 3 };
+
+	// Luma contrast with the neighbors below which the anti-alias pass copies a pixel
+	// as is, so only edges are filtered.
+	const double ANTI_ALIAS_THRESHOLD = 0.125;
+
+	// Number of sprite indices the sprite index buffer starts with, and the fewest 
+	// triangles the sprite triangle region is given. Both grow as needed.
+	const int INITIAL_SPRITE_INDEX_CAPACITY = 256;
+	const int INITIAL_SPRITE_TRIANGLES = 256;
+
+	// Kernel arguments of the sprite indices and the first triangle of the sprite
+	// triangle region, after each kernel's existing arguments.
+	const std::array<int, 2> FUSED_RENDER_SPRITE_ARGS = { 18, 19 };
+	const std::array<int, 2> INTERSECT_SPRITE_ARGS = { 18, 19 };
+	const std::array<int, 2> INTERSECT_PACKET_SPRITE_ARGS = { 20, 21 };
+	const std::array<int, 2> RAY_TRACE_SPRITE_ARGS = { 23, 24 };
+
+	// Dirty ranges closer together than this are written to the device as one range,
+	// since rewriting a few clean bytes is cheaper than another write command.
+	const cl::size_type DIRTY_RANGE_GAP_BYTES = 256;
+
+	// Sorts [begin, end) ranges and merges the ones that overlap or are within the 
+	// given gap of each other.
+	std::vector<std::pair<int, int>> coalesceRanges(std::vector<std::pair<int, int>> &ranges,
+		int maxGap)
+	{
+		std::sort(ranges.begin(), ranges.end());
+
+		std::vector<std::pair<int, int>> merged;
+		for (const auto &range : ranges)
+		{
+			if ((merged.size() > 0) && (range.first <= (merged.back().second + maxGap)))
+			{
+				merged.back().second = std::max(merged.back().second, range.second);
+			}
+			else
+			{
+				merged.push_back(range);
+			}
+		}
+
+		return merged;
+	}
+
+	// Writes a voxel reference into a local buffer at the given pointer.
+	void writeVoxelRef(const VoxelReference &voxelRef, cl_char *ptr)
+	{
+		cl_int *refPtr = reinterpret_cast<cl_int*>(ptr);
+		*(refPtr + 0) = voxelRef.getOffset(); // Number of triangles to skip.
+		*(refPtr + 1) = voxelRef.getTriangleCount();
+	}
+
+	// Gets the interface version defined in the kernel source, or 0 if there is none.
+	int getKernelInterfaceVersion(const std::string &source)
+	{
+		const std::string prefix = "#define " + KERNEL_INTERFACE_VERSION_NAME + " ";
+		const size_t index = source.find(prefix);
+		if (index == std::string::npos)
+		{
+			return 0;
+		}
+
+		return std::atoi(source.c_str() + index + prefix.size());
+	}
 }
 
 const std::string CLProgram::PATH = "data/kernels/";
 const std::string CLProgram::FILENAME = "kernel.cl";
 const std::string CLProgram::INTERSECT_KERNEL = "intersect";
+const std::string CLProgram::INTERSECT_PACKET_KERNEL = "intersectPacket";
 const std::string CLProgram::AMBIENT_OCCLUSION_KERNEL = "ambientOcclusion";
 const std::string CLProgram::RAY_TRACE_KERNEL = "rayTrace";
 const std::string CLProgram::ANTI_ALIAS_KERNEL = "antiAlias";
 const std::string CLProgram::POST_PROCESS_KERNEL = "postProcess";
 const std::string CLProgram::CONVERT_TO_RGB_KERNEL = "convertToRGB";
+const std::string CLProgram::FUSED_RENDER_KERNEL = "fusedRender";
+
+CLProgram::CLProgram(int width, int height, int worldWidth, int worldHeight,
+	int worldDepth, const Options &options, TextureManager &textureManager,
+	Renderer &renderer)
+	: CLProgram(width, height, worldWidth, worldHeight, worldDepth, options,
+		textureManager, &renderer) { }
+
+CLProgram::CLProgram(int width, int height, int worldWidth, int worldHeight,
+	int worldDepth, const Options &options, TextureManager &textureManager)
+	: CLProgram(width, height, worldWidth, worldHeight, worldDepth, options,
+		textureManager, nullptr) { }
 
 CLProgram::CLProgram(int width, int height, int worldWidth, int worldHeight,
-	int worldDepth, TextureManager &textureManager, Renderer &renderer)
-	: textureManager(textureManager)
+	int worldDepth, const Options &options, TextureManager &textureManager,
+	Renderer *renderer)
+	: textureManager(textureManager), lightGrid(worldWidth, worldHeight, worldDepth),
+	spriteGrid(worldWidth, worldHeight, worldDepth), spriteTriangleRun(0, 0)
 {
 	assert(width > 0);
 	assert(height > 0);
@@ -55,96 +370,391 @@ CLProgram::CLProgram(int width, int height, int worldWidth, int worldHeight,
 
 	Debug::mention("CLProgram", "Initializing.");
 
+	if (renderer == nullptr)
+	{
+		Debug::mention("CLProgram", "Headless, so frames are only kept on the host.");
+	}
+
+	this->headless = renderer == nullptr;
 	this->width = width;
 	this->height = height;
 	this->worldWidth = worldWidth;
 	this->worldHeight = worldHeight;
 	this->worldDepth = worldDepth;
+	this->triangleCount = 0;
+	this->triangleCapacity = INITIAL_TRIANGLE_CAPACITY;
+	this->lightCapacity = INITIAL_LIGHT_CAPACITY;
+	this->lightIndexCapacity = INITIAL_LIGHT_INDEX_CAPACITY;
+	this->spriteIndexCapacity = INITIAL_SPRITE_INDEX_CAPACITY;
+	this->shadowRays = options.getShadowRayCount();
+	assert(this->shadowRays <= LightGrid::MAX_SHADOW_RAYS);
+	this->fused = options.usesFusedRenderKernel();
+	this->packetTraversal = options.usesPacketTraversal() && !this->fused;
+	this->packetLocalMemory = 0;
+	this->occlusionSamples = this->fused ? 0 : options.getAmbientOcclusionSamples();
+	this->occlusionScale = options.usesHalfResolutionAO() ? 2 : 1;
+	this->antiAliasing = options.usesAntiAliasing() && !this->fused;
+	this->postProcessing = options.usesPostProcessing() && !this->fused;
+
+	if (options.usesPacketTraversal() && this->fused)
+	{
+		Debug::mention("CLProgram", "Packet traversal needs the multi-pass kernels.");
+	}
 
-	// Create the local output pixel buffer.
-	this->outputData = std::vector<char>(sizeof(cl_int) * width * height);
+	if (this->fused && ((options.getAmbientOcclusionSamples() > 0) ||
+		options.usesAntiAliasing() || options.usesPostProcessing()))
+	{
+		Debug::mention("CLProgram", "Ambient occlusion, anti-aliasing, and " 
+			"post-processing need the multi-pass kernels.");
+	}
 
-	// Create streaming texture to be used as the game world frame buffer.	
-	this->texture = renderer.createTexture(SDL_PIXELFORMAT_ARGB8888,
-		SDL_TEXTUREACCESS_STREAMING, width, height);
-	Debug::check(this->texture != nullptr, "CLProgram", "SDL_CreateTexture");
+	// Host copy of the voxel references. All zeroes means every voxel is empty.
+	this->voxelRefData = std::vector<char>(
+		SIZEOF_VOXEL_REF * worldWidth * worldHeight * worldDepth);
+
+	// Host copy of the occupancy hierarchy. The whole thing is uploaded once so the 
+	// device starts with every brick empty.
+	const int smallBrickCount = 
+		getBrickCount(worldWidth, OCCUPANCY_SMALL_BRICK) *
+		getBrickCount(worldHeight, OCCUPANCY_SMALL_BRICK) *
+		getBrickCount(worldDepth, OCCUPANCY_SMALL_BRICK);
+	const int largeBrickCount = 
+		getBrickCount(worldWidth, OCCUPANCY_LARGE_BRICK) *
+		getBrickCount(worldHeight, OCCUPANCY_LARGE_BRICK) *
+		getBrickCount(worldDepth, OCCUPANCY_LARGE_BRICK);
+	this->occupancyLargeOffset = smallBrickCount;
+	this->occupancyData = std::vector<char>(
+		sizeof(cl_ushort) * (smallBrickCount + largeBrickCount));
+	this->dirtyOccupancy.push_back(std::make_pair(0, smallBrickCount + largeBrickCount));
+	this->spriteVoxels = std::vector<bool>(worldWidth * worldHeight * worldDepth, false);
+
+	// Prepare for mapping the output buffers, one for each frame in flight.
+	const int framesInFlight = options.getFramesInFlight();
+	this->mappedOutputs = std::vector<void*>(framesInFlight, nullptr);
+	this->mapEvents = std::vector<cl::Event>(framesInFlight);
+	this->mapPending = std::vector<bool>(framesInFlight, false);
+	this->profileEvents = std::vector<std::vector<std::pair<std::string, cl::Event>>>(
+		framesInFlight);
+	this->frameIndex = 0;
+
+	// Start tracing at full resolution.
+	this->resolutionScaling = options.usesResolutionScaling();
+	this->resolutionScale = 1.0;
+	this->minResolutionScale = options.getMinResolutionScale();
+	this->frameBudget = (1000.0 / static_cast<double>(options.getTargetFPS())) *
+		RESOLUTION_BUDGET_SHARE;
+	this->smoothedFrameTime = -1.0;
+	this->renderWidth = width;
+	this->renderHeight = height;
+	this->frameDimensions = std::vector<std::pair<int, int>>(framesInFlight,
+		std::make_pair(width, height));
+	this->shownDimensions = std::make_pair(width, height);
+
+	// Nothing has been traced yet, so the first frame is rendered in full.
+	this->frameReuse = options.usesFrameReuse();
+	this->historyValid = false;
+	this->cameraMoved = true;
+	this->worldChanged = true;
+	this->shadingDirty = true;
+	this->timingPending = false;
+	this->gameTime = 0.0;
+	this->daylight = 0.0;
+	this->shadedGameTime = 0.0;
+	this->shadedDaylight = 0.0;
+
+	if (options.usesKernelProfiling())
+	{
+		Debug::mention("CLProgram", "Kernel profiling is on.");
+		this->profiler = std::unique_ptr<RenderProfiler>(
+			new RenderProfiler(PROFILE_WINDOW_SIZE));
+		this->profileFilename = options.getKernelProfileFile();
+	}
 
 	// Get the OpenCL platforms (i.e., AMD, Intel, Nvidia) available on the machine.
 	auto platforms = CLProgram::getPlatforms();
 	Debug::check(platforms.size() > 0, "CLProgram", "No OpenCL platform found.");
 
-	// Look at the first platform. Most computers shouldn't have more than one.
-	// More robust code can check for multiple platforms in the future.
-	const auto &platform = platforms.at(0);
+	// List the platforms so the platform option can name one. The first platform is
+	// used unless the options say otherwise.
+	std::vector<std::string> platformNames;
+	for (const auto &platform : platforms)
+	{
+		platformNames.push_back(platform.getInfo<CL_PLATFORM_NAME>());
+		Debug::mention("CLProgram", "Platform " + 
+			std::to_string(platformNames.size() - 1) + " \"" + platformNames.back() + "\".");
+	}
+
+	const int platformIndex = selectByName(options.getCLPlatform(), platformNames, 
+		"platform");
+	const auto &platform = platforms.at(std::max(platformIndex, 0));
 
 	// Mention some version information about the platform (it should be okay if the 
 	// platform version is higher than the device version).
 	Debug::mention("CLProgram", "Platform version \"" +
 		platform.getInfo<CL_PLATFORM_VERSION>() + "\".");
 
-	// Check for all possible devices on the platform, starting with GPUs.
-	auto devices = CLProgram::getDevices(platform, CL_DEVICE_TYPE_GPU);
-	if (devices.size() == 0)
+	// List the platform's devices the same way for the device option.
+	const auto allDevices = CLProgram::getDevices(platform, CL_DEVICE_TYPE_ALL);
+	std::vector<std::string> deviceNames;
+	for (const auto &device : allDevices)
+	{
+		deviceNames.push_back(device.getInfo<CL_DEVICE_NAME>());
+		Debug::mention("CLProgram", "Device " + 
+			std::to_string(deviceNames.size() - 1) + " \"" + deviceNames.back() + "\".");
+	}
+
+	const int deviceIndex = selectByName(options.getCLDevice(), deviceNames, "device");
+	if (deviceIndex >= 0)
+	{
+		this->device = allDevices.at(deviceIndex);
+	}
+	else
 	{
-		Debug::mention("CLProgram", "No OpenCL GPU device found. Trying CPUs.");
-		devices = CLProgram::getDevices(platforms.at(0), CL_DEVICE_TYPE_CPU);
+		// Check for all possible devices on the platform, starting with GPUs.
+		auto devices = CLProgram::getDevices(platform, CL_DEVICE_TYPE_GPU);
 		if (devices.size() == 0)
 		{
-			Debug::mention("CLProgram", "No OpenCL CPU device found. Trying accelerators.");
-			devices = CLProgram::getDevices(platforms.at(0), CL_DEVICE_TYPE_ACCELERATOR);
-			Debug::check(devices.size() > 0, "CLProgram", "No OpenCL devices found.");
+			Debug::mention("CLProgram", "No OpenCL GPU device found. Trying CPUs.");
+			devices = CLProgram::getDevices(platform, CL_DEVICE_TYPE_CPU);
+			if (devices.size() == 0)
+			{
+				Debug::mention("CLProgram", "No OpenCL CPU device found. Trying accelerators.");
+				devices = CLProgram::getDevices(platform, CL_DEVICE_TYPE_ACCELERATOR);
+				Debug::check(devices.size() > 0, "CLProgram", "No OpenCL devices found.");
+			}
 		}
+
+		// Choose the first available device.
+		this->device = devices.at(0);
 	}
 
-	// Choose the first available device. Users with multiple GPUs might prefer an option.
-	this->device = devices.at(0);
+	Debug::mention("CLProgram", "Using device \"" + 
+		this->device.getInfo<CL_DEVICE_NAME>() + "\".");
+
+	// Split-frame bands are spread over every device of the same type on the platform,
+	// starting with the selected one. Without bands, only the selected device is used.
+	const int bandCount = options.getSplitFrameBands();
+	std::vector<cl::Device> devices = { this->device };
+	if (bandCount > 1)
+	{
+		const auto sameTypeDevices = CLProgram::getDevices(platform,
+			this->device.getInfo<CL_DEVICE_TYPE>());
+		for (const auto &device : sameTypeDevices)
+		{
+			if ((device() != this->device()) &&
+				(static_cast<int>(devices.size()) < bandCount))
+			{
+				devices.push_back(device);
+			}
+		}
+
+		Debug::mention("CLProgram", "Rendering " + std::to_string(bandCount) +
+			" bands on " + std::to_string(devices.size()) + " device(s).");
+	}
 
 	// Create an OpenCL context.
 	cl_int status = CL_SUCCESS;
-	this->context = cl::Context(this->device, nullptr, nullptr, nullptr, &status);
+	this->context = cl::Context(devices, nullptr, nullptr, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Context.");
 
-	// Create an OpenCL command queue.
-	this->commandQueue = cl::CommandQueue(this->context, this->device, 0, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue.");
+	// Create an OpenCL command queue for each band, taking turns between the devices.
+	// The first one is the main command queue that all uploads and read backs go 
+	// through. Bands are timed with profiling events so they can be balanced, and so
+	// the resolution scale can follow the kernel times.
+	const cl_command_queue_properties queueProperties = ((bandCount > 1) ||
+		(this->profiler.get() != nullptr) || this->resolutionScaling) ?
+		CL_QUEUE_PROFILING_ENABLE : 0;
+	for (int i = 0; i < bandCount; ++i)
+	{
+		const auto &bandDevice = devices.at(i % devices.size());
+		this->bandQueues.push_back(cl::CommandQueue(
+			this->context, bandDevice, queueProperties, &status));
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue.");
+	}
+
+	this->commandQueue = this->bandQueues.front();
+	this->bandShares = std::vector<double>(bandCount, 1.0 / bandCount);
+	this->bandRows = std::vector<int>(bandCount, 0);
+	this->bandStartEvents = std::vector<cl::Event>(bandCount);
+	this->bandEndEvents = std::vector<cl::Event>(bandCount);
 
 	// Read the kernel source from file.
 	std::string source = File::toString(CLProgram::PATH + CLProgram::FILENAME);
+	const int kernelVersion = getKernelInterfaceVersion(source);
+	Debug::check(kernelVersion == KERNEL_INTERFACE_VERSION, "CLProgram",
+		"Kernel interface version " + std::to_string(kernelVersion) + " in \"" +
+		CLProgram::PATH + CLProgram::FILENAME + "\" doesn't match version " +
+		std::to_string(KERNEL_INTERFACE_VERSION) + ".");
 
 	// Make some #defines to add to the kernel source.
-	std::string defines = std::string("#define SCREEN_WIDTH ") + std::to_string(width) +
-		std::string("\n") + std::string("#define SCREEN_HEIGHT ") +
-		std::to_string(height) + std::string("\n") + std::string("#define ASPECT_RATIO ") +
-		std::to_string(static_cast<double>(width) / static_cast<double>(height)) +
-		std::string("f\n") + // The "f" is for "float". OpenCL complains if it's a double.
+	// The screen dimensions are kernel arguments instead, so resizing the window 
+	// doesn't need the program to be built again.
+	std::string defines = 
 		std::string("#define WORLD_WIDTH ") + std::to_string(worldWidth) + std::string("\n") +
 		std::string("#define WORLD_HEIGHT ") + std::to_string(worldHeight) + std::string("\n") +
-		std::string("#define WORLD_DEPTH ") + std::to_string(worldDepth) + std::string("\n");
-
-	// Put the kernel source in a program object within the OpenCL context.
-	this->program = cl::Program(this->context, defines + source, false, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Program.");
+		std::string("#define WORLD_DEPTH ") + std::to_string(worldDepth) + std::string("\n") +
+		std::string("#define DAY_LENGTH ") + std::to_string(DAY_LENGTH) +
+		std::string("f\n") + // The "f" is for "float". OpenCL complains if it's a double.
+		std::string("#define OCCUPANCY_SMALL_BRICK ") +
+		std::to_string(OCCUPANCY_SMALL_BRICK) + std::string("\n") +
+		std::string("#define OCCUPANCY_LARGE_BRICK ") +
+		std::to_string(OCCUPANCY_LARGE_BRICK) + std::string("\n") +
+		std::string("#define OCCUPANCY_LARGE_OFFSET ") +
+		std::to_string(this->occupancyLargeOffset) + std::string("\n") +
+		std::string("#define VOXEL_TRIANGLES_LOCAL\n") +
+		std::string("#define PACKET_WIDTH ") + std::to_string(PACKET_WIDTH) +
+		std::string("\n") +
+		std::string("#define PACKET_HEIGHT ") + std::to_string(PACKET_HEIGHT) +
+		std::string("\n") +
+		std::string("#define PACKET_CELL_CACHE ") + std::to_string(PACKET_CELL_CACHE) +
+		std::string("\n") +
+		std::string("#define PACKET_TRIANGLE_CACHE ") +
+		std::to_string(PACKET_TRIANGLE_CACHE) + std::string("\n") +
+		std::string("#define LIGHT_CELL_SIZE ") + std::to_string(LightGrid::CELL_SIZE) +
+		std::string("\n") +
+		std::string("#define MAX_SHADOW_RAYS ") + std::to_string(this->shadowRays) +
+		std::string("\n") +
+		std::string("#define VISIBILITY_SAMPLES ") +
+		std::to_string(LightGrid::VISIBILITY_SAMPLES) + std::string("\n") +
+		std::string("#define MAX_VISIBILITY_SAMPLES ") +
+		std::to_string(LightGrid::MAX_VISIBILITY_SAMPLES) + std::string("\n") +
+		std::string("#define AMBIENT_OCCLUSION_SAMPLES ") +
+		std::to_string(this->occlusionSamples) + std::string("\n") +
+		std::string("#define AMBIENT_OCCLUSION_SCALE ") +
+		std::to_string(this->occlusionScale) + std::string("\n") +
+		std::string("#define ANTI_ALIAS_THRESHOLD ") +
+		std::to_string(ANTI_ALIAS_THRESHOLD) + std::string("f\n");
 
 	// Add some kernel compilation switches.
-	std::string options("-cl-fast-relaxed-math -cl-strict-aliasing");
+	std::string buildOptions("-cl-fast-relaxed-math -cl-strict-aliasing");
+
+	// The cached binary's name comes from everything that could change the compiled 
+	// program, so a new kernel, world size, or driver gets its own binary.
+	const std::string deviceString = this->device.getInfo<CL_DEVICE_NAME>() +
+		this->device.getInfo<CL_DEVICE_VERSION>() +
+		this->device.getInfo<CL_DRIVER_VERSION>();
+	this->deviceHash = String::toHexString(getFnv1aHash(deviceString));
+
+	const uint64_t programHash = getFnv1aHash(defines + source + buildOptions + deviceString);
+	const std::string binaryFilename = CLProgram::PATH + PROGRAM_BINARY_PREFIX +
+		String::toHexString(programHash) + PROGRAM_BINARY_EXTENSION;
+
+	// Use the cached binary if there is one. Otherwise, compile the source and cache it.
+	// Binaries are only cached for a single device.
+	const bool cachesBinary = devices.size() == 1;
+	if (!cachesBinary || !this->loadProgramBinary(binaryFilename, buildOptions))
+	{
+		// Put the kernel source in a program object within the OpenCL context.
+		this->program = cl::Program(this->context, defines + source, false, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Program.");
 
-	// Build the program into something executable. If compilation fails, the program stops.
-	status = this->program.build(devices, options.c_str());
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Program::build (" +
-		this->getErrorString(status) + ").");
+		// Build the program into something executable. If compilation fails, the 
+		// program stops.
+		status = this->program.build(devices, buildOptions.c_str());
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Program::build (" +
+			this->getErrorString(status) + ").");
+
+		if (cachesBinary)
+		{
+			this->saveProgramBinary(binaryFilename);
+		}
+	}
 
 	// Create the kernels and set their entry function to be a __kernel in the program.
-	this->intersectKernel = cl::Kernel(
-		this->program, CLProgram::INTERSECT_KERNEL.c_str(), &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel intersectKernel.");
+	if (this->fused)
+	{
+		Debug::mention("CLProgram", "Using fused render kernel.");
+
+		this->fusedRenderKernel = cl::Kernel(
+			this->program, CLProgram::FUSED_RENDER_KERNEL.c_str(), &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel fusedRenderKernel.");
+	}
+	else
+	{
+		// The packet variant needs a work-group of at least one packet, and at least 
+		// one tile size whose caches fit in local memory. Otherwise, each work-item 
+		// traces its own ray.
+		if (this->packetTraversal)
+		{
+			this->intersectKernel = cl::Kernel(
+				this->program, CLProgram::INTERSECT_PACKET_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel intersectKernel (packet).");
+
+			const cl::size_type localMemory = 
+				this->device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+			const cl::size_type kernelLocalMemory = this->intersectKernel
+				.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(this->device);
+			this->packetLocalMemory = (localMemory > kernelLocalMemory) ?
+				(localMemory - kernelLocalMemory) : 0;
+
+			const cl::size_type maxTileArea = this->intersectKernel
+				.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(this->device);
+			const bool hasPacketTile = std::any_of(TILE_CANDIDATES.begin(),
+				TILE_CANDIDATES.end(), [this, maxTileArea](const std::pair<int, int> &tile)
+			{
+				const cl::size_type cacheBytes = getPacketCacheBytes(tile);
+				return (cacheBytes > 0) && (cacheBytes <= this->packetLocalMemory) &&
+					(static_cast<cl::size_type>(tile.first * tile.second) <= maxTileArea);
+			});
+
+			if (hasPacketTile)
+			{
+				Debug::mention("CLProgram", "Using packet traversal.");
+			}
+			else
+			{
+				Debug::mention("CLProgram", "Packet traversal doesn't fit on this device.");
+				this->packetTraversal = false;
+			}
+		}
+
+		if (!this->packetTraversal)
+		{
+			this->intersectKernel = cl::Kernel(
+				this->program, CLProgram::INTERSECT_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel intersectKernel.");
+		}
+
+		this->rayTraceKernel = cl::Kernel(
+			this->program, CLProgram::RAY_TRACE_KERNEL.c_str(), &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel rayTraceKernel.");
+
+		this->convertToRGBKernel = cl::Kernel(
+			this->program, CLProgram::CONVERT_TO_RGB_KERNEL.c_str(), &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel convertToRGBKernel.");
+
+		// Only the optional passes that are on are created.
+		if (this->occlusionSamples > 0)
+		{
+			Debug::mention("CLProgram", "Using ambient occlusion (" +
+				std::to_string(this->occlusionSamples) + " sample(s)" +
+				((this->occlusionScale > 1) ? ", half resolution)." : ")."));
+
+			this->ambientOcclusionKernel = cl::Kernel(
+				this->program, CLProgram::AMBIENT_OCCLUSION_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel ambientOcclusionKernel.");
+		}
+
+		if (this->antiAliasing)
+		{
+			Debug::mention("CLProgram", "Using anti-aliasing.");
 
-	this->rayTraceKernel = cl::Kernel(
-		this->program, CLProgram::RAY_TRACE_KERNEL.c_str(), &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel rayTraceKernel.");
+			this->antiAliasKernel = cl::Kernel(
+				this->program, CLProgram::ANTI_ALIAS_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel antiAliasKernel.");
+		}
+
+		if (this->postProcessing)
+		{
+			Debug::mention("CLProgram", "Using post-processing.");
 
-	this->convertToRGBKernel = cl::Kernel(
-		this->program, CLProgram::CONVERT_TO_RGB_KERNEL.c_str(), &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel convertToRGBKernel.");
+			this->postProcessKernel = cl::Kernel(
+				this->program, CLProgram::POST_PROCESS_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel postProcessKernel.");
+		}
+	}
 
 	// Create the OpenCL buffers in the context for reading and/or writing.
 	// NOTE: The size of some of these buffers is just a placeholder for now.
@@ -156,156 +766,628 @@ CLProgram::CLProgram(int width, int height, int worldWidth, int worldHeight,
 		SIZEOF_VOXEL_REF * worldWidth * worldHeight * worldDepth, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer voxelRefBuffer.");
 
+	this->occupancyBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		this->occupancyData.size(), nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer occupancyBuffer.");
+
 	this->spriteRefBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
 		SIZEOF_SPRITE_REF * worldWidth * worldHeight * worldDepth, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer spriteRefBuffer.");
 
+	this->spriteIndexBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		sizeof(cl_int) * this->spriteIndexCapacity, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer spriteIndexBuffer.");
+
+	// Light references are per light grid cell instead of per voxel.
 	this->lightRefBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_LIGHT_REF * worldWidth * worldHeight * worldDepth, nullptr, &status);
+		SIZEOF_LIGHT_REF * this->lightGrid.getCellCount(), nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightRefBuffer.");
 
-	this->triangleBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_TRIANGLE * 12 * worldWidth * worldHeight * worldDepth
-		/* This buffer size is actually very naive. Much of it will just be air.
-		Make a mapping of 3D cell coordinates to triangles at some point to help. */,
-		nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer triangleBuffer.");
+	// Triangles are stored densely, so only non-empty voxels take up space. The buffers
+	// grow in reserveTriangles() when the world needs more room.
+	for (const auto stream : TrianglePacker::STREAMS)
+	{
+		this->triangleBuffers.push_back(cl::Buffer(this->context, CL_MEM_READ_ONLY,
+			TrianglePacker::getStride(stream) * this->triangleCapacity, nullptr, &status));
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer triangleBuffers.");
+	}
 
+	// The light buffers grow in uploadLights() when there are more lights.
 	this->lightBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_LIGHT /* Some # of lights * world dims, Placeholder size */, nullptr, &status);
+		SIZEOF_LIGHT * this->lightCapacity, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightBuffer.");
 
-	this->textureBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		sizeof(cl_float4) * 64 * 64 * 32 /* Placeholder size, 32 textures */, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer textureBuffer.");
+	this->lightIndexBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		sizeof(cl_int) * this->lightIndexCapacity, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightIndexBuffer.");
+
+	// The kernels count shadow rays into the visibility cache, and it grows with the
+	// cell lights. It starts with no samples.
+	this->visibilityBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_uint) * this->getVisibilityCapacity(), nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer visibilityBuffer.");
+
+	const cl_uint noSamples = 0;
+	status = this->commandQueue.enqueueFillBuffer(this->visibilityBuffer, noSamples, 0,
+		sizeof(cl_uint) * this->getVisibilityCapacity(), nullptr, nullptr);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::CommandQueue::enqueueFillBuffer visibilityBuffer.");
+
+	// The texture buffer is created when textures are loaded, since its size depends 
+	// on them.
+	this->paletteBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		sizeof(cl_uchar4) * PALETTE_LENGTH * DEVICE_PALETTES.size(), nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer paletteBuffer.");
 
 	this->gameTimeBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		sizeof(cl_float), nullptr, &status);
+		SIZEOF_GAME_TIME, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer gameTimeBuffer.");
 
-	this->depthBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float) * width * height, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer depthBuffer.");
+	// Create the screen-sized buffers and the frame buffer texture.
+	this->createScreenBuffers(renderer);
 
-	this->normalBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float3) * width * height, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer normalBuffer.");
+	if (this->fused)
+	{
+		// Tell the fused kernel arguments where their world buffers live.
+		status = this->fusedRenderKernel.setArg(0, this->cameraBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel cameraBuffer.");
+
+		status = this->fusedRenderKernel.setArg(1, this->voxelRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel voxelRefBuffer.");
+
+		status = this->fusedRenderKernel.setArg(2, this->spriteRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel spriteRefBuffer.");
+
+		status = this->fusedRenderKernel.setArg(3, this->lightRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel lightRefBuffer.");
+
+		status = this->fusedRenderKernel.setArg(7, this->gameTimeBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel gameTimeBuffer.");
+
+		status = this->fusedRenderKernel.setArg(11, this->occupancyBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel occupancyBuffer.");
+
+		status = this->fusedRenderKernel.setArg(12, this->paletteBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel paletteBuffer.");
+	}
+	else
+	{
+		// Tell the intersect kernel arguments where their world buffers live.
+		status = this->intersectKernel.setArg(0, this->cameraBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel cameraBuffer.");
 
-	this->viewBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float3) * width * height, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer viewBuffer.");
+		status = this->intersectKernel.setArg(1, this->voxelRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel voxelRefBuffer.");
 
-	this->pointBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float3) * width * height, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer pointBuffer.");
+		status = this->intersectKernel.setArg(2, this->spriteRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel spriteRefBuffer.");
 
-	this->uvBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float2) * width * height, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer uvBuffer.");
+		status = this->intersectKernel.setArg(13, this->occupancyBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel occupancyBuffer.");
 
-	this->triangleIndexBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_int) * width * height, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer triangleIndexBuffer.");
+		// Tell the rayTrace kernel arguments where their world buffers live.
+		status = this->rayTraceKernel.setArg(0, this->voxelRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel voxelRefBuffer.");
 
-	this->colorBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float3) * width * height, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer colorBuffer.");
+		status = this->rayTraceKernel.setArg(1, this->spriteRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel spriteRefBuffer.");
 
-	this->outputBuffer = cl::Buffer(this->context, CL_MEM_WRITE_ONLY,
-		sizeof(cl_int) * width * height, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer outputBuffer.");
+		status = this->rayTraceKernel.setArg(2, this->lightRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel lightRefBuffer.");
 
-	// Tell the intersect kernel arguments where their buffers live.
-	status = this->intersectKernel.setArg(0, this->cameraBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel cameraBuffer.");
+		status = this->rayTraceKernel.setArg(6, this->gameTimeBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel gameTimeBuffer.");
 
-	status = this->intersectKernel.setArg(1, this->voxelRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel voxelRefBuffer.");
+		status = this->rayTraceKernel.setArg(16, this->occupancyBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel occupancyBuffer.");
 
-	status = this->intersectKernel.setArg(2, this->spriteRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel spriteRefBuffer.");
+		status = this->rayTraceKernel.setArg(17, this->paletteBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel paletteBuffer.");
 
-	status = this->intersectKernel.setArg(3, this->triangleBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel triangleBuffer.");
+		if (this->occlusionSamples > 0)
+		{
+			// Tell the ambientOcclusion kernel arguments where their world buffers live.
+			status = this->ambientOcclusionKernel.setArg(0, this->voxelRefBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg ambientOcclusionKernel voxelRefBuffer.");
+
+			status = this->ambientOcclusionKernel.setArg(1, this->occupancyBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg ambientOcclusionKernel occupancyBuffer.");
+		}
+	}
 
-	status = this->intersectKernel.setArg(4, this->textureBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel textureBuffer.");
+	// Tell the kernels where each triangle stream and the lights live.
+	this->setTriangleArgs();
+	this->setLightArgs();
+	this->setSpriteArgs();
 
-	status = this->intersectKernel.setArg(5, this->depthBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel depthBuffer.");
+	// Allocate the uniform block once. It's written to the device in render().
+	this->uniformData = std::vector<char>(SIZEOF_UNIFORMS);
+	this->uniformsDirty = false;
+	this->uniformWritePending = false;
 
-	status = this->intersectKernel.setArg(6, this->normalBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel normalBuffer.");
+	// Put the palettes on the device, starting with the default one for all day.
+	this->loadPalettes();
+	this->setPalette(PaletteName::Default);
+	this->updateGameTime(0.0);
 
-	status = this->intersectKernel.setArg(7, this->viewBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel viewBuffer.");
+	// Pick the render kernels' tile size, or get ready to find one.
+	this->loadTileSize();
 
-	status = this->intersectKernel.setArg(8, this->pointBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel pointBuffer.");
+	// --- TESTING PURPOSES ---
+	// The following code is for testing. Remove it once using actual world data.
 
-	status = this->intersectKernel.setArg(9, this->uvBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel uvBuffer.");
+	// Air voxels are written too, so the device starts with every voxel empty.
+	this->markChunkDirty(0, 0, 0, worldWidth, worldHeight, worldDepth);
+	this->makeTestWorld(worldWidth, worldHeight, worldDepth);
 
-	status = this->intersectKernel.setArg(10, this->triangleIndexBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel triangleIndexBuffer.");
+	Debug::mention("CLProgram", "Test world has " + std::to_string(this->triangleCount) +
+		" shared triangles.");
 
-	// Tell the rayTrace kernel arguments where their buffers live.
-	status = this->rayTraceKernel.setArg(0, this->voxelRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel voxelRefBuffer.");
+	// Write the voxel references, triangles, sprites, and lights to device memory.
+	this->updateSprites();
+	this->uploadDirtyRegions();
+	this->uploadLights();
+	this->clearStaleVisibility();
 
-	status = this->rayTraceKernel.setArg(1, this->spriteRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel spriteRefBuffer.");
+	// --- END TESTING ---
+}
 
-	status = this->rayTraceKernel.setArg(2, this->lightRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel lightRefBuffer.");
+CLProgram::~CLProgram()
+{
+	// Unmap any output buffers that were never shown, and let everything finish before
+	// the buffers are freed.
+	for (int i = 0; i < static_cast<int>(this->mapPending.size()); ++i)
+	{
+		if (this->mapPending.at(i))
+		{
+			this->unmapOutput(i);
+		}
+	}
 
-	status = this->rayTraceKernel.setArg(3, this->triangleBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel triangleBuffer.");
+	for (const auto &queue : this->bandQueues)
+	{
+		queue.finish();
+	}
 
-	status = this->rayTraceKernel.setArg(4, this->lightBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel lightBuffer.");
+	// Save the stage times for looking at later.
+	if ((this->profiler.get() != nullptr) && (this->profileFilename.size() > 0))
+	{
+		if (this->profiler->save(this->profileFilename))
+		{
+			Debug::mention("CLProgram", "Saved profile \"" + this->profileFilename + "\".");
+		}
+		else
+		{
+			Debug::mention("CLProgram", "Could not save profile \"" + 
+				this->profileFilename + "\".");
+		}
+	}
 
-	status = this->rayTraceKernel.setArg(5, this->textureBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel textureBuffer.");
+	// Destroy the game world frame buffer.
+	// The SDL_Renderer destroys this itself with SDL_DestroyRenderer(), too.
+	if (this->texture != nullptr)
+	{
+		SDL_DestroyTexture(this->texture);
+	}
+}
 
-	status = this->rayTraceKernel.setArg(6, this->gameTimeBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel gameTimeBuffer.");
+std::vector<cl::Platform> CLProgram::getPlatforms()
+{
+	std::vector<cl::Platform> platforms;
+	cl_int status = cl::Platform::get(&platforms);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "CLProgram::getPlatforms.");
 
-	status = this->rayTraceKernel.setArg(7, this->depthBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel depthBuffer.");
+	return platforms;
+}
 
-	status = this->rayTraceKernel.setArg(8, this->normalBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel normalBuffer.");
+std::vector<cl::Device> CLProgram::getDevices(const cl::Platform &platform,
+	cl_device_type type)
+{
+	std::vector<cl::Device> devices;
+	cl_int status = platform.getDevices(type, &devices);
+	Debug::check((status == CL_SUCCESS) || (status == CL_DEVICE_NOT_FOUND),
+		"CLProgram", "CLProgram::getDevices.");
 
-	status = this->rayTraceKernel.setArg(9, this->viewBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel viewBuffer.");
+	return devices;
+}
 
-	status = this->rayTraceKernel.setArg(10, this->pointBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel pointBuffer.");
+bool CLProgram::hasCompatibleKernel()
+{
+	const std::string filename = CLProgram::PATH + CLProgram::FILENAME;
+	if (!File::exists(filename))
+	{
+		Debug::mention("CLProgram", "Kernel \"" + filename + "\" not found.");
+		return false;
+	}
 
-	status = this->rayTraceKernel.setArg(11, this->uvBuffer);
+	const int kernelVersion = getKernelInterfaceVersion(File::toString(filename));
+	if (kernelVersion != KERNEL_INTERFACE_VERSION)
+	{
+		Debug::mention("CLProgram", "Kernel interface version " +
+			std::to_string(kernelVersion) + " in \"" + filename +
+			"\" doesn't match version " + std::to_string(KERNEL_INTERFACE_VERSION) + ".");
+		return false;
+	}
+
+	return true;
+}
+
+std::vector<cl::Kernel*> CLProgram::getRenderKernels()
+{
+	if (this->fused)
+	{
+		return { &this->fusedRenderKernel };
+	}
+	else if (this->hasScreenPasses())
+	{
+		return { &this->intersectKernel, &this->rayTraceKernel };
+	}
+	else
+	{
+		return { &this->intersectKernel, &this->rayTraceKernel, &this->convertToRGBKernel };
+	}
+}
+
+bool CLProgram::hasScreenPasses() const
+{
+	return this->antiAliasing || this->postProcessing;
+}
+
+void CLProgram::loadTileSize()
+{
+	// The largest tile all of the render kernels can be launched with.
+	cl::size_type maxTileArea = this->device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+	for (const auto *kernel : this->getRenderKernels())
+	{
+		maxTileArea = std::min(maxTileArea,
+			kernel->getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(this->device));
+	}
+
+	// Packet traversal also needs whole packets whose caches fit in local memory.
+	this->tileCandidates.clear();
+	for (const auto &candidate : TILE_CANDIDATES)
+	{
+		const cl::size_type area = candidate.first * candidate.second;
+		const cl::size_type cacheBytes = getPacketCacheBytes(candidate);
+		const bool fitsPackets = !this->packetTraversal ||
+			((cacheBytes > 0) && (cacheBytes <= this->packetLocalMemory));
+		if ((area <= maxTileArea) && fitsPackets)
+		{
+			this->tileCandidates.push_back(candidate);
+		}
+	}
+
+	// If even the smallest tile is too big, let the driver choose. Packet traversal was
+	// already checked for a tile that fits.
+	if (this->tileCandidates.size() == 0)
+	{
+		assert(!this->packetTraversal);
+		Debug::mention("CLProgram", "Render kernels can't be launched in tiles.");
+		this->tileSize = std::make_pair(0, 0);
+		return;
+	}
+
+	this->tileSize = this->tileCandidates.front();
+	this->setPacketCaches();
+	this->bestTileSize = this->tileSize;
+	this->bestTileTime = std::numeric_limits<double>::infinity();
+	this->tuningFrame = 0;
+
+	// Use the tuned tile size if it was found for this device before, and if it's 
+	// still one of the candidates.
+	if (File::exists(TUNING_FILENAME))
+	{
+		KvpTextMap textMap(TUNING_FILENAME);
+		if (textMap.getString(TUNING_DEVICE_KEY) == this->deviceHash)
+		{
+			const auto savedTileSize = std::make_pair(
+				textMap.getInteger(TUNING_TILE_WIDTH_KEY),
+				textMap.getInteger(TUNING_TILE_HEIGHT_KEY));
+
+			const auto iter = std::find(this->tileCandidates.begin(),
+				this->tileCandidates.end(), savedTileSize);
+			if (iter != this->tileCandidates.end())
+			{
+				this->tileSize = savedTileSize;
+				this->tileCandidates.clear();
+				this->setPacketCaches();
+				return;
+			}
+		}
+	}
+
+	Debug::mention("CLProgram", "Tuning render tile size.");
+}
+
+void CLProgram::updateTileTuning(double seconds)
+{
+	assert(this->tileCandidates.size() > 0);
+
+	// Keep each candidate's fastest frame, since slower ones are more likely to have
+	// been interrupted by something else.
+	if (seconds < this->bestTileTime)
+	{
+		this->bestTileTime = seconds;
+		this->bestTileSize = this->tileSize;
+	}
+
+	++this->tuningFrame;
+
+	const int candidateIndex = this->tuningFrame / TUNING_FRAMES_PER_CANDIDATE;
+	if (candidateIndex < static_cast<int>(this->tileCandidates.size()))
+	{
+		this->tileSize = this->tileCandidates.at(candidateIndex);
+		this->setPacketCaches();
+		return;
+	}
+
+	// Every candidate has been timed. Keep the fastest and save it for next time.
+	this->tileSize = this->bestTileSize;
+	this->tileCandidates.clear();
+	this->setPacketCaches();
+
+	Debug::mention("CLProgram", "Render tile size is " +
+		std::to_string(this->tileSize.first) + "x" +
+		std::to_string(this->tileSize.second) + ".");
+
+	const std::string text = "# Generated by the renderer. Delete to tune again.\n" +
+		TUNING_DEVICE_KEY + "=" + this->deviceHash + "\n" +
+		TUNING_TILE_WIDTH_KEY + "=" + std::to_string(this->tileSize.first) + "\n" +
+		TUNING_TILE_HEIGHT_KEY + "=" + std::to_string(this->tileSize.second) + "\n";
+
+	if (!File::fromString(TUNING_FILENAME, text))
+	{
+		Debug::mention("CLProgram", "Could not save \"" + TUNING_FILENAME + "\".");
+	}
+}
+
+void CLProgram::setPacketCaches()
+{
+	if (!this->packetTraversal)
+	{
+		return;
+	}
+
+	const cl::size_type packetCount = (this->tileSize.first / PACKET_WIDTH) *
+		(this->tileSize.second / PACKET_HEIGHT);
+	assert(packetCount > 0);
+
+	cl_int status = this->intersectKernel.setArg(14,
+		cl::Local(sizeof(cl_int) * PACKET_CELL_CACHE * packetCount));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel cell cache.");
+
+	status = this->intersectKernel.setArg(15,
+		cl::Local(SIZEOF_PACKET_TRIANGLE * PACKET_TRIANGLE_CACHE * packetCount));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel triangle cache.");
+}
+
+void CLProgram::finishBands()
+{
+	for (const auto &queue : this->bandQueues)
+	{
+		cl_int status = queue.finish();
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::finish.");
+	}
+}
+
+void CLProgram::balanceBands()
+{
+	const int bandCount = static_cast<int>(this->bandQueues.size());
+	if (bandCount == 1)
+	{
+		return;
+	}
+
+	// Only use the last frame's times once every band that rendered has finished.
+	for (int i = 0; i < bandCount; ++i)
+	{
+		if (this->bandRows.at(i) > 0)
+		{
+			const cl::Event &event = this->bandEndEvents.at(i);
+			if (event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE)
+			{
+				return;
+			}
+		}
+	}
+
+	// Get how many rows per second each band rendered.
+	std::vector<double> speeds(bandCount, 0.0);
+	double totalSpeed = 0.0;
+	for (int i = 0; i < bandCount; ++i)
+	{
+		if (this->bandRows.at(i) > 0)
+		{
+			const cl_ulong start = this->bandStartEvents.at(i)
+				.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+			const cl_ulong end = this->bandEndEvents.at(i)
+				.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+			const double seconds = (end > start) ?
+				(static_cast<double>(end - start) / 1.0e9) : 1.0e-6;
+
+			speeds.at(i) = static_cast<double>(this->bandRows.at(i)) / seconds;
+			totalSpeed += speeds.at(i);
+		}
+	}
+
+	if (totalSpeed <= 0.0)
+	{
+		return;
+	}
+
+	// Move each band's share of the screen toward its share of the total speed.
+	double totalShare = 0.0;
+	for (int i = 0; i < bandCount; ++i)
+	{
+		const double timedShare = std::max(speeds.at(i) / totalSpeed, MIN_BAND_SHARE);
+		double &share = this->bandShares.at(i);
+		share += (timedShare - share) * BAND_SHARE_RESPONSE;
+		totalShare += share;
+	}
+
+	for (auto &share : this->bandShares)
+	{
+		share /= totalShare;
+	}
+}
+
+void CLProgram::createScreenBuffers(Renderer *renderer)
+{
+	assert((renderer == nullptr) == this->headless);
+
+	const int framesInFlight = static_cast<int>(this->mapPending.size());
+
+	// Create streaming texture to be used as the game world frame buffer. Headless
+	// programs keep the shown frame in a host buffer instead.
+	if (this->headless)
+	{
+		this->texture = nullptr;
+		this->frameData.clear();
+	}
+	else
+	{
+		this->texture = renderer->createTexture(SDL_PIXELFORMAT_ARGB8888,
+			SDL_TEXTUREACCESS_STREAMING, this->width, this->height);
+		Debug::check(this->texture != nullptr, "CLProgram", "SDL_CreateTexture");
+	}
+
+	cl_int status = CL_SUCCESS;
+
+	// The output buffers are allocated where the host can map them, so finished frames 
+	// can go straight to the texture without being copied into a host buffer first.
+	this->outputBuffers.clear();
+	for (int i = 0; i < framesInFlight; ++i)
+	{
+		this->outputBuffers.push_back(cl::Buffer(this->context,
+			CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+			sizeof(cl_int) * this->width * this->height, nullptr, &status));
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer outputBuffer.");
+	}
+
+	// The screen buffers don't hold the last frame anymore.
+	this->historyValid = false;
+
+	// The fused kernel only needs the traced dimensions. Everything else stays in
+	// registers.
+	if (this->fused)
+	{
+		this->setRenderDimensions();
+		return;
+	}
+
+	// The multi-pass kernels pass each pixel's intersection and color between them
+	// in these buffers.
+	this->depthBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_float) * this->width * this->height, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer depthBuffer.");
+
+	this->normalBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_float3) * this->width * this->height, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer normalBuffer.");
+
+	this->viewBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_float3) * this->width * this->height, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer viewBuffer.");
+
+	this->pointBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_float3) * this->width * this->height, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer pointBuffer.");
+
+	this->uvBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_float2) * this->width * this->height, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer uvBuffer.");
+
+	this->triangleIndexBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_int) * this->width * this->height, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer triangleIndexBuffer.");
+
+	this->colorBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_float3) * this->width * this->height, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer colorBuffer.");
+
+	// Ambient occlusion has one float per sample, which is one pixel or 2x2 pixels. 
+	// Without it, rayTrace gets a placeholder with one float.
+	const int occlusionWidth = (this->width + this->occlusionScale - 1) / this->occlusionScale;
+	const int occlusionHeight = (this->height + this->occlusionScale - 1) / this->occlusionScale;
+	this->occlusionBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+		sizeof(cl_float) * ((this->occlusionSamples > 0) ?
+		(occlusionWidth * occlusionHeight) : 1), nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer occlusionBuffer.");
+
+	// Anti-aliasing can't filter in place, since its neighbors would already be 
+	// filtered.
+	if (this->antiAliasing)
+	{
+		this->filteredBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			sizeof(cl_float3) * this->width * this->height, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer filteredBuffer.");
+	}
+
+	// Tell the intersect kernel arguments where their screen buffers live.
+	status = this->intersectKernel.setArg(5, this->depthBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel depthBuffer.");
+
+	status = this->intersectKernel.setArg(6, this->normalBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel normalBuffer.");
+
+	status = this->intersectKernel.setArg(7, this->viewBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel viewBuffer.");
+
+	status = this->intersectKernel.setArg(8, this->pointBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel pointBuffer.");
+
+	status = this->intersectKernel.setArg(9, this->uvBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel uvBuffer.");
+
+	status = this->intersectKernel.setArg(10, this->triangleIndexBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel triangleIndexBuffer.");
+
+
+	// Tell the rayTrace kernel arguments where their screen buffers live.
+	status = this->rayTraceKernel.setArg(7, this->depthBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg rayTraceKernel depthBuffer.");
+
+	status = this->rayTraceKernel.setArg(8, this->normalBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg rayTraceKernel normalBuffer.");
+
+	status = this->rayTraceKernel.setArg(9, this->viewBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg rayTraceKernel viewBuffer.");
+
+	status = this->rayTraceKernel.setArg(10, this->pointBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg rayTraceKernel pointBuffer.");
+
+	status = this->rayTraceKernel.setArg(11, this->uvBuffer);
 	Debug::check(status == CL_SUCCESS, "CLProgram",
 		"cl::Kernel::setArg rayTraceKernel uvBuffer.");
 
@@ -317,89 +1399,350 @@ CLProgram::CLProgram(int width, int height, int worldWidth, int worldHeight,
 	Debug::check(status == CL_SUCCESS, "CLProgram",
 		"cl::Kernel::setArg rayTraceKernel colorBuffer.");
 
+	status = this->rayTraceKernel.setArg(RAY_TRACE_OCCLUSION_ARG, this->occlusionBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg rayTraceKernel occlusionBuffer.");
+
+	// Tell the optional passes where their screen buffers live.
+	if (this->occlusionSamples > 0)
+	{
+		status = this->ambientOcclusionKernel.setArg(4, this->pointBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg ambientOcclusionKernel pointBuffer.");
+
+		status = this->ambientOcclusionKernel.setArg(5, this->normalBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg ambientOcclusionKernel normalBuffer.");
+
+		status = this->ambientOcclusionKernel.setArg(6, this->depthBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg ambientOcclusionKernel depthBuffer.");
+
+		status = this->ambientOcclusionKernel.setArg(7, this->occlusionBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg ambientOcclusionKernel occlusionBuffer.");
+	}
+
+	if (this->antiAliasing)
+	{
+		status = this->antiAliasKernel.setArg(0, this->colorBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg antiAliasKernel colorBuffer.");
+
+		status = this->antiAliasKernel.setArg(1, this->filteredBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg antiAliasKernel filteredBuffer.");
+	}
+
+	// Post-processing and RGB conversion take the newest colors, which are the
+	// filtered ones with anti-aliasing. Post-processing changes them in place.
+	const cl::Buffer &finalColorBuffer = this->antiAliasing ?
+		this->filteredBuffer : this->colorBuffer;
+
+	if (this->postProcessing)
+	{
+		status = this->postProcessKernel.setArg(0, finalColorBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg postProcessKernel colorBuffer.");
+	}
+
 	// Tell the convertToRGB kernel arguments where their buffers live.
-	status = this->convertToRGBKernel.setArg(0, this->colorBuffer);
+	status = this->convertToRGBKernel.setArg(0, finalColorBuffer);
 	Debug::check(status == CL_SUCCESS, "CLProgram",
 		"cl::Kernel::setArg convertToRGBKernel colorBuffer.");
 
-	status = this->convertToRGBKernel.setArg(1, this->outputBuffer);
+	// The convertToRGB kernel's output buffer is set each frame in render().
+	this->setRenderDimensions();
+}
+
+void CLProgram::setRenderDimensions()
+{
+	const int oldWidth = this->renderWidth;
+	const int oldHeight = this->renderHeight;
+
+	this->renderWidth = std::max(static_cast<int>(std::round(
+		this->width * this->resolutionScale)), 1);
+	this->renderHeight = std::max(static_cast<int>(std::round(
+		this->height * this->resolutionScale)), 1);
+
+	// The kernels index the screen buffers with the traced width, so the traced pixels
+	// are packed at the start of each buffer.
+	const cl_int width = static_cast<cl_int>(this->renderWidth);
+	const cl_int height = static_cast<cl_int>(this->renderHeight);
+	cl_int status = CL_SUCCESS;
+
+	// The last frame's pixels are in a different place at another size.
+	if ((this->renderWidth != oldWidth) || (this->renderHeight != oldHeight))
+	{
+		this->historyValid = false;
+	}
+
+	if (this->fused)
+	{
+		status = this->fusedRenderKernel.setArg(9, width);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel width.");
+
+		status = this->fusedRenderKernel.setArg(10, height);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel height.");
+
+		return;
+	}
+
+	status = this->intersectKernel.setArg(11, width);
 	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg convertToRGBKernel outputBuffer.");
+		"cl::Kernel::setArg intersectKernel width.");
 
-	// --- TESTING PURPOSES ---
-	// The following code is for testing. Remove it once using actual world data.
+	status = this->intersectKernel.setArg(12, height);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg intersectKernel height.");
+
+	status = this->rayTraceKernel.setArg(14, width);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg rayTraceKernel width.");
+
+	status = this->rayTraceKernel.setArg(15, height);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg rayTraceKernel height.");
+
+	status = this->convertToRGBKernel.setArg(2, width);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg convertToRGBKernel width.");
+
+	status = this->convertToRGBKernel.setArg(3, height);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg convertToRGBKernel height.");
+
+	// Ambient occlusion works out its own grid from the traced dimensions.
+	if (this->occlusionSamples > 0)
+	{
+		status = this->ambientOcclusionKernel.setArg(8, width);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg ambientOcclusionKernel width.");
+
+		status = this->ambientOcclusionKernel.setArg(9, height);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg ambientOcclusionKernel height.");
+	}
+
+	if (this->antiAliasing)
+	{
+		status = this->antiAliasKernel.setArg(2, width);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg antiAliasKernel width.");
+
+		status = this->antiAliasKernel.setArg(3, height);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg antiAliasKernel height.");
+	}
+
+	if (this->postProcessing)
+	{
+		status = this->postProcessKernel.setArg(1, width);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg postProcessKernel width.");
+
+		status = this->postProcessKernel.setArg(2, height);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg postProcessKernel height.");
+	}
+}
+
+void CLProgram::updateResolutionScale()
+{
+	// Tile tuning changes the kernel times on purpose, so wait until it's done. Frames
+	// that were only shaded, or not rendered, don't say how long tracing takes.
+	if (!this->resolutionScaling || (this->tileCandidates.size() > 0) ||
+		!this->timingPending)
+	{
+		return;
+	}
+
+	// The bands run side by side, so the frame takes as long as the slowest band. Only
+	// use the last frame once every band that rendered has finished.
+	double frameTime = -1.0;
+	for (int i = 0; i < static_cast<int>(this->bandQueues.size()); ++i)
+	{
+		if (this->bandRows.at(i) == 0)
+		{
+			continue;
+		}
+
+		const cl::Event &startEvent = this->bandStartEvents.at(i);
+		const cl::Event &endEvent = this->bandEndEvents.at(i);
+		if (endEvent.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE)
+		{
+			return;
+		}
+
+		const cl_ulong start = startEvent.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		const cl_ulong end = endEvent.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		const double milliseconds = (end > start) ?
+			(static_cast<double>(end - start) / 1.0e6) : 0.0;
+		frameTime = std::max(frameTime, milliseconds);
+	}
 
-	this->makeTestWorld();
+	// The whole-frame passes run after the slowest band.
+	if (this->hasScreenPasses() && (frameTime >= 0.0))
+	{
+		if (this->screenEndEvent.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() !=
+			CL_COMPLETE)
+		{
+			return;
+		}
+
+		const cl_ulong start = this->screenStartEvent
+			.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		const cl_ulong end = this->screenEndEvent
+			.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		frameTime += (end > start) ? (static_cast<double>(end - start) / 1.0e6) : 0.0;
+	}
+
+	this->timingPending = false;
+	if (frameTime < 0.0)
+	{
+		return;
+	}
+
+	this->smoothedFrameTime = (this->smoothedFrameTime < 0.0) ? frameTime :
+		(this->smoothedFrameTime + ((frameTime - this->smoothedFrameTime) *
+			FRAME_TIME_RESPONSE));
+
+	// Kernel time goes with the number of pixels, which is the square of the scale.
+	const double oldScale = this->resolutionScale;
+	double newScale = oldScale;
+	if (this->smoothedFrameTime > this->frameBudget)
+	{
+		const double fitScale = oldScale *
+			std::sqrt(this->frameBudget / this->smoothedFrameTime);
+		newScale = std::max(fitScale, oldScale - MAX_SCALE_DECREASE);
+	}
+	else if (this->smoothedFrameTime < (this->frameBudget * RESOLUTION_UPSCALE_HEADROOM))
+	{
+		const double fitScale = oldScale * std::sqrt(
+			(this->frameBudget * RESOLUTION_UPSCALE_HEADROOM) /
+			std::max(this->smoothedFrameTime, 1.0e-3));
+		newScale = std::min(fitScale, oldScale + MAX_SCALE_INCREASE);
+	}
+
+	newScale = std::min(std::max(newScale, this->minResolutionScale), 1.0);
+
+	// Always allow reaching the limits, even in small steps.
+	const bool isLimit = (newScale == this->minResolutionScale) || (newScale == 1.0);
+	if ((newScale == oldScale) ||
+		((std::abs(newScale - oldScale) < MIN_SCALE_CHANGE) && !isLimit))
+	{
+		return;
+	}
+
+	// Predict the smoothed time at the new scale so the next frames don't keep
+	// correcting for a size that's already gone.
+	this->smoothedFrameTime *= (newScale * newScale) / (oldScale * oldScale);
+	this->resolutionScale = newScale;
+	this->setRenderDimensions();
+}
+
+void CLProgram::unmapOutput(int frame)
+{
+	assert(this->mapPending.at(frame));
+
+	cl_int status = this->commandQueue.enqueueUnmapMemObject(this->outputBuffers.at(frame),
+		this->mappedOutputs.at(frame), nullptr, nullptr);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::CommandQueue::enqueueUnmapMemObject outputBuffer.");
+
+	this->mappedOutputs.at(frame) = nullptr;
+	this->mapPending.at(frame) = false;
+	this->profileEvents.at(frame).clear();
+}
+
+void CLProgram::recordProfile(int frame)
+{
+	assert(this->profiler.get() != nullptr);
+
+	// Sum each stage's time over the bands, keeping the stages in launch order.
+	std::vector<std::pair<std::string, double>> stageTimes;
+	for (const auto &pair : this->profileEvents.at(frame))
+	{
+		const double milliseconds = getEventMilliseconds(pair.second);
+		const auto iter = std::find_if(stageTimes.begin(), stageTimes.end(),
+			[&pair](const std::pair<std::string, double> &stageTime)
+		{
+			return stageTime.first == pair.first;
+		});
+
+		if (iter != stageTimes.end())
+		{
+			iter->second += milliseconds;
+		}
+		else
+		{
+			stageTimes.push_back(std::make_pair(pair.first, milliseconds));
+		}
+	}
 
-	// --- END TESTING ---
+	for (const auto &stageTime : stageTimes)
+	{
+		this->profiler->addSample(stageTime.first, stageTime.second);
+	}
 }
 
-CLProgram::~CLProgram()
+bool CLProgram::loadProgramBinary(const std::string &filename,
+	const std::string &buildOptions)
 {
-	// Destroy the game world frame buffer.
-	// The SDL_Renderer destroys this itself with SDL_DestroyRenderer(), too.
-	SDL_DestroyTexture(this->texture);
-}
-
-CLProgram &CLProgram::operator=(CLProgram &&clProgram)
-{
-	// Is there a better way to do this?
-	this->device = clProgram.device;
-	this->context = clProgram.context;
-	this->commandQueue = clProgram.commandQueue;
-	this->program = clProgram.program;
-	this->intersectKernel = clProgram.intersectKernel;
-	this->rayTraceKernel = clProgram.rayTraceKernel;
-	this->convertToRGBKernel = clProgram.convertToRGBKernel;
-	this->cameraBuffer = clProgram.cameraBuffer;
-	this->voxelRefBuffer = clProgram.voxelRefBuffer;
-	this->spriteRefBuffer = clProgram.spriteRefBuffer;
-	this->lightRefBuffer = clProgram.lightRefBuffer;
-	this->triangleBuffer = clProgram.triangleBuffer;
-	this->lightBuffer = clProgram.lightBuffer;
-	this->textureBuffer = clProgram.textureBuffer;
-	this->gameTimeBuffer = clProgram.gameTimeBuffer;
-	this->depthBuffer = clProgram.depthBuffer;
-	this->normalBuffer = clProgram.normalBuffer;
-	this->viewBuffer = clProgram.viewBuffer;
-	this->pointBuffer = clProgram.pointBuffer;
-	this->uvBuffer = clProgram.uvBuffer;
-	this->triangleIndexBuffer = clProgram.triangleIndexBuffer;
-	this->colorBuffer = clProgram.colorBuffer;
-	this->outputBuffer = clProgram.outputBuffer;
-	this->outputData = clProgram.outputData;
-	this->textureManager = std::move(clProgram.textureManager);
-	this->width = clProgram.width;
-	this->height = clProgram.height;
-	this->worldWidth = clProgram.worldWidth;
-	this->worldHeight = clProgram.worldHeight;
-	this->worldDepth = clProgram.worldDepth;
-
-	SDL_DestroyTexture(this->texture);
-	this->texture = clProgram.texture;
-	clProgram.texture = nullptr;
-
-	return *this;
-}
+	if (!File::exists(filename))
+	{
+		return false;
+	}
 
-std::vector<cl::Platform> CLProgram::getPlatforms()
-{
-	std::vector<cl::Platform> platforms;
-	cl_int status = cl::Platform::get(&platforms);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "CLProgram::getPlatforms.");
+	const std::string binary = File::toString(filename);
+	const cl::Program::Binaries binaries = { 
+		std::vector<unsigned char>(binary.begin(), binary.end()) };
+	const std::vector<cl::Device> devices = { this->device };
 
-	return platforms;
+	// A binary from an older driver (or a damaged file) is rejected here, and the 
+	// source is compiled instead.
+	std::vector<cl_int> binaryStatus;
+	cl_int status = CL_SUCCESS;
+	this->program = cl::Program(this->context, devices, binaries, &binaryStatus, &status);
+	if ((status != CL_SUCCESS) || (binaryStatus.size() == 0) ||
+		(binaryStatus.at(0) != CL_SUCCESS))
+	{
+		Debug::mention("CLProgram", "Could not load program binary \"" + filename +
+			"\" (" + this->getErrorString(status) + ").");
+		return false;
+	}
+
+	status = this->program.build(devices, buildOptions.c_str());
+	if (status != CL_SUCCESS)
+	{
+		Debug::mention("CLProgram", "Could not build program binary \"" + filename +
+			"\" (" + this->getErrorString(status) + ").");
+		return false;
+	}
+
+	Debug::mention("CLProgram", "Loaded program binary \"" + filename + "\".");
+	return true;
 }
 
-std::vector<cl::Device> CLProgram::getDevices(const cl::Platform &platform,
-	cl_device_type type)
+void CLProgram::saveProgramBinary(const std::string &filename) const
 {
-	std::vector<cl::Device> devices;
-	cl_int status = platform.getDevices(type, &devices);
-	Debug::check((status == CL_SUCCESS) || (status == CL_DEVICE_NOT_FOUND),
-		"CLProgram", "CLProgram::getDevices.");
+	cl_int status = CL_SUCCESS;
+	const auto binaries = this->program.getInfo<CL_PROGRAM_BINARIES>(&status);
+	if ((status != CL_SUCCESS) || (binaries.size() == 0) || (binaries.at(0).size() == 0))
+	{
+		Debug::mention("CLProgram", "Program binary not available for caching.");
+		return;
+	}
 
-	return devices;
+	// Not being able to write the cache isn't fatal. The source is just compiled again
+	// next time.
+	const auto &binary = binaries.at(0);
+	if (!File::fromString(filename, std::string(binary.begin(), binary.end())))
+	{
+		Debug::mention("CLProgram", "Could not save program binary \"" + filename + "\".");
+	}
 }
 
 std::string CLProgram::getBuildReport() const
@@ -486,397 +1829,925 @@ std::string CLProgram::getErrorString(cl_int error) const
 	}
 }
 
-void CLProgram::makeTestWorld()
-{
-	Debug::mention("CLProgram", "Making test world.");
-
-	// This method builds a simple test city with some blocks around.
-	// It does nothing with sprites and lights yet.
-
-	// Lambda for creating a vector of triangles for a particular voxel.
-	auto makeBlock = [](int cellX, int cellY, int cellZ)
-	{
-		double x = static_cast<double>(cellX);
-		double y = static_cast<double>(cellY);
-		double z = static_cast<double>(cellZ);
-		const double sideLength = 1.0;
-
-		// Front.
-		Triangle t1(
-			Float3d(x + sideLength, y + sideLength, z),
-			Float3d(x + sideLength, y, z),
-			Float3d(x, y, z),
-			Float2d(0.0, 0.0),
-			Float2d(0.0, 1.0),
-			Float2d(1.0, 1.0));
-
-		Triangle t2(
-			Float3d(x, y, z),
-			Float3d(x, y + sideLength, z),
-			Float3d(x + sideLength, y + sideLength, z),
-			Float2d(1.0, 1.0),
-			Float2d(1.0, 0.0),
-			Float2d(0.0, 0.0));
-
-		// Back.
-		Triangle t3(
-			Float3d(x, y + sideLength, z + sideLength),
-			Float3d(x, y, z + sideLength),
-			Float3d(x + sideLength, y, z + sideLength),
-			Float2d(0.0, 0.0),
-			Float2d(0.0, 1.0),
-			Float2d(1.0, 1.0));
-
-		Triangle t4(
-			Float3d(x + sideLength, y, z + sideLength),
-			Float3d(x + sideLength, y + sideLength, z + sideLength),
-			Float3d(x, y + sideLength, z + sideLength),
-			Float2d(1.0, 1.0),
-			Float2d(1.0, 0.0),
-			Float2d(0.0, 0.0));
-
-		// Top.
-		Triangle t5(
-			Float3d(x + sideLength, y + sideLength, z + sideLength),
-			Float3d(x + sideLength, y + sideLength, z),
-			Float3d(x, y + sideLength, z),
-			Float2d(0.0, 0.0),
-			Float2d(0.0, 1.0),
-			Float2d(1.0, 1.0));
-
-		Triangle t6(
-			Float3d(x, y + sideLength, z),
-			Float3d(x, y + sideLength, z + sideLength),
-			Float3d(x + sideLength, y + sideLength, z + sideLength),
-			Float2d(1.0, 1.0),
-			Float2d(1.0, 0.0),
-			Float2d(0.0, 0.0));
-
-		// Bottom.
-		Triangle t7(
-			Float3d(x + sideLength, y, z),
-			Float3d(x + sideLength, y, z + sideLength),
-			Float3d(x, y, z + sideLength),
-			Float2d(0.0, 0.0),
-			Float2d(0.0, 1.0),
-			Float2d(1.0, 1.0));
-
-		Triangle t8(
-			Float3d(x, y, z + sideLength),
-			Float3d(x, y, z),
-			Float3d(x + sideLength, y, z),
-			Float2d(1.0, 1.0),
-			Float2d(1.0, 0.0),
-			Float2d(0.0, 0.0));
-
-		// Right.
-		Triangle t9(
-			Float3d(x, y + sideLength, z),
-			Float3d(x, y, z),
-			Float3d(x, y, z + sideLength),
-			Float2d(0.0, 0.0),
-			Float2d(0.0, 1.0),
-			Float2d(1.0, 1.0));
-
-		Triangle t10(
-			Float3d(x, y, z + sideLength),
-			Float3d(x, y + sideLength, z + sideLength),
-			Float3d(x, y + sideLength, z),
-			Float2d(1.0, 1.0),
-			Float2d(1.0, 0.0),
-			Float2d(0.0, 0.0));
-
-		// Left.
-		Triangle t11(
-			Float3d(x + sideLength, y + sideLength, z + sideLength),
-			Float3d(x + sideLength, y, z + sideLength),
-			Float3d(x + sideLength, y, z),
-			Float2d(0.0, 0.0),
-			Float2d(0.0, 1.0),
-			Float2d(1.0, 1.0));
-
-		Triangle t12(
-			Float3d(x + sideLength, y, z),
-			Float3d(x + sideLength, y + sideLength, z),
-			Float3d(x + sideLength, y + sideLength, z + sideLength),
-			Float2d(1.0, 1.0),
-			Float2d(1.0, 0.0),
-			Float2d(0.0, 0.0));
-
-		return std::vector<Triangle>
-		{
-			t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12
-		};
-	};
+void CLProgram::setTriangleArgs()
+{
+	for (size_t i = 0; i < this->triangleBuffers.size(); ++i)
+	{
+		const cl::Buffer &buffer = this->triangleBuffers.at(i);
+
+		if (this->fused)
+		{
+			cl_int status = this->fusedRenderKernel.setArg(
+				FUSED_RENDER_TRIANGLE_ARGS.at(i), buffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg fusedRenderKernel triangleBuffers.");
+		}
+		else
+		{
+			const std::array<int, 5> &intersectArgs = this->packetTraversal ?
+				INTERSECT_PACKET_TRIANGLE_ARGS : INTERSECT_TRIANGLE_ARGS;
+			cl_int status = this->intersectKernel.setArg(intersectArgs.at(i), buffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg intersectKernel triangleBuffers.");
+
+			status = this->rayTraceKernel.setArg(RAY_TRACE_TRIANGLE_ARGS.at(i), buffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg rayTraceKernel triangleBuffers.");
+
+			if ((this->occlusionSamples > 0) && (i < AMBIENT_OCCLUSION_TRIANGLE_ARGS.size()))
+			{
+				status = this->ambientOcclusionKernel.setArg(
+					AMBIENT_OCCLUSION_TRIANGLE_ARGS.at(i), buffer);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::Kernel::setArg ambientOcclusionKernel triangleBuffers.");
+			}
+		}
+	}
+}
+
+void CLProgram::setLightArgs()
+{
+	if (this->fused)
+	{
+		cl_int status = this->fusedRenderKernel.setArg(5, this->lightBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel lightBuffer.");
+
+		status = this->fusedRenderKernel.setArg(FUSED_RENDER_LIGHT_INDEX_ARG,
+			this->lightIndexBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel lightIndexBuffer.");
+
+		status = this->fusedRenderKernel.setArg(FUSED_RENDER_VISIBILITY_ARG,
+			this->visibilityBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel visibilityBuffer.");
+	}
+	else
+	{
+		cl_int status = this->rayTraceKernel.setArg(4, this->lightBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel lightBuffer.");
+
+		status = this->rayTraceKernel.setArg(RAY_TRACE_LIGHT_INDEX_ARG,
+			this->lightIndexBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel lightIndexBuffer.");
+
+		status = this->rayTraceKernel.setArg(RAY_TRACE_VISIBILITY_ARG,
+			this->visibilityBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel visibilityBuffer.");
+	}
+}
+
+void CLProgram::setSpriteArgs()
+{
+	const cl_int spriteTriangleOffset = this->spriteTriangleRun.getOffset();
+
+	if (this->fused)
+	{
+		cl_int status = this->fusedRenderKernel.setArg(FUSED_RENDER_SPRITE_ARGS.at(0),
+			this->spriteIndexBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel spriteIndexBuffer.");
+
+		status = this->fusedRenderKernel.setArg(FUSED_RENDER_SPRITE_ARGS.at(1),
+			spriteTriangleOffset);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel spriteTriangleOffset.");
+	}
+	else
+	{
+		const std::array<int, 2> &intersectArgs = this->packetTraversal ?
+			INTERSECT_PACKET_SPRITE_ARGS : INTERSECT_SPRITE_ARGS;
+		cl_int status = this->intersectKernel.setArg(intersectArgs.at(0),
+			this->spriteIndexBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel spriteIndexBuffer.");
+
+		status = this->intersectKernel.setArg(intersectArgs.at(1),
+			spriteTriangleOffset);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel spriteTriangleOffset.");
+
+		status = this->rayTraceKernel.setArg(RAY_TRACE_SPRITE_ARGS.at(0),
+			this->spriteIndexBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel spriteIndexBuffer.");
+
+		status = this->rayTraceKernel.setArg(RAY_TRACE_SPRITE_ARGS.at(1),
+			spriteTriangleOffset);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel spriteTriangleOffset.");
+	}
+}
+
+void CLProgram::updateSprites()
+{
+	if (!this->spriteGrid.isDirty())
+	{
+		return;
+	}
+
+	// The host sprite indices can't change while they're being written.
+	this->finishUploads();
+	this->spriteGrid.update();
+
+	// Grow the sprite index buffer geometrically, keeping what's on the device. The
+	// dirty ranges cover everything that changed.
+	const int indexCount = static_cast<int>(this->spriteGrid.getSpriteIndices().size());
+	if (indexCount > this->spriteIndexCapacity)
+	{
+		int newCapacity = this->spriteIndexCapacity;
+		while (newCapacity < indexCount)
+		{
+			newCapacity *= 2;
+		}
+
+		cl_int status = CL_SUCCESS;
+		cl::Buffer newSpriteIndexBuffer(this->context, CL_MEM_READ_ONLY,
+			sizeof(cl_int) * newCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer spriteIndexBuffer.");
+
+		status = this->commandQueue.enqueueCopyBuffer(this->spriteIndexBuffer,
+			newSpriteIndexBuffer, 0, 0, sizeof(cl_int) * this->spriteIndexCapacity,
+			nullptr, nullptr);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueCopyBuffer spriteIndexBuffer.");
+
+		this->spriteIndexBuffer = newSpriteIndexBuffer;
+		this->spriteIndexCapacity = newCapacity;
+		this->setSpriteArgs();
+	}
+
+	// Each sprite slot has two triangles in the sprite triangle region. If the region
+	// is too small, move every slot to a bigger one.
+	const int slotCount = this->spriteGrid.getSlotCount();
+	const int triangleCount = slotCount * 2;
+	if (triangleCount > this->spriteTriangleRun.getTriangleCount())
+	{
+		int newCount = std::max(this->spriteTriangleRun.getTriangleCount(),
+			INITIAL_SPRITE_TRIANGLES);
+		while (newCount < triangleCount)
+		{
+			newCount *= 2;
+		}
+
+		this->freeTriangles(this->spriteTriangleRun);
+		this->spriteTriangleRun = VoxelReference(this->allocateTriangles(newCount),
+			newCount);
+		this->setSpriteArgs();
+
+		for (int i = 0; i < slotCount; ++i)
+		{
+			this->writeTriangles(this->spriteGrid.getTriangles(i),
+				this->spriteGrid.getTextureIndex(i),
+				this->spriteTriangleRun.getOffset() + (i * 2));
+		}
+	}
+	else
+	{
+		for (const int slot : this->spriteGrid.getUpdatedSlots())
+		{
+			this->writeTriangles(this->spriteGrid.getTriangles(slot),
+				this->spriteGrid.getTextureIndex(slot),
+				this->spriteTriangleRun.getOffset() + (slot * 2));
+		}
+	}
+}
+
+void CLProgram::uploadLights()
+{
+	if (!this->lightGrid.isDirty())
+	{
+		return;
+	}
+
+	// The host light data can't change while it's being written.
+	this->finishUploads();
+	this->lightGrid.update();
+
+	const int lightCount = this->lightGrid.getLightCount();
+	const int lightIndexCount = static_cast<int>(this->lightGrid.getCellLights().size());
+
+	// Grow the light buffers geometrically if they're too small. Everything in them is
+	// written again below, so nothing needs copying.
+	const bool lightsGrow = lightCount > this->lightCapacity;
+	const bool lightIndicesGrow = lightIndexCount > this->lightIndexCapacity;
+	cl_int status = CL_SUCCESS;
+	if (lightsGrow)
+	{
+		while (this->lightCapacity < lightCount)
+		{
+			this->lightCapacity *= 2;
+		}
+
+		this->lightBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+			SIZEOF_LIGHT * this->lightCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightBuffer.");
+	}
+
+	// The visibility cache follows the cell lists. A new one has no samples, since the
+	// cell lists it was counted for moved.
+	if (lightIndicesGrow)
+	{
+		while (this->lightIndexCapacity < lightIndexCount)
+		{
+			this->lightIndexCapacity *= 2;
+		}
+
+		this->lightIndexBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+			sizeof(cl_int) * this->lightIndexCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightIndexBuffer.");
+
+		this->visibilityBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			sizeof(cl_uint) * this->getVisibilityCapacity(), nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer visibilityBuffer.");
+
+		const cl_uint noSamples = 0;
+		cl::Event event;
+		status = this->commandQueue.enqueueFillBuffer(this->visibilityBuffer, noSamples, 0,
+			sizeof(cl_uint) * this->getVisibilityCapacity(), nullptr, &event);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueFillBuffer visibilityBuffer.");
+
+		this->uploadEvents.push_back(event);
+	}
+
+	if (lightsGrow || lightIndicesGrow)
+	{
+		this->setLightArgs();
+	}
+
+	// Lambda for writing a whole host array to the start of a device buffer without
+	// blocking.
+	auto upload = [this](const cl::Buffer &buffer, const void *data, cl::size_type size,
+		const std::string &bufferName)
+	{
+		if (size == 0)
+		{
+			return;
+		}
+
+		cl::Event event;
+		cl_int status = this->commandQueue.enqueueWriteBuffer(buffer, CL_FALSE, 0, size,
+			data, nullptr, &event);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::enqueueWriteBuffer uploadLights " + bufferName);
+
+		this->uploadEvents.push_back(event);
+	};
+
+	upload(this->lightBuffer, this->lightGrid.getLightData().data(),
+		SIZEOF_LIGHT * lightCount, "lightBuffer");
+	upload(this->lightRefBuffer, this->lightGrid.getCellRefs().data(),
+		SIZEOF_LIGHT_REF * this->lightGrid.getCellCount(), "lightRefBuffer");
+	upload(this->lightIndexBuffer, this->lightGrid.getCellLights().data(),
+		sizeof(cl_int) * lightIndexCount, "lightIndexBuffer");
+
+	// Lights only change shading, so the hits don't need tracing again.
+	this->shadingDirty = true;
+}
+
+int CLProgram::getVisibilityCapacity() const
+{
+	return (this->shadowRays > 0) ?
+		(this->lightIndexCapacity * LightGrid::CELL_VOXELS) : 1;
+}
+
+void CLProgram::clearStaleVisibility()
+{
+	// Stale ranges are still popped without shadows, so they don't pile up.
+	const std::vector<std::pair<int, int>> ranges = this->lightGrid.popStaleVisibility();
+	if (this->shadowRays == 0)
+	{
+		return;
+	}
+
+	const cl_uint noSamples = 0;
+	for (const auto &range : ranges)
+	{
+		cl::Event event;
+		cl_int status = this->commandQueue.enqueueFillBuffer(this->visibilityBuffer,
+			noSamples, sizeof(cl_uint) * range.first,
+			sizeof(cl_uint) * (range.second - range.first), nullptr, &event);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueFillBuffer visibilityBuffer.");
+
+		this->uploadEvents.push_back(event);
+	}
+}
+
+void CLProgram::reserveTriangles(int count)
+{
+	assert(count >= 0);
+
+	if (count <= this->triangleCapacity)
+	{
+		return;
+	}
+
+	// Grow geometrically so incremental additions don't reallocate every time.
+	int newCapacity = this->triangleCapacity;
+	while (newCapacity < count)
+	{
+		newCapacity *= 2;
+	}
+
+	Debug::mention("CLProgram", "Growing triangle buffer to " +
+		std::to_string(newCapacity) + " triangles.");
+
+	for (size_t i = 0; i < TrianglePacker::STREAMS.size(); ++i)
+	{
+		const cl::size_type stride = TrianglePacker::getStride(TrianglePacker::STREAMS.at(i));
+
+		cl_int status = CL_SUCCESS;
+		cl::Buffer newTriangleBuffer(this->context, CL_MEM_READ_ONLY,
+			stride * newCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer triangleBuffers.");
+
+		// Keep the triangles that are already on the device.
+		if (this->triangleCount > 0)
+		{
+			status = this->commandQueue.enqueueCopyBuffer(this->triangleBuffers.at(i),
+				newTriangleBuffer, 0, 0, stride * this->triangleCount, nullptr, nullptr);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::CommandQueue::enqueueCopyBuffer triangleBuffers.");
+		}
+
+		this->triangleBuffers.at(i) = newTriangleBuffer;
+	}
+
+	this->triangleCapacity = newCapacity;
+
+	// Every kernel that reads triangles needs to see the new buffers.
+	this->setTriangleArgs();
+}
+
+void CLProgram::finishUploads()
+{
+	if (this->uploadEvents.size() > 0)
+	{
+		cl_int status = cl::Event::waitForEvents(this->uploadEvents);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::waitForEvents uploads.");
+
+		this->uploadEvents.clear();
+	}
+}
+
+void CLProgram::finishUniformWrites()
+{
+	if (this->uniformWritePending)
+	{
+		cl_int status = this->uniformEvent.wait();
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::wait uniformEvent.");
+
+		this->uniformWritePending = false;
+	}
+}
+
+void CLProgram::uploadUniforms()
+{
+	if (!this->uniformsDirty)
+	{
+		return;
+	}
+
+	const cl_char *uniformPtr = reinterpret_cast<const cl_char*>(this->uniformData.data());
+
+	// The queue is in order, so the game time write finishing means the camera write
+	// has finished, too.
+	cl_int status = this->commandQueue.enqueueWriteBuffer(this->cameraBuffer, CL_FALSE,
+		0, SIZEOF_CAMERA, static_cast<const void*>(uniformPtr + UNIFORM_CAMERA_OFFSET),
+		nullptr, nullptr);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer cameraBuffer");
+
+	status = this->commandQueue.enqueueWriteBuffer(this->gameTimeBuffer, CL_FALSE,
+		0, SIZEOF_GAME_TIME, static_cast<const void*>(uniformPtr + UNIFORM_GAME_TIME_OFFSET),
+		nullptr, &this->uniformEvent);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer gameTimeBuffer");
+
+	this->uniformsDirty = false;
+	this->uniformWritePending = true;
+}
+
+int CLProgram::allocateTriangles(int count)
+{
+	assert(count > 0);
+
+	// Use the first freed run that's big enough, and keep the rest of it free.
+	for (size_t i = 0; i < this->freeTriangleRuns.size(); ++i)
+	{
+		const VoxelReference run = this->freeTriangleRuns.at(i);
+		if (run.getTriangleCount() >= count)
+		{
+			this->freeTriangleRuns.erase(this->freeTriangleRuns.begin() + i);
+
+			if (run.getTriangleCount() > count)
+			{
+				this->freeTriangleRuns.push_back(VoxelReference(
+					run.getOffset() + count, run.getTriangleCount() - count));
+			}
+
+			return run.getOffset();
+		}
+	}
+
+	// Otherwise, add the triangles to the end.
+	const int offset = this->triangleCount;
+	this->reserveTriangles(offset + count);
+
+	// The host copy might move in memory when it grows.
+	this->finishUploads();
+	this->trianglePacker.resize(offset + count);
+	this->triangleCount += count;
+
+	return offset;
+}
+
+void CLProgram::freeTriangles(const VoxelReference &run)
+{
+	assert(run.getOffset() >= 0);
+	assert((run.getOffset() + run.getTriangleCount()) <= this->triangleCount);
+
+	if (run.getTriangleCount() == 0)
+	{
+		return;
+	}
+
+	// Merge the run with the free runs right before and after it, so freed space
+	// doesn't end up split into runs too small to reuse.
+	int offset = run.getOffset();
+	int end = run.getOffset() + run.getTriangleCount();
+	auto runIter = this->freeTriangleRuns.begin();
+	while (runIter != this->freeTriangleRuns.end())
+	{
+		const int runEnd = runIter->getOffset() + runIter->getTriangleCount();
+		if (runEnd == offset)
+		{
+			offset = runIter->getOffset();
+			runIter = this->freeTriangleRuns.erase(runIter);
+		}
+		else if (runIter->getOffset() == end)
+		{
+			end = runEnd;
+			runIter = this->freeTriangleRuns.erase(runIter);
+		}
+		else
+		{
+			++runIter;
+		}
+	}
+
+	this->freeTriangleRuns.push_back(VoxelReference(offset, end - offset));
+}
+
+void CLProgram::loadTextures(const std::vector<std::string> &filenames)
+{
+	assert(this->triangleCount == 0);
+
+	// Read each texture's palette indices and note where they go in the atlas.
+	std::vector<std::vector<uint8_t>> indices;
+	this->textureRefs.clear();
+	int texelCount = 0;
+	for (const auto &filename : filenames)
+	{
+		int width, height;
+		indices.push_back(this->textureManager.getIndices(filename, width, height));
+		this->textureRefs.push_back(TextureReference(texelCount, width, height));
+		texelCount += width * height;
+	}
+
+	// Pack the textures one after another.
+	std::vector<cl_uchar> atlas(std::max(texelCount, 1));
+	for (int i = 0; i < static_cast<int>(indices.size()); ++i)
+	{
+		const auto &textureIndices = indices.at(i);
+		std::copy(textureIndices.begin(), textureIndices.end(),
+			atlas.begin() + this->textureRefs.at(i).getOffset());
+	}
+
+	Debug::mention("CLProgram", "Texture atlas has " + std::to_string(filenames.size()) +
+		" textures (" + std::to_string(atlas.size()) + " bytes).");
+
+	cl_int status = CL_SUCCESS;
+	this->textureBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		atlas.size(), nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer textureBuffer.");
+
+	status = this->commandQueue.enqueueWriteBuffer(this->textureBuffer, CL_TRUE, 0,
+		atlas.size(), static_cast<const void*>(atlas.data()), nullptr, nullptr);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer textureBuffer");
+
+	// Every kernel that samples textures needs to see the new buffer.
+	if (this->fused)
+	{
+		status = this->fusedRenderKernel.setArg(6, this->textureBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel textureBuffer.");
+	}
+	else
+	{
+		status = this->intersectKernel.setArg(4, this->textureBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel textureBuffer.");
+
+		status = this->rayTraceKernel.setArg(5, this->textureBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel textureBuffer.");
+	}
+}
+
+void CLProgram::writeTriangles(const std::vector<Triangle> &triangles, int textureIndex,
+	int offset)
+{
+	const int count = static_cast<int>(triangles.size());
+	assert(offset >= 0);
+	assert((offset + count) <= this->triangleCount);
+
+	this->finishUploads();
+
+	const TextureReference &textureRef = this->textureRefs.at(textureIndex);
+	for (int i = 0; i < count; ++i)
+	{
+		this->trianglePacker.write(offset + i, triangles.at(i), textureRef);
+	}
+
+	this->dirtyTriangles.push_back(std::make_pair(offset, offset + count));
+}
+
+int CLProgram::getVoxelIndex(int x, int y, int z) const
+{
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(z >= 0);
+	assert(x < this->worldWidth);
+	assert(y < this->worldHeight);
+	assert(z < this->worldDepth);
+
+	return x + (y * this->worldWidth) + (z * this->worldWidth * this->worldHeight);
+}
+
+void CLProgram::setVoxelReference(int voxelIndex, const VoxelReference &voxelRef)
+{
+	this->finishUploads();
+
+	cl_char *voxPtr = reinterpret_cast<cl_char*>(this->voxelRefData.data()) +
+		(SIZEOF_VOXEL_REF * voxelIndex);
+
+	// Update the occupancy hierarchy if the voxel becomes empty or non-empty.
+	const cl_int oldCount = *(reinterpret_cast<const cl_int*>(voxPtr) + 1);
+	const bool wasOccupied = oldCount > 0;
+	const bool isOccupied = voxelRef.getTriangleCount() > 0;
+	if (wasOccupied != isOccupied)
+	{
+		this->updateOccupancy(voxelIndex, isOccupied ? 1 : -1);
+	}
+
+	writeVoxelRef(voxelRef, voxPtr);
+
+	this->dirtyVoxelRefs.push_back(std::make_pair(voxelIndex, voxelIndex + 1));
+}
+
+void CLProgram::updateOccupancy(int voxelIndex, int delta)
+{
+	const int x = voxelIndex % this->worldWidth;
+	const int y = (voxelIndex / this->worldWidth) % this->worldHeight;
+	const int z = voxelIndex / (this->worldWidth * this->worldHeight);
+
+	cl_ushort *countPtr = reinterpret_cast<cl_ushort*>(this->occupancyData.data());
+
+	// Lambda for changing the count of the brick containing the voxel in one level.
+	auto updateBrick = [this, x, y, z, delta, countPtr](int brickSize, int levelOffset)
+	{
+		const int levelWidth = getBrickCount(this->worldWidth, brickSize);
+		const int levelHeight = getBrickCount(this->worldHeight, brickSize);
+		const int brickIndex = levelOffset + (x / brickSize) +
+			((y / brickSize) * levelWidth) + ((z / brickSize) * levelWidth * levelHeight);
+
+		cl_ushort &count = *(countPtr + brickIndex);
+		assert((delta > 0) || (count > 0));
+		count = static_cast<cl_ushort>(count + delta);
 
-	// Write some triangles to a triangle buffer.
-	const int maxTrianglesPerVoxel = 12;
-	size_t triangleBufferSize = SIZEOF_TRIANGLE * maxTrianglesPerVoxel *
-		this->worldWidth * this->worldHeight * this->worldDepth;
-	std::vector<char> triangleBuffer(triangleBufferSize);
-	cl_char *triPtr = reinterpret_cast<cl_char*>(triangleBuffer.data());
-
-	// Lambda for writing triangle data to the local buffer.
-	// - NOTE: using texture index here assumes that all textures are 64x64.
-	auto writeTriangle = [this, maxTrianglesPerVoxel, triPtr](const Triangle &triangle,
-		int cellX, int cellY, int cellZ, int triangleOffset, int textureIndex)
-	{
-		assert(cellX >= 0);
-		assert(cellY >= 0);
-		assert(cellZ >= 0);
-		assert(cellX < this->worldWidth);
-		assert(cellY < this->worldHeight);
-		assert(cellZ < this->worldDepth);
-
-		// Only 12 triangles max per block for now.
-		assert(triangleOffset < maxTrianglesPerVoxel);
-
-		// Offset in the local buffer.
-		cl_char *ptr = triPtr + (cellX * SIZEOF_TRIANGLE * maxTrianglesPerVoxel) +
-			((cellY * this->worldWidth) * SIZEOF_TRIANGLE * maxTrianglesPerVoxel) +
-			((cellZ * this->worldWidth * this->worldHeight) * SIZEOF_TRIANGLE *
-				maxTrianglesPerVoxel) + (triangleOffset * SIZEOF_TRIANGLE);
-
-		cl_float *p1Ptr = reinterpret_cast<cl_float*>(ptr);
-		*(p1Ptr + 0) = static_cast<cl_float>(triangle.getP1().getX());
-		*(p1Ptr + 1) = static_cast<cl_float>(triangle.getP1().getY());
-		*(p1Ptr + 2) = static_cast<cl_float>(triangle.getP1().getZ());
-
-		cl_float *p2Ptr = reinterpret_cast<cl_float*>(ptr + sizeof(cl_float3));
-		*(p2Ptr + 0) = static_cast<cl_float>(triangle.getP2().getX());
-		*(p2Ptr + 1) = static_cast<cl_float>(triangle.getP2().getY());
-		*(p2Ptr + 2) = static_cast<cl_float>(triangle.getP2().getZ());
-
-		cl_float *p3Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 2));
-		*(p3Ptr + 0) = static_cast<cl_float>(triangle.getP3().getX());
-		*(p3Ptr + 1) = static_cast<cl_float>(triangle.getP3().getY());
-		*(p3Ptr + 2) = static_cast<cl_float>(triangle.getP3().getZ());
-
-		cl_float *normalPtr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 3));
-		*(normalPtr + 0) = static_cast<cl_float>(triangle.getNormal().getX());
-		*(normalPtr + 1) = static_cast<cl_float>(triangle.getNormal().getY());
-		*(normalPtr + 2) = static_cast<cl_float>(triangle.getNormal().getZ());
-
-		cl_float *uv1Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 4));
-		*(uv1Ptr + 0) = static_cast<cl_float>(triangle.getUV1().getX());
-		*(uv1Ptr + 1) = static_cast<cl_float>(triangle.getUV1().getY());
-
-		cl_float *uv2Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 4) +
-			sizeof(cl_float2));
-		*(uv2Ptr + 0) = static_cast<cl_float>(triangle.getUV2().getX());
-		*(uv2Ptr + 1) = static_cast<cl_float>(triangle.getUV2().getY());
-
-		cl_float *uv3Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 4) +
-			(sizeof(cl_float2) * 2));
-		*(uv3Ptr + 0) = static_cast<cl_float>(triangle.getUV3().getX());
-		*(uv3Ptr + 1) = static_cast<cl_float>(triangle.getUV3().getY());
-
-		cl_int *offsetPtr = reinterpret_cast<cl_int*>(ptr + (sizeof(cl_float3) * 4) +
-			(sizeof(cl_float2) * 3));
-		*(offsetPtr + 0) = 64 * 64 * textureIndex; // Number of float4's to skip.
-
-		cl_short *dimPtr = reinterpret_cast<cl_short*>(ptr + (sizeof(cl_float3) * 4) +
-			(sizeof(cl_float2) * 3) + sizeof(cl_int));
-		*(dimPtr + 0) = 64;
-		*(dimPtr + 1) = 64;
+		this->dirtyOccupancy.push_back(std::make_pair(brickIndex, brickIndex + 1));
 	};
 
-	// Fill a voxel reference buffer with references to those triangles.
-	size_t voxelRefBufferSize = SIZEOF_VOXEL_REF * this->worldWidth * this->worldHeight *
-		this->worldDepth;
-	std::vector<char> voxelRefBuffer(voxelRefBufferSize);
-	cl_char *voxPtr = reinterpret_cast<cl_char*>(voxelRefBuffer.data());
-
-	// Lambda for writing a voxel reference into the local buffer. This only works 
-	// when using the naive triangle array storage (i.e., *every* voxel has 12 
-	// triangle slots). Consider making the offset based on the number of triangles
-	// written, instead of an arbitrary XYZ coordinate.
-	auto writeVoxelRef = [this, voxPtr](int cellX, int cellY, int cellZ, int count)
-	{
-		assert(cellX >= 0);
-		assert(cellY >= 0);
-		assert(cellZ >= 0);
-		assert(cellX < this->worldWidth);
-		assert(cellY < this->worldHeight);
-		assert(cellZ < this->worldDepth);
-		assert(count >= 0);
-
-		cl_char *ptr = voxPtr + (cellX * SIZEOF_VOXEL_REF) +
-			((cellY * this->worldWidth) * SIZEOF_VOXEL_REF) +
-			((cellZ * this->worldWidth * this->worldHeight) * SIZEOF_VOXEL_REF);
-
-		// Number of triangles to skip in the triangles array.
-		int offset = 12 * (cellX + (cellY * this->worldWidth) +
-			(cellZ * this->worldWidth * this->worldHeight));
-
-		cl_int *offsetPtr = reinterpret_cast<cl_int*>(ptr);
-		*(offsetPtr + 0) = offset;
-
-		cl_int *countPtr = reinterpret_cast<cl_int*>(ptr + sizeof(cl_int));
-		*(countPtr + 0) = count;
-	};
+	updateBrick(OCCUPANCY_SMALL_BRICK, 0);
+	updateBrick(OCCUPANCY_LARGE_BRICK, this->occupancyLargeOffset);
+}
+
+VoxelReference CLProgram::getVoxelTemplate(VoxelType voxelType, int textureIndex)
+{
+	assert(textureIndex >= 0);
 
-	// Prepare some textures for a local float4 buffer.	
-	this->textureManager.setPalette(PaletteName::Default);
-	std::vector<const SDL_Surface*> textures =
+	auto key = std::make_pair(voxelType, textureIndex);
+	auto templateIter = this->voxelTemplates.find(key);
+	if (templateIter != this->voxelTemplates.end())
 	{
-		this->textureManager.getSurface("T_CITYWL.IMG").getSurface(),
-		this->textureManager.getSurface("T_NGRASS.IMG").getSurface(),
-		this->textureManager.getSurface("T_NROAD.IMG").getSurface(),
-		this->textureManager.getSurface("T_NSDWLK.IMG").getSurface(),
-		this->textureManager.getSurface("T_GARDEN.IMG").getSurface(),
-	};
+		return templateIter->second;
+	}
+
+	// Add the voxel type's triangles to the triangle buffer.
+	std::vector<Triangle> geometry = Voxel(voxelType).getGeometry();
+	const int count = static_cast<int>(geometry.size());
+	const int offset = (count > 0) ? this->allocateTriangles(count) : 0;
 
-	const int textureCount = static_cast<int>(textures.size());
-	const int textureWidth = 64;
-	const int textureHeight = 64;
-	size_t textureBufferSize = sizeof(cl_float4) * textureWidth * 
-		textureHeight * textureCount;
-	std::vector<char> textureBuffer(textureBufferSize);
-	cl_char *texPtr = reinterpret_cast<cl_char*>(textureBuffer.data());
-	
-	// Pack the texture data into the local buffer.
-	for (int i = 0; i < textureCount; ++i)
+	if (count > 0)
 	{
-		const SDL_Surface *texture = textures.at(i);
-		uint32_t *pixels = static_cast<uint32_t*>(texture->pixels);
+		this->writeTriangles(geometry, textureIndex, offset);
+	}
 
-		int pixelOffset = sizeof(cl_float4) * textureWidth * textureHeight * i;
-		cl_float4 *pixelPtr = reinterpret_cast<cl_float4*>(texPtr + pixelOffset);
+	VoxelReference voxelRef(offset, count);
+	this->voxelTemplates.insert(std::make_pair(key, voxelRef));
+	return voxelRef;
+}
 
-		for (int y = 0; y < texture->h; ++y)
+void CLProgram::loadPalettes()
+{
+	// Palette colors are RGBA bytes on the device.
+	std::vector<cl_uchar4> paletteData(PALETTE_LENGTH * DEVICE_PALETTES.size());
+	for (int slot = 0; slot < static_cast<int>(DEVICE_PALETTES.size()); ++slot)
+	{
+		const auto &palette = this->textureManager.getPalette(DEVICE_PALETTES.at(slot));
+		for (int i = 0; i < PALETTE_LENGTH; ++i)
 		{
-			for (int x = 0; x < texture->w; ++x)
-			{
-				int index = x + (y * texture->w);
+			const Color &color = palette.at(i);
+			cl_uchar *colorPtr = reinterpret_cast<cl_uchar*>(
+				&paletteData.at((slot * PALETTE_LENGTH) + i));
+			*(colorPtr + 0) = color.getR();
+			*(colorPtr + 1) = color.getG();
+			*(colorPtr + 2) = color.getB();
+			*(colorPtr + 3) = color.getA();
+		}
+	}
+
+	cl_int status = this->commandQueue.enqueueWriteBuffer(this->paletteBuffer, CL_TRUE,
+		0, sizeof(cl_uchar4) * paletteData.size(),
+		static_cast<const void*>(paletteData.data()), nullptr, nullptr);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer paletteBuffer");
+}
+
+void CLProgram::setPalette(PaletteName paletteName)
+{
+	this->setPalettes(paletteName, paletteName);
+}
 
-				// Convert from ARGB int to RGBA float4.
-				Float4f color = Float4f::fromARGB(pixels[index]);
+void CLProgram::setPalettes(PaletteName nightPalette, PaletteName dayPalette)
+{
+	// The uniform block might still be in use by last frame's write.
+	this->finishUniformWrites();
 
-				cl_float *colorPtr = reinterpret_cast<cl_float*>(pixelPtr + index);
-				*(colorPtr + 0) = static_cast<cl_float>(color.getX());
-				*(colorPtr + 1) = static_cast<cl_float>(color.getY());
-				*(colorPtr + 2) = static_cast<cl_float>(color.getZ());
+	cl_char *bufPtr = reinterpret_cast<cl_char*>(this->uniformData.data()) +
+		UNIFORM_GAME_TIME_OFFSET;
 
-				// Transparency depends on whether the pixel is black.
-				*(colorPtr + 3) = static_cast<cl_float>(pixels[index] == 0 ? 0.0f : 1.0f);
-			}
-		}
+	auto *slotPtr = reinterpret_cast<cl_int*>(bufPtr + sizeof(cl_float));
+	*(slotPtr + 0) = static_cast<cl_int>(getPaletteSlot(nightPalette));
+	*(slotPtr + 1) = static_cast<cl_int>(getPaletteSlot(dayPalette));
+
+	// It's sent to device memory at the start of the next frame.
+	this->uniformsDirty = true;
+	this->shadingDirty = true;
+}
+
+void CLProgram::resize(int width, int height, Renderer &renderer)
+{
+	this->resizeScreen(width, height, &renderer);
+}
+
+void CLProgram::resize(int width, int height)
+{
+	this->resizeScreen(width, height, nullptr);
+}
+
+void CLProgram::resizeScreen(int width, int height, Renderer *renderer)
+{
+	assert(width > 0);
+	assert(height > 0);
+
+	if ((width == this->width) && (height == this->height))
+	{
+		return;
 	}
 
-	// Zero out all the voxel references to start.
-	for (int k = 0; k < this->worldDepth; ++k)
+	// Give back any mapped output buffers and let the device finish with the old
+	// screen buffers before they're replaced.
+	for (int i = 0; i < static_cast<int>(this->mapPending.size()); ++i)
 	{
-		for (int j = 0; j < this->worldHeight; ++j)
+		if (this->mapPending.at(i))
 		{
-			for (int i = 0; i < this->worldWidth; ++i)
-			{
-				writeVoxelRef(i, j, k, 0);
-			}
+			this->unmapOutput(i);
 		}
 	}
 
-	// Use the same seed so it's not a new city on every screen resize.
-	Random random(2);
+	this->finishBands();
 
-	// Make the ground.
-	for (int k = 0; k < this->worldDepth; ++k)
+	if (this->texture != nullptr)
 	{
-		for (int i = 0; i < this->worldWidth; ++i)
-		{
-			std::vector<Triangle> block = makeBlock(i, 0, k);
-			int triangleCount = static_cast<int>(block.size());
+		SDL_DestroyTexture(this->texture);
+	}
 
-			int textureIndex = 1 + random.next(3);
-			for (int index = 0; index < triangleCount; ++index)
-			{
-				writeTriangle(block.at(index), i, 0, k, index, textureIndex);
-			}
+	this->width = width;
+	this->height = height;
+	this->frameIndex = 0;
 
-			writeVoxelRef(i, 0, k, 12);
-		}
-	}
+	this->createScreenBuffers(renderer);
+	this->shownDimensions = std::make_pair(this->renderWidth, this->renderHeight);
+}
 
-	// Make the near X and far X walls.
-	for (int j = 1; j < this->worldHeight; ++j)
+void CLProgram::setVoxel(int x, int y, int z, VoxelType voxelType, int textureIndex)
+{
+	const int voxelIndex = this->getVoxelIndex(x, y, z);
+
+	// Give back any triangles the voxel had to itself.
+	auto runIter = this->voxelTriangleRuns.find(voxelIndex);
+	if (runIter != this->voxelTriangleRuns.end())
 	{
-		for (int k = 0; k < this->worldDepth; ++k)
-		{
-			std::vector<Triangle> block = makeBlock(0, j, k);
-			int triangleCount = static_cast<int>(block.size());
+		this->freeTriangles(runIter->second);
+		this->voxelTriangleRuns.erase(runIter);
+	}
 
-			for (int index = 0; index < triangleCount; ++index)
-			{
-				writeTriangle(block.at(index), 0, j, k, index, 0);
-			}
+	VoxelReference voxelRef = (voxelType == VoxelType::Air) ? VoxelReference(0, 0) :
+		this->getVoxelTemplate(voxelType, textureIndex);
+	this->setVoxelReference(voxelIndex, voxelRef);
+	this->lightGrid.markVoxelChanged(x, y, z);
+}
 
-			block = makeBlock(this->worldWidth - 1, j, k);
-			for (int index = 0; index < triangleCount; ++index)
-			{
-				writeTriangle(block.at(index), this->worldWidth - 1, j, k, index, 0);
-			}
+void CLProgram::setVoxelTriangles(int x, int y, int z,
+	const std::vector<Triangle> &triangles, int textureIndex)
+{
+	const int voxelIndex = this->getVoxelIndex(x, y, z);
+	const int count = static_cast<int>(triangles.size());
+	int offset = 0;
+
+	// Reuse the voxel's own triangles if there's room. Otherwise, get a new run. A
+	// voxel with no triangles gives its run back.
+	auto runIter = this->voxelTriangleRuns.find(voxelIndex);
+	if ((runIter != this->voxelTriangleRuns.end()) && (count > 0) &&
+		(runIter->second.getTriangleCount() >= count))
+	{
+		offset = runIter->second.getOffset();
+	}
+	else
+	{
+		if (runIter != this->voxelTriangleRuns.end())
+		{
+			this->freeTriangles(runIter->second);
+			this->voxelTriangleRuns.erase(runIter);
+		}
 
-			writeVoxelRef(0, j, k, 12);
-			writeVoxelRef(this->worldWidth - 1, j, k, 12);
+		if (count > 0)
+		{
+			offset = this->allocateTriangles(count);
+			this->voxelTriangleRuns.insert(std::make_pair(
+				voxelIndex, VoxelReference(offset, count)));
 		}
 	}
 
-	// Make the near Z and far Z walls (ignoring existing corners).
-	for (int j = 1; j < this->worldHeight; ++j)
+	if (count > 0)
 	{
-		for (int i = 1; i < (this->worldWidth - 1); ++i)
+		this->writeTriangles(triangles, textureIndex, offset);
+	}
+
+	this->setVoxelReference(voxelIndex, VoxelReference(offset, count));
+	this->lightGrid.markVoxelChanged(x, y, z);
+}
+
+void CLProgram::markVoxelDirty(int x, int y, int z)
+{
+	const int voxelIndex = this->getVoxelIndex(x, y, z);
+	this->dirtyVoxelRefs.push_back(std::make_pair(voxelIndex, voxelIndex + 1));
+}
+
+void CLProgram::markChunkDirty(int x, int y, int z, int width, int height, int depth)
+{
+	assert(width > 0);
+	assert(height > 0);
+	assert(depth > 0);
+	assert((x + width) <= this->worldWidth);
+	assert((y + height) <= this->worldHeight);
+	assert((z + depth) <= this->worldDepth);
+
+	// Each row of voxels along X is contiguous in memory.
+	for (int k = z; k < (z + depth); ++k)
+	{
+		for (int j = y; j < (y + height); ++j)
 		{
-			std::vector<Triangle> block = makeBlock(i, j, 0);
-			int triangleCount = static_cast<int>(block.size());
+			const int voxelIndex = this->getVoxelIndex(x, j, k);
+			this->dirtyVoxelRefs.push_back(std::make_pair(voxelIndex, voxelIndex + width));
+		}
+	}
+}
 
-			for (int index = 0; index < triangleCount; ++index)
-			{
-				writeTriangle(block.at(index), i, j, 0, index, 0);
-			}
+void CLProgram::uploadDirtyRegions()
+{
+	std::vector<std::pair<int, int>> dirtySpriteRefs = this->spriteGrid.popDirtyRefs();
+	std::vector<std::pair<int, int>> dirtySpriteIndices = this->spriteGrid.popDirtyIndices();
 
-			block = makeBlock(i, j, this->worldDepth - 1);
-			for (int index = 0; index < triangleCount; ++index)
+	// A voxel that gains or loses all of its sprites changes the occupancy bricks, so 
+	// the kernels don't step over sprites in otherwise empty bricks.
+	const std::vector<int> &spriteRefs = this->spriteGrid.getSpriteRefs();
+	for (const auto &range : dirtySpriteRefs)
+	{
+		for (int i = range.first; i < range.second; ++i)
+		{
+			const bool hasSprites = spriteRefs.at((i * 2) + 1) > 0;
+			if (hasSprites != this->spriteVoxels.at(i))
 			{
-				writeTriangle(block.at(index), i, j, this->worldDepth - 1, index, 0);
+				this->finishUploads();
+				this->updateOccupancy(i, hasSprites ? 1 : -1);
+				this->spriteVoxels.at(i) = hasSprites;
 			}
-
-			writeVoxelRef(i, j, 0, 12);
-			writeVoxelRef(i, j, this->worldDepth - 1, 12);
 		}
 	}
 
-	// Add some random blocks around.
-	for (int count = 0; count < 32; ++count)
+	// Any world change means the next frame has to be traced again.
+	if ((this->dirtyVoxelRefs.size() > 0) || (this->dirtyTriangles.size() > 0) ||
+		(this->dirtyOccupancy.size() > 0) || (dirtySpriteRefs.size() > 0))
 	{
-		int x = 1 + random.next(this->worldWidth - 2);
-		int y = 1;
-		int z = 1 + random.next(this->worldDepth - 2);
+		this->worldChanged = true;
+	}
 
-		std::vector<Triangle> block = makeBlock(x, y, z);
-		int triangleCount = static_cast<int>(block.size());
+	// Lambda for writing the dirty ranges of a host buffer to its device buffer. The
+	// writes don't block, so the host buffers are left alone until they're done.
+	auto uploadRanges = [this](std::vector<std::pair<int, int>> &ranges,
+		const char *data, const cl::Buffer &buffer,
+		cl::size_type elementSize, const std::string &bufferName)
+	{
+		if (ranges.size() == 0)
+		{
+			return;
+		}
 
-		for (int index = 0; index < triangleCount; ++index)
+		const int maxGap = static_cast<int>(DIRTY_RANGE_GAP_BYTES / elementSize);
+		for (const auto &range : coalesceRanges(ranges, maxGap))
 		{
-			writeTriangle(block.at(index), x, y, z, index, 4);
+			const cl::size_type offset = elementSize * range.first;
+			const cl::size_type size = elementSize * (range.second - range.first);
+
+			cl::Event event;
+			cl_int status = this->commandQueue.enqueueWriteBuffer(buffer, CL_FALSE,
+				offset, size, static_cast<const void*>(data + offset),
+				nullptr, &event);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::enqueueWriteBuffer uploadDirtyRegions " + bufferName);
+
+			this->uploadEvents.push_back(event);
 		}
 
-		writeVoxelRef(x, y, z, 12);
+		ranges.clear();
+	};
+
+	uploadRanges(this->dirtyVoxelRefs, this->voxelRefData.data(), this->voxelRefBuffer,
+		SIZEOF_VOXEL_REF, "voxelRefBuffer");
+
+	// Every triangle stream has the same dirty triangles.
+	for (size_t i = 0; i < TrianglePacker::STREAMS.size(); ++i)
+	{
+		const TriangleStream stream = TrianglePacker::STREAMS.at(i);
+		std::vector<std::pair<int, int>> ranges = this->dirtyTriangles;
+		uploadRanges(ranges, this->trianglePacker.getData(stream).data(),
+			this->triangleBuffers.at(i), TrianglePacker::getStride(stream),
+			"triangleBuffers");
 	}
 
-	// Write the triangle buffer to device memory.
-	cl_int status = this->commandQueue.enqueueWriteBuffer(this->triangleBuffer,
-		CL_TRUE, 0, triangleBufferSize, static_cast<const void*>(triPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer test triangleBuffer");
+	this->dirtyTriangles.clear();
+
+	uploadRanges(this->dirtyOccupancy, this->occupancyData.data(), this->occupancyBuffer,
+		sizeof(cl_ushort), "occupancyBuffer");
+	uploadRanges(dirtySpriteRefs,
+		reinterpret_cast<const char*>(this->spriteGrid.getSpriteRefs().data()),
+		this->spriteRefBuffer, SIZEOF_SPRITE_REF, "spriteRefBuffer");
+	uploadRanges(dirtySpriteIndices,
+		reinterpret_cast<const char*>(this->spriteGrid.getSpriteIndices().data()),
+		this->spriteIndexBuffer, sizeof(cl_int), "spriteIndexBuffer");
+}
+
+int CLProgram::addLight(const Float3d &point, const Float3d &color, double radius)
+{
+	return this->lightGrid.addLight(point, color, radius);
+}
+
+void CLProgram::setLight(int id, const Float3d &point, const Float3d &color,
+	double radius)
+{
+	this->lightGrid.setLight(id, point, color, radius);
+}
+
+void CLProgram::removeLight(int id)
+{
+	this->lightGrid.removeLight(id);
+}
 
-	// Write the voxel reference buffer to device memory.
-	status = this->commandQueue.enqueueWriteBuffer(this->voxelRefBuffer,
-		CL_TRUE, 0, voxelRefBufferSize, static_cast<const void*>(voxPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer test voxelRefBuffer");
+void CLProgram::setSprite(int id, const Float3d &position, double width, double height,
+	int textureIndex)
+{
+	this->spriteGrid.setSprite(id, position, width, height, textureIndex);
+}
 
-	// Write the texture buffer to device memory.
-	status = this->commandQueue.enqueueWriteBuffer(this->textureBuffer,
-		CL_TRUE, 0, textureBufferSize, static_cast<const void*>(texPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer test textureBuffer");
+void CLProgram::removeSprite(int id)
+{
+	this->spriteGrid.removeSprite(id);
 }
 
 void CLProgram::updateCamera(const Float3d &eye, const Float3d &direction, double fovY)
@@ -884,11 +2755,19 @@ void CLProgram::updateCamera(const Float3d &eye, const Float3d &direction, doubl
 	// Do not scale the direction beforehand.
 	assert(direction.isNormalized());
 
-	std::vector<char> buffer(SIZEOF_CAMERA);
+	this->spriteGrid.setFacing(direction);
+
+	// The uniform block might still be in use by last frame's write.
+	this->finishUniformWrites();
 
-	cl_char *bufPtr = reinterpret_cast<cl_char*>(buffer.data());
+	cl_char *bufPtr = reinterpret_cast<cl_char*>(this->uniformData.data()) +
+		UNIFORM_CAMERA_OFFSET;
 
-	// Write the components of the camera to the local buffer.
+	// Keep the old camera to see whether it moved.
+	std::array<cl_char, SIZEOF_CAMERA> oldCamera;
+	std::copy(bufPtr, bufPtr + SIZEOF_CAMERA, oldCamera.begin());
+
+	// Write the components of the camera to the uniform block.
 	// Correct spacing is very important.
 	auto *eyePtr = reinterpret_cast<cl_float*>(bufPtr);
 	*(eyePtr + 0) = static_cast<cl_float>(eye.getX());
@@ -917,59 +2796,499 @@ void CLProgram::updateCamera(const Float3d &eye, const Float3d &direction, doubl
 	auto *zoomPtr = reinterpret_cast<cl_float*>(bufPtr + (sizeof(cl_float3) * 4));
 	*zoomPtr = static_cast<cl_float>(zoom);
 
-	// Write the buffer to device memory.
-	cl_int status = this->commandQueue.enqueueWriteBuffer(this->cameraBuffer,
-		CL_TRUE, 0, buffer.size(), static_cast<const void*>(bufPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer updateCamera");
+	// It's sent to device memory at the start of the next frame, if it changed.
+	if (!std::equal(oldCamera.begin(), oldCamera.end(), bufPtr))
+	{
+		this->cameraMoved = true;
+		this->uniformsDirty = true;
+	}
 }
 
 void CLProgram::updateGameTime(double gameTime)
 {
 	assert(gameTime >= 0.0);
 
-	std::vector<char> buffer(sizeof(cl_float));
+	// The uniform block might still be in use by last frame's write.
+	this->finishUniformWrites();
 
-	cl_char *bufPtr = reinterpret_cast<cl_char*>(buffer.data());
+	cl_char *bufPtr = reinterpret_cast<cl_char*>(this->uniformData.data()) +
+		UNIFORM_GAME_TIME_OFFSET;
 
 	auto *timePtr = reinterpret_cast<cl_float*>(bufPtr);
 	*timePtr = static_cast<cl_float>(gameTime);
 
-	// Write the buffer to device memory.
-	cl_int status = this->commandQueue.enqueueWriteBuffer(this->gameTimeBuffer,
-		CL_TRUE, 0, buffer.size(), static_cast<const void*>(bufPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer updateGameTime");
+	// Blend from the night palette at midnight to the day palette at noon.
+	const double dayPercent = std::fmod(gameTime, DAY_LENGTH) / DAY_LENGTH;
+	const double daylight = 0.5 - (0.5 * std::cos(dayPercent * 2.0 * PI));
+	auto *blendPtr = reinterpret_cast<cl_float*>(bufPtr + sizeof(cl_float) +
+		(sizeof(cl_int) * 2));
+	*blendPtr = static_cast<cl_float>(daylight);
+
+	this->gameTime = gameTime;
+	this->daylight = daylight;
+
+	// It's sent to device memory at the start of the next frame that's shaded.
+	this->uniformsDirty = true;
+}
+
+const RenderProfiler *CLProgram::getProfiler() const
+{
+	return this->profiler.get();
 }
 
 void CLProgram::render(Renderer &renderer)
 {
-	cl::NDRange workDims(this->width, this->height);
+	this->renderFrame(&renderer);
+}
 
-	// Run the intersect kernel.
-	cl_int status = this->commandQueue.enqueueNDRangeKernel(this->intersectKernel,
-		cl::NullRange, workDims, cl::NullRange, nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::CommandQueue::enqueueNDRangeKernel intersectKernel.");
+void CLProgram::render()
+{
+	this->renderFrame(nullptr);
+}
 
-	// Run the ray tracing kernel using the results from the intersect kernel.
-	status = this->commandQueue.enqueueNDRangeKernel(this->rayTraceKernel,
-		cl::NullRange, workDims, cl::NullRange, nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::CommandQueue::enqueueNDRangeKernel rayTraceKernel.");
+void CLProgram::renderFrame(Renderer *renderer)
+{
+	assert((renderer == nullptr) == this->headless);
+
+	// Send any world, sprite, and light changes since the last frame to the device.
+	this->updateSprites();
+	this->uploadDirtyRegions();
+	this->uploadLights();
+	this->clearStaleVisibility();
+
+	// Even out the split-frame bands and pick the resolution using the last frame's
+	// times.
+	this->balanceBands();
+	this->updateResolutionScale();
+
+	// While tile sizes are being tuned, each frame's kernels are timed on their own.
+	const bool isTuning = this->tileCandidates.size() > 0;
+
+	// With frame reuse, decide how much of this frame actually needs rendering. The 
+	// fused kernel can't shade without tracing, so it traces whenever it shades.
+	const bool shadeNeeded = this->shadingDirty ||
+		(std::abs(this->daylight - this->shadedDaylight) >= RESHADE_DAYLIGHT_STEP) ||
+		(std::abs(this->gameTime - this->shadedGameTime) >= RESHADE_INTERVAL);
+	const bool canReuse = this->frameReuse && this->historyValid && !isTuning &&
+		!this->worldChanged;
+	const bool isTraced = !canReuse || this->cameraMoved || (this->fused && shadeNeeded);
+	const bool isShaded = isTraced || shadeNeeded;
+
+	// Each frame in flight writes to its own output buffer.
+	const int framesInFlight = static_cast<int>(this->outputBuffers.size());
+
+	// If nothing changed, keep showing what's already there (and any frames still in
+	// flight).
+	if (!isShaded)
+	{
+		const int newestFrame = (this->frameIndex - 1 + framesInFlight) % framesInFlight;
+		this->showNewestFrame(newestFrame, renderer);
+		return;
+	}
 
-	// Run the RGB conversion kernel using the results from ray tracing.
-	status = this->commandQueue.enqueueNDRangeKernel(this->convertToRGBKernel,
-		cl::NullRange, workDims, cl::NullRange, nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::CommandQueue::enqueueNDRangeKernel convertToRGBKernel.");
+	// Send the camera and game time to the device.
+	this->uploadUniforms();
+
+	// Launch the render kernels in tiles, padding the global size to whole tiles. The 
+	// kernels ignore work-items outside the traced dimensions they're given.
+	const bool isTiled = this->tileSize.first > 0;
+	const cl::size_type workWidth = isTiled ?
+		padToTile(this->renderWidth, this->tileSize.first) : this->renderWidth;
+	const int workHeight = isTiled ?
+		static_cast<int>(padToTile(this->renderHeight, this->tileSize.second)) :
+		this->renderHeight;
+	const cl::NDRange localDims = isTiled ?
+		cl::NDRange(this->tileSize.first, this->tileSize.second) : cl::NullRange;
 
-	// Copy the output buffer into the destination pixel buffer.
-	void *outputDataPtr = static_cast<void*>(this->outputData.data());
-	status = this->commandQueue.enqueueReadBuffer(this->outputBuffer, CL_TRUE, 0,
-		static_cast<cl::size_type>(sizeof(cl_int) * this->width * this->height),
-		outputDataPtr, nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::enqueueReadBuffer.");
+	cl_int status = CL_SUCCESS;
+	auto tuningStart = std::chrono::high_resolution_clock::now();
+	if (isTuning)
+	{
+		this->finishBands();
+		tuningStart = std::chrono::high_resolution_clock::now();
+	}
+
+	const int currentFrame = this->frameIndex;
+
+	if (this->fused)
+	{
+		status = this->fusedRenderKernel.setArg(8, this->outputBuffers.at(currentFrame));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedRenderKernel outputBuffer.");
+	}
+	else
+	{
+		status = this->convertToRGBKernel.setArg(1, this->outputBuffers.at(currentFrame));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg convertToRGBKernel outputBuffer.");
+	}
+
+	const bool isProfiling = this->profiler.get() != nullptr;
+
+	// The bands on other command queues wait for this frame's uploads, which are on 
+	// the main command queue.
+	const int bandCount = static_cast<int>(this->bandQueues.size());
+	std::vector<cl::Event> uploadMarker;
+	if (bandCount > 1)
+	{
+		uploadMarker.push_back(cl::Event());
+		status = this->commandQueue.enqueueMarkerWithWaitList(nullptr, &uploadMarker.back());
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueMarkerWithWaitList.");
+	}
+
+	// Run the render kernels (intersection, ray tracing, and RGB conversion, or the 
+	// fused kernel) for each band. The global offset puts each band's work-items on its
+	// own rows, in whole tiles. The last band takes whatever rows are left. A frame that
+	// is only shaded again skips intersection (and ambient occlusion, which only
+	// depends on the hits).
+	auto renderKernels = this->getRenderKernels();
+	std::vector<std::string> renderKernelNames = this->fused ?
+		std::vector<std::string> { CLProgram::FUSED_RENDER_KERNEL } :
+		std::vector<std::string> { this->packetTraversal ?
+			CLProgram::INTERSECT_PACKET_KERNEL : CLProgram::INTERSECT_KERNEL,
+			CLProgram::RAY_TRACE_KERNEL, CLProgram::CONVERT_TO_RGB_KERNEL };
+	renderKernelNames.resize(renderKernels.size());
+	if (!isTraced)
+	{
+		renderKernels.erase(renderKernels.begin());
+		renderKernelNames.erase(renderKernelNames.begin());
+	}
+
+	const bool isOcclusionTraced = isTraced && (this->occlusionSamples > 0);
+
+	// Bands start on an even row with half resolution ambient occlusion, so no 2x2
+	// sample is split between bands.
+	int rowStep = isTiled ? this->tileSize.second : 1;
+	if ((rowStep % this->occlusionScale) != 0)
+	{
+		rowStep *= this->occlusionScale;
+	}
+
+	const int rowSteps = workHeight / rowStep;
+	std::vector<cl::Event> bandEvents;
+	double bandShareSum = 0.0;
+	int bandStart = 0;
+	for (int i = 0; i < bandCount; ++i)
+	{
+		bandShareSum += this->bandShares.at(i);
+		const int bandEnd = (i == (bandCount - 1)) ? workHeight : std::min(workHeight,
+			static_cast<int>(std::round(bandShareSum * rowSteps)) * rowStep);
+		const int rows = std::max(bandEnd - bandStart, 0);
+		this->bandRows.at(i) = rows;
+		if (rows == 0)
+		{
+			continue;
+		}
+
+		const cl::CommandQueue &queue = this->bandQueues.at(i);
+		const cl::NDRange offset(0, bandStart);
+		const cl::NDRange workDims(workWidth, rows);
+		cl::Event event;
+		for (int k = 0; k < static_cast<int>(renderKernels.size()); ++k)
+		{
+			const std::vector<cl::Event> *waitList = 
+				((i > 0) && (k == 0)) ? &uploadMarker : nullptr;
+			status = queue.enqueueNDRangeKernel(*renderKernels.at(k), offset, workDims,
+				localDims, waitList, &event);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::CommandQueue::enqueueNDRangeKernel (band " + std::to_string(i) + ").");
+
+			if (k == 0)
+			{
+				this->bandStartEvents.at(i) = event;
+			}
+
+			if (isProfiling)
+			{
+				this->profileEvents.at(currentFrame).push_back(
+					std::make_pair(renderKernelNames.at(k), event));
+			}
+
+			// Ambient occlusion follows intersection, on its own grid instead of tiles.
+			if (isOcclusionTraced && (k == 0))
+			{
+				const int scale = this->occlusionScale;
+				status = queue.enqueueNDRangeKernel(this->ambientOcclusionKernel,
+					cl::NDRange(0, bandStart / scale),
+					cl::NDRange((workWidth + scale - 1) / scale, (rows + scale - 1) / scale),
+					cl::NullRange, nullptr, &event);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::CommandQueue::enqueueNDRangeKernel ambientOcclusionKernel (band " +
+					std::to_string(i) + ").");
+
+				if (isProfiling)
+				{
+					this->profileEvents.at(currentFrame).push_back(
+						std::make_pair(CLProgram::AMBIENT_OCCLUSION_KERNEL, event));
+				}
+			}
+		}
+
+		this->bandEndEvents.at(i) = event;
+		bandEvents.push_back(event);
+		bandStart += rows;
+	}
+
+	if (isTuning)
+	{
+		this->finishBands();
+
+		const std::chrono::duration<double> tuningTime =
+			std::chrono::high_resolution_clock::now() - tuningStart;
+		this->updateTileTuning(tuningTime.count());
+	}
+
+	// Anti-aliasing and post-processing read pixels across band boundaries, so they and
+	// the RGB conversion wait for every band and run on the whole traced frame. Tiles 
+	// don't matter to them, so they're left out of tuning.
+	if (this->hasScreenPasses())
+	{
+		std::vector<std::pair<cl::Kernel*, std::string>> screenPasses;
+		if (this->antiAliasing)
+		{
+			screenPasses.push_back(std::make_pair(
+				&this->antiAliasKernel, CLProgram::ANTI_ALIAS_KERNEL));
+		}
+
+		if (this->postProcessing)
+		{
+			screenPasses.push_back(std::make_pair(
+				&this->postProcessKernel, CLProgram::POST_PROCESS_KERNEL));
+		}
+
+		screenPasses.push_back(std::make_pair(
+			&this->convertToRGBKernel, CLProgram::CONVERT_TO_RGB_KERNEL));
+
+		const cl::NDRange screenDims(this->renderWidth, this->renderHeight);
+		for (int k = 0; k < static_cast<int>(screenPasses.size()); ++k)
+		{
+			cl::Event event;
+			status = this->commandQueue.enqueueNDRangeKernel(*screenPasses.at(k).first,
+				cl::NullRange, screenDims, cl::NullRange,
+				(k == 0) ? &bandEvents : nullptr, &event);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::CommandQueue::enqueueNDRangeKernel " + screenPasses.at(k).second + ".");
+
+			if (k == 0)
+			{
+				this->screenStartEvent = event;
+			}
+
+			if (isProfiling)
+			{
+				this->profileEvents.at(currentFrame).push_back(
+					std::make_pair(screenPasses.at(k).second, event));
+			}
+
+			this->screenEndEvent = event;
+		}
+
+		// The output buffer is ready once the last pass is.
+		bandEvents = std::vector<cl::Event> { this->screenEndEvent };
+	}
+
+	// Map the output buffer so the host can read it once every band is done. With only
+	// one frame in flight, wait for it here like before. Otherwise, let it finish in 
+	// the background. Since the main command queue is in order, anything sent to it 
+	// after this also waits for the bands.
+	const cl_bool blocking = (framesInFlight == 1) ? CL_TRUE : CL_FALSE;
+	this->mappedOutputs.at(currentFrame) = this->commandQueue.enqueueMapBuffer(
+		this->outputBuffers.at(currentFrame), blocking, CL_MAP_READ, 0,
+		static_cast<cl::size_type>(sizeof(cl_int) * this->renderWidth * this->renderHeight),
+		&bandEvents, &this->mapEvents.at(currentFrame), &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::enqueueMapBuffer.");
+
+	if (isProfiling)
+	{
+		this->profileEvents.at(currentFrame).push_back(std::make_pair(
+			PROFILE_READ_BACK_STAGE, this->mapEvents.at(currentFrame)));
+	}
+
+	this->mapPending.at(currentFrame) = true;
+	this->frameDimensions.at(currentFrame) = std::make_pair(
+		this->renderWidth, this->renderHeight);
+	this->frameIndex = (currentFrame + 1) % framesInFlight;
 
-	// Update the frame buffer texture and draw to the renderer.
-	SDL_UpdateTexture(this->texture, nullptr, outputDataPtr, this->width * sizeof(cl_int));
-	renderer.drawToNative(this->texture);
+	// Start the devices on this frame's work while the host goes on.
+	for (const auto &queue : this->bandQueues)
+	{
+		status = queue.flush();
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::flush.");
+	}
+
+	// Remember what this frame was rendered with, so the next frames can tell what
+	// changed. Only traced frames say how long tracing takes.
+	if (isTraced)
+	{
+		this->historyValid = true;
+		this->cameraMoved = false;
+		this->worldChanged = false;
+	}
+
+	this->timingPending = isTraced;
+	this->shadingDirty = false;
+	this->shadedGameTime = this->gameTime;
+	this->shadedDaylight = this->daylight;
+
+	this->showNewestFrame(currentFrame, renderer);
+}
+
+void CLProgram::showNewestFrame(int newestFrame, Renderer *renderer)
+{
+	const int framesInFlight = static_cast<int>(this->outputBuffers.size());
+	const bool isProfiling = this->profiler.get() != nullptr;
+
+	// Find the newest frame that has finished, starting with the given one. The oldest
+	// frame's buffer is needed again next frame, so if nothing newer is done, wait for
+	// that one.
+	int shownFrame = -1;
+	for (int i = 0; i < framesInFlight; ++i)
+	{
+		const int frame = (newestFrame - i + framesInFlight) % framesInFlight;
+		if (!this->mapPending.at(frame))
+		{
+			continue;
+		}
+
+		const cl::Event &mapEvent = this->mapEvents.at(frame);
+		const bool isOldest = (frame == this->frameIndex);
+		const bool isDone = mapEvent.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() ==
+			CL_COMPLETE;
+
+		if (isDone || isOldest)
+		{
+			const cl_int status = mapEvent.wait();
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::wait mapEvent.");
+			shownFrame = frame;
+			break;
+		}
+	}
+
+	if (shownFrame >= 0)
+	{
+		// Update the traced corner of the frame buffer texture straight from the mapped
+		// output buffer.
+		const auto &dimensions = this->frameDimensions.at(shownFrame);
+		SDL_Rect rect;
+		rect.x = 0;
+		rect.y = 0;
+		rect.w = dimensions.first;
+		rect.h = dimensions.second;
+
+		// Headless programs copy it into the host frame instead. Each row of the 
+		// output buffer is as wide as the traced width, so the frame is one copy.
+		const auto updateStart = std::chrono::high_resolution_clock::now();
+		if (this->headless)
+		{
+			const uint32_t *pixels = static_cast<const uint32_t*>(
+				this->mappedOutputs.at(shownFrame));
+			this->frameData.assign(pixels,
+				pixels + (dimensions.first * dimensions.second));
+		}
+		else
+		{
+			SDL_UpdateTexture(this->texture, &rect, this->mappedOutputs.at(shownFrame),
+				dimensions.first * sizeof(cl_int));
+		}
+
+		this->shownDimensions = dimensions;
+
+		if (isProfiling)
+		{
+			const std::chrono::duration<double, std::milli> updateTime =
+				std::chrono::high_resolution_clock::now() - updateStart;
+			this->profiler->addSample(PROFILE_TEXTURE_UPDATE_STAGE, updateTime.count());
+		}
+
+		// Give the shown output buffer back, along with any older ones that were 
+		// skipped (they're done too since the queue is in order).
+		int frame = shownFrame;
+		while (true)
+		{
+			if (this->mapPending.at(frame))
+			{
+				if (isProfiling)
+				{
+					this->recordProfile(frame);
+				}
+
+				this->unmapOutput(frame);
+			}
+
+			if (frame == this->frameIndex)
+			{
+				break;
+			}
+
+			frame = (frame - 1 + framesInFlight) % framesInFlight;
+		}
+	}
+
+	// Draw the newest finished frame to the renderer, stretched over the screen if it
+	// was traced at a lower resolution.
+	if (!this->headless)
+	{
+		SDL_Rect source;
+		source.x = 0;
+		source.y = 0;
+		source.w = this->shownDimensions.first;
+		source.h = this->shownDimensions.second;
+		renderer->drawToNative(this->texture, source, 0, 0, this->width, this->height);
+	}
+}
+
+void CLProgram::readFrame(std::vector<uint32_t> &pixels, int &width, int &height)
+{
+	assert(this->headless);
+
+	// Show the newest frame in flight, waiting for it if it's not done yet.
+	const int framesInFlight = static_cast<int>(this->outputBuffers.size());
+	const int newestFrame = (this->frameIndex - 1 + framesInFlight) % framesInFlight;
+	if (this->mapPending.at(newestFrame))
+	{
+		const cl_int status = this->mapEvents.at(newestFrame).wait();
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::wait mapEvent.");
+
+		this->showNewestFrame(newestFrame, nullptr);
+	}
+
+	// Before any frame is shown, there's nothing to read.
+	pixels = this->frameData;
+	width = pixels.size() > 0 ? this->shownDimensions.first : 0;
+	height = pixels.size() > 0 ? this->shownDimensions.second : 0;
+}
+
+bool CLProgram::saveFrame(const std::string &filename)
+{
+	std::vector<uint32_t> pixels;
+	int width, height;
+	this->readFrame(pixels, width, height);
+
+	if (pixels.size() == 0)
+	{
+		Debug::mention("CLProgram", "No frame to save to \"" + filename + "\".");
+		return false;
+	}
+
+	// Binary PPM is RGB bytes after a small text header. Alpha is dropped.
+	std::string image = "P6\n" + std::to_string(width) + " " +
+		std::to_string(height) + "\n255\n";
+	image.reserve(image.size() + (pixels.size() * 3));
+	for (const uint32_t pixel : pixels)
+	{
+		image.push_back(static_cast<char>((pixel >> 16) & 0xFF));
+		image.push_back(static_cast<char>((pixel >> 8) & 0xFF));
+		image.push_back(static_cast<char>(pixel & 0xFF));
+	}
+
+	if (!File::fromString(filename, image))
+	{
+		Debug::mention("CLProgram", "Could not save frame \"" + filename + "\".");
+		return false;
+	}
+
+	return true;
 }
+
+#endif /* HAVE_OPENCL */
@@ -1,6 +1,15 @@
 #ifndef CL_PROGRAM_H
 #define CL_PROGRAM_H
 
+// The OpenCL renderer is only built when OpenCL is available (HAVE_OPENCL).
+#ifdef HAVE_OPENCL
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #define CL_HPP_MINIMUM_OPENCL_VERSION 120
@@ -8,7 +17,13 @@
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #include <CL/cl2.hpp>
 
+#include "LightGrid.h"
+#include "SpriteGrid.h"
+#include "TextureReference.h"
+#include "TrianglePacker.h"
+#include "WorldRenderer.h"
 #include "../Math/Float3.h"
+#include "../World/VoxelReference.h"
 
 // The OpenCL object should be kept alive while the game data object is alive.
 // Otherwise, it would reload the kernel whenever the game world panel was
@@ -18,63 +33,434 @@
 // It is important to remember that cl_float3 and cl_float4 are structurally
 // equivalent.
 
+// Voxel triangles are stored once per voxel type (and texture) in voxel-local 
+// coordinates, and every voxel of that type points its voxel reference at them. 
+// The kernel moves the ray into the voxel's space (by subtracting the voxel's cell 
+// coordinates from the ray origin) before testing its triangles. This is signaled 
+// to the kernel with VOXEL_TRIANGLES_LOCAL.
+
+// Textures are stored as 8-bit palette indices, one after another in a single atlas
+// buffer, and colors are looked up in a separate palette buffer. Index 0 is 
+// transparent. The palette buffer holds every palette the world uses, and each frame
+// the kernel blends between a night and a day palette depending on the game time, so
+// neither palette swaps nor time of day touch the texels.
+
+// To skip empty space quickly, the kernel also gets a two-level occupancy hierarchy:
+// the number of non-empty voxels in each 4x4x4 brick, followed by the same for each
+// 16x16x16 brick. A ray can step over a whole brick when its count is zero. The
+// counts are kept up to date whenever a voxel changes between empty and non-empty.
+// Voxels with sprites are counted too (apart from their triangles), so a brick 
+// holding only sprites isn't skipped.
+
+// Triangles are stored as a structure of arrays, one buffer per triangle stream (see
+// TrianglePacker), with each triangle's edges worked out on the host. Intersection
+// tests only read the positions and edges, and the rest of a triangle is only read
+// once it's the closest hit (or a closer candidate needs its texture checked for
+// transparency).
+
+// Point lights are put in the cells of a light grid on the host whenever one changes,
+// and the kernels shade a hit only with the lights in its cell's list, so shading cost
+// depends on how many lights are nearby rather than how many are in the world.
+
+// With shadows on, each lit hit traces shadow rays to the lights that matter most, up
+// to a budget per pixel, with lights sorted by how much they'd add. How each voxel 
+// sees each light in its cell is cached on the device as counts of lit and blocked
+// rays (see LightGrid), and lights the cache is sure about or that are past the budget
+// use it instead of tracing. The host clears only the cache entries that a light or
+// voxel change made stale.
+
+// Camera-facing sprites are kept in a sprite grid on the host. Their triangles live in
+// a region of the triangle buffers, in world coordinates, and each voxel's sprite
+// reference points at the sprites in that voxel, so the kernels only test sprites in
+// the voxels a ray visits. Moving a sprite only writes its own triangles and the
+// references of the voxels it left and entered.
+
+// The program keeps host copies of the voxel reference and triangle buffers. World
+// changes are made to those copies and marked dirty, and once per frame the dirty
+// ranges are coalesced and written to the device, so something like a door opening
+// only costs a few bytes of transfer instead of a whole buffer.
+
+// Without a renderer, the program is headless: there's no frame buffer texture, and
+// finished frames are copied from the mapped output buffers into a host frame that
+// can be read as ARGB pixels or saved as an image (i.e., for regression tests and 
+// benchmarks on machines without a display).
+
+class Options;
+class RenderProfiler;
 class Renderer;
 class TextureManager;
+class Triangle;
+
+enum class PaletteName;
+enum class VoxelType;
 
 struct SDL_Texture;
 
-class CLProgram
+class CLProgram : public WorldRenderer
 {
 private:
 	static const std::string PATH;
 	static const std::string FILENAME;
 	static const std::string INTERSECT_KERNEL;
+	static const std::string INTERSECT_PACKET_KERNEL;
 	static const std::string AMBIENT_OCCLUSION_KERNEL;
 	static const std::string RAY_TRACE_KERNEL;
 	static const std::string ANTI_ALIAS_KERNEL;
 	static const std::string POST_PROCESS_KERNEL;
 	static const std::string CONVERT_TO_RGB_KERNEL;
+	static const std::string FUSED_RENDER_KERNEL;
 
 	cl::Device device; // The device selected from the devices list.
 	cl::Context context;
 	cl::CommandQueue commandQueue;
 	cl::Program program;
 	cl::Kernel intersectKernel, rayTraceKernel, convertToRGBKernel;
+
+	// The fused kernel does intersection, shading, and RGB conversion for a pixel in 
+	// one pass, so nothing between them goes through global memory. When it's used, the
+	// three multi-pass kernels and their screen buffers aren't created.
+	cl::Kernel fusedRenderKernel;
+	bool fused;
+
+	// With packet traversal, the intersect kernel is the packet variant. It has the
+	// same arguments, plus local memory where each 4x4 packet of rays in a work-group
+	// shares the voxel cells and triangles it visits. Tiles have to be whole packets, 
+	// and small enough for the caches to fit in the device's local memory.
+	bool packetTraversal;
+	cl::size_type packetLocalMemory; // Local memory the packet caches can use.
+
+	// Optional passes of the multi-pass kernels, each left out entirely when it's off.
+	// Ambient occlusion runs after intersection in each band, on its own grid so it
+	// can be traced for every 2x2 pixels. Anti-aliasing and post-processing read 
+	// neighboring pixels that may be in other bands, so when either is on, they and 
+	// the RGB conversion run on the whole frame once every band is done.
+	cl::Kernel ambientOcclusionKernel, antiAliasKernel, postProcessKernel;
+	cl::Buffer occlusionBuffer, filteredBuffer;
+	int occlusionSamples; // Ambient occlusion rays per sample. 0 for none.
+	int occlusionScale; // Pixels along each side of an ambient occlusion sample.
+	bool antiAliasing, postProcessing;
+	cl::Event screenStartEvent, screenEndEvent; // The whole-frame passes of the last frame.
 	cl::Buffer cameraBuffer, voxelRefBuffer, spriteRefBuffer, lightRefBuffer, 
-		triangleBuffer, lightBuffer, textureBuffer, gameTimeBuffer, depthBuffer, 
-		normalBuffer, viewBuffer, pointBuffer, uvBuffer, triangleIndexBuffer, 
-		colorBuffer, outputBuffer;
-	std::vector<char> outputData; // For receiving pixels from the device's output buffer.
-	SDL_Texture *texture; // Streaming render texture for outputData to update.
+		lightBuffer, lightIndexBuffer, spriteIndexBuffer, textureBuffer, gameTimeBuffer,
+		depthBuffer, normalBuffer, viewBuffer, pointBuffer, uvBuffer, triangleIndexBuffer, 
+		colorBuffer, occupancyBuffer, paletteBuffer;
+
+	// One output buffer per frame in flight. With more than one, a frame is read back
+	// while the next frame's kernels run, and the texture shows the newest frame that
+	// has finished. Output buffers live in host-accessible memory and are mapped 
+	// instead of copied, so on CPU devices there's no extra copy of each frame.
+	std::vector<cl::Buffer> outputBuffers;
+	std::vector<void*> mappedOutputs; // Host pointers to mapped output buffers.
+	std::vector<cl::Event> mapEvents; // Maps of each output buffer.
+	std::vector<bool> mapPending; // Whether each output buffer is mapped but not shown.
+	int frameIndex; // Output buffer for the next frame.
+	SDL_Texture *texture; // Streaming render texture for mapped outputs to update.
+	bool headless; // Whether there's no texture, only the host frame.
+	std::vector<uint32_t> frameData; // ARGB pixels of the newest shown frame, when headless.
 	TextureManager &textureManager;
 	int width, height, worldWidth, worldHeight, worldDepth;
+	std::vector<cl::Buffer> triangleBuffers; // One per triangle stream.
+	std::vector<char> voxelRefData; // Host copy of the device voxel reference buffer.
+	TrianglePacker trianglePacker; // Host copy of the device triangle buffers.
+	std::vector<cl::Event> uploadEvents; // Writes from the host copies still in flight.
+	std::vector<std::pair<int, int>> dirtyVoxelRefs, dirtyTriangles; // [begin, end) ranges.
+	std::vector<char> occupancyData; // Host copy of the occupancy brick counts.
+	std::vector<std::pair<int, int>> dirtyOccupancy; // [begin, end) ranges of bricks.
+	int occupancyLargeOffset; // Index of the first 16x16x16 brick in occupancyData.
+	std::vector<bool> spriteVoxels; // Voxels with sprites, as counted in the bricks.
+	std::map<std::pair<VoxelType, int>, VoxelReference> voxelTemplates; // Shared triangles.
+	std::unordered_map<int, VoxelReference> voxelTriangleRuns; // Voxels with own triangles.
+	std::vector<VoxelReference> freeTriangleRuns; // Reusable space in the triangle buffer.
+	int triangleCount, triangleCapacity; // Triangles used and allocated in triangleBuffers.
+	std::vector<TextureReference> textureRefs; // Where each texture is in textureBuffer.
+	LightGrid lightGrid; // Host copy of the device light buffers.
+	SpriteGrid spriteGrid; // Host copy of the device sprite buffers.
+	VoxelReference spriteTriangleRun; // Sprite triangle region in triangleBuffers.
+	int spriteIndexCapacity; // Sprite indices allocated in spriteIndexBuffer.
+	int lightCapacity, lightIndexCapacity; // Lights and cell light IDs allocated.
+	cl::Buffer visibilityBuffer; // Lit and blocked shadow ray counts of each voxel's lights.
+	int shadowRays; // Most shadow rays each hit may trace. 0 for no shadows.
+
+	// Per-frame parameters (camera, game time) are packed into one persistent host 
+	// block and written to the device without blocking at the start of each frame.
+	std::vector<char> uniformData;
+	cl::Event uniformEvent; // The last write from uniformData.
+	bool uniformsDirty, uniformWritePending;
+
+	// The render kernels are launched in tiles of this size, with the global size 
+	// padded to a multiple of it. The tile size is chosen by timing some candidates 
+	// during the first frames, and then remembered for the device in the tuning file.
+	std::vector<std::pair<int, int>> tileCandidates; // Tile sizes still being timed.
+	std::pair<int, int> tileSize, bestTileSize;
+	double bestTileTime; // Seconds per frame with the best tile size so far.
+	int tuningFrame; // Frames timed so far.
+	std::string deviceHash; // Identifies the device and driver in the tuning file.
+
+	// With split-frame rendering, the screen is cut into horizontal bands, and each band
+	// is launched on its own command queue (on its own device, if the context has more
+	// than one). The first band uses the main command queue. Each band's kernels are
+	// timed, and the band heights follow how fast each band rendered its rows.
+	std::vector<cl::CommandQueue> bandQueues; // The first is the main command queue.
+	std::vector<double> bandShares; // Fraction of the screen height for each band.
+	std::vector<int> bandRows; // Rows each band rendered in the last frame.
+	std::vector<cl::Event> bandStartEvents, bandEndEvents; // Each band's first and last kernels.
+
+	// With kernel profiling, each kernel launch and read back keeps its event, and once 
+	// a frame is shown, its events become stage times in the profiler. The profiler is
+	// null when kernel profiling is off.
+	std::unique_ptr<RenderProfiler> profiler;
+	std::vector<std::vector<std::pair<std::string, cl::Event>>> profileEvents; // Per frame.
+	std::string profileFilename; // Where to save stage times on exit, if anywhere.
+
+	// With resolution scaling, the kernels trace fewer pixels than the screen has when
+	// they take longer than the frame budget, and the traced corner of the frame buffer
+	// texture is stretched over the screen. The screen buffers always have room for the
+	// full resolution, so changing the scale only changes the kernels' dimensions.
+	bool resolutionScaling;
+	double resolutionScale, minResolutionScale; // Fraction of the width and height traced.
+	double frameBudget; // Milliseconds of kernel time per frame to aim for.
+	double smoothedFrameTime; // Kernel milliseconds of recent frames. Negative for none yet.
+	int renderWidth, renderHeight; // Pixels traced each frame.
+	std::vector<std::pair<int, int>> frameDimensions; // Traced size of each output buffer.
+	std::pair<int, int> shownDimensions; // Traced size of the frame in the texture.
+
+	// With frame reuse, a frame where nothing the kernels depend on has changed isn't
+	// rendered at all, and one where only the time of day or the palettes changed just
+	// runs the shading kernels on the last frame's intersections. Any camera movement
+	// traces the whole frame again.
+	bool frameReuse;
+	bool historyValid; // Whether the screen buffers match the current traced dimensions.
+	bool cameraMoved, worldChanged; // Changes since the last traced frame.
+	bool shadingDirty; // Whether the palettes changed since the last shaded frame.
+	bool timingPending; // Whether the band events are from a traced frame not yet timed.
+	double gameTime, daylight; // Values in the uniform block.
+	double shadedGameTime, shadedDaylight; // Values when the last frame was shaded.
+
+	// Gets the kernels launched in tiles in each band every frame, in order.
+	std::vector<cl::Kernel*> getRenderKernels();
+
+	// Returns whether any passes run on the whole frame after the bands.
+	bool hasScreenPasses() const;
+
+	// Reads the tile size for this device from the tuning file. If there isn't one,
+	// tile sizes that the kernels support are timed during the next frames.
+	void loadTileSize();
+
+	// Records how long a frame took with the current tile size candidate. Once every
+	// candidate has been timed, the fastest is kept and saved to the tuning file.
+	void updateTileTuning(double seconds);
+
+	// Sizes the packet intersect kernel's local memory caches for the tile size.
+	void setPacketCaches();
+
+	// Waits for the command queue of every band to finish its work.
+	void finishBands();
+
+	// Moves the band boundaries so each band should take about as long as the others,
+	// using the kernel times of the last frame once all of its bands are done.
+	void balanceBands();
+
+	// Constructor for either mode. Headless when the renderer is null.
+	CLProgram(int width, int height, int worldWidth, int worldHeight, int worldDepth,
+		const Options &options, TextureManager &textureManager, Renderer *renderer);
+
+	// Creates the buffers that depend on the screen dimensions (and the frame buffer
+	// texture unless headless), and points the kernels at them.
+	void createScreenBuffers(Renderer *renderer);
+
+	// Recreates the screen-sized buffers for new dimensions.
+	void resizeScreen(int width, int height, Renderer *renderer);
+
+	// Works out the traced dimensions from the screen dimensions and the resolution
+	// scale, and gives them to the kernels.
+	void setRenderDimensions();
+
+	// Moves the resolution scale toward what should fit in the frame budget, using the
+	// kernel times of the last frame once all of its bands are done.
+	void updateResolutionScale();
+
+	// Gives a mapped output buffer back to the device so a later frame can use it.
+	void unmapOutput(int frame);
+
+	// Updates the frame buffer texture (or the host frame when headless) with the 
+	// newest finished frame (starting from the given frame and going back), gives back
+	// its output buffer and any older ones, and draws the texture to the renderer.
+	void showNewestFrame(int newestFrame, Renderer *renderer);
+
+	// Sends a frame's work to the devices and shows the newest finished frame.
+	void renderFrame(Renderer *renderer);
+
+	// Adds the stage times of a finished frame to the profiler. Stages split into bands
+	// are summed.
+	void recordProfile(int frame);
+
+	// Tries to build the program from a binary cached by an earlier run. Returns 
+	// whether it succeeded.
+	bool loadProgramBinary(const std::string &filename, const std::string &buildOptions);
+
+	// Saves the built program's binary so later runs can skip compiling the source.
+	void saveProgramBinary(const std::string &filename) const;
 
 	std::string getBuildReport() const;
 	std::string getErrorString(cl_int error) const;
 
-	// For testing purposes before using actual world data.
-	void makeTestWorld();
+	// Points the kernels at the triangle buffers.
+	void setTriangleArgs();
+
+	// Points the kernels at the light and cell light buffers.
+	void setLightArgs();
+
+	// Points the kernels at the sprite indices and the sprite triangle region.
+	void setSpriteArgs();
+
+	// Moves and turns changed sprites, and writes their triangles to the sprite 
+	// triangle region (which grows as needed). Their references and indices are 
+	// written to the device along with the other dirty regions.
+	void updateSprites();
+
+	// Writes the light grid to the device if a light changed since the last frame. 
+	// The light buffers grow as needed.
+	void uploadLights();
+
+	// Gets the number of entries the visibility buffer has room for. Without shadows,
+	// it's a placeholder with one entry.
+	int getVisibilityCapacity() const;
+
+	// Clears the visibility entries that went stale since the last frame, after the
+	// light grid is updated.
+	void clearStaleVisibility();
+
+	// Makes sure the triangle buffers can hold at least the given number of triangles.
+	// If it needs to grow, existing triangles are copied into the new buffers and the
+	// kernels are pointed at them.
+	void reserveTriangles(int count);
+
+	// Waits for writes from the host world buffers to finish, so the host buffers 
+	// can be changed (or moved in memory) safely.
+	void finishUploads();
+
+	// Waits for the last write from the uniform block, so it can be changed safely.
+	void finishUniformWrites();
+
+	// Writes the uniform block to the camera and game time buffers if it changed.
+	void uploadUniforms();
+
+	// Gets a run of unused triangles in the triangle buffer, either from space that
+	// was freed earlier or from the end of the buffer. Returns the run's offset.
+	int allocateTriangles(int count);
+
+	// Gives a run of triangles back so it can be reused.
+	void freeTriangles(const VoxelReference &run);
+
+	// Writes every palette the world can use to the palette buffer.
+	void loadPalettes();
+
+	// Packs the palette indices of the given IMG files into the texture buffer. This
+	// must be done before any triangles are written, since triangles refer to their 
+	// texture's location.
+	virtual void loadTextures(const std::vector<std::string> &filenames) override;
+
+	// Writes triangles into the host triangle streams and marks them dirty.
+	void writeTriangles(const std::vector<Triangle> &triangles, int textureIndex,
+		int offset);
+
+	// Gets the index of a voxel in the 1D voxel reference array.
+	int getVoxelIndex(int x, int y, int z) const;
+
+	// Points a voxel at the given triangles and marks it dirty.
+	void setVoxelReference(int voxelIndex, const VoxelReference &voxelRef);
+
+	// Adds to the non-empty voxel counts of the bricks containing a voxel (a delta of
+	// 1 or -1), and marks them dirty.
+	void updateOccupancy(int voxelIndex, int delta);
+
+	// Gets a voxel reference to the shared triangles of a voxel type with the given
+	// texture. The triangles are added to the triangle buffer the first time they're 
+	// needed.
+	VoxelReference getVoxelTemplate(VoxelType voxelType, int textureIndex);
 public:
 	// Constructor for the OpenCL render program.
 	CLProgram(int width, int height, int worldWidth, int worldHeight, int worldDepth,
-		TextureManager &textureManager, Renderer &renderer);
-	~CLProgram();
+		const Options &options, TextureManager &textureManager, Renderer &renderer);
 
-	CLProgram &operator=(CLProgram &&clProgram);
+	// Constructor for a headless program, which only renders into its output buffers.
+	CLProgram(int width, int height, int worldWidth, int worldHeight, int worldDepth,
+		const Options &options, TextureManager &textureManager);
+	virtual ~CLProgram();
 
-	// These are public in case the options menu is going to need to list them.
-	// There should be a constructor that also takes a platform and device, then.
+	CLProgram &operator=(CLProgram &&clProgram) = delete;
+
+	// These are public in case the options menu is going to need to list them for the
+	// platform and device options.
 	static std::vector<cl::Platform> getPlatforms();
 	static std::vector<cl::Device> getDevices(const cl::Platform &platform,
 		cl_device_type type);
 
-	void updateCamera(const Float3d &eye, const Float3d &direction, double fovY);
+	// Returns whether the kernel source on disk has the interface this program uses.
+	// A kernel from an older data download can't be given the current arguments, so 
+	// the caller should use another renderer instead.
+	static bool hasCompatibleKernel();
+
+	virtual void setPalette(PaletteName paletteName) override;
+	virtual void setPalettes(PaletteName nightPalette, PaletteName dayPalette) override;
+
+	// Only the screen-sized buffers and the frame buffer texture are recreated. The
+	// program and the world stay as they are.
+	virtual void resize(int width, int height, Renderer &renderer) override;
+
+	// Headless version of resize().
+	void resize(int width, int height);
+
+	virtual void setVoxel(int x, int y, int z, VoxelType voxelType,
+		int textureIndex) override;
+	virtual void setVoxelTriangles(int x, int y, int z,
+		const std::vector<Triangle> &triangles, int textureIndex) override;
+
+	// Marks a voxel or a box of voxels (i.e., a chunk) as needing to be written to
+	// the device again.
+	void markVoxelDirty(int x, int y, int z);
+	void markChunkDirty(int x, int y, int z, int width, int height, int depth);
 
-	// Give this method total ticks instead of delta time so the constructor doesn't
-	// need a "start time". Also, this prevents any additive "double -> float" error.
-	void updateGameTime(double gameTime);	
+	// Writes all dirty voxel references, triangles, and sprite references to the 
+	// device. Nearby ranges are merged so there are only a few small writes. This is
+	// done once per frame by render(), but can be called sooner if necessary.
+	void uploadDirtyRegions();
 
-	void render(Renderer &renderer);
+	virtual int addLight(const Float3d &point, const Float3d &color,
+		double radius) override;
+	virtual void setLight(int id, const Float3d &point, const Float3d &color,
+		double radius) override;
+	virtual void removeLight(int id) override;
+
+	virtual void setSprite(int id, const Float3d &position, double width, double height,
+		int textureIndex) override;
+	virtual void removeSprite(int id) override;
+
+	// Sprites turn to face the camera here, too.
+	virtual void updateCamera(const Float3d &eye, const Float3d &direction,
+		double fovY) override;
+
+	// Total ticks also prevent any additive "double -> float" error.
+	virtual void updateGameTime(double gameTime) override;
+
+	// Gets the stage times of recent frames, or null if kernel profiling is off.
+	const RenderProfiler *getProfiler() const;
+
+	virtual void render(Renderer &renderer) override;
+
+	// Headless version of render(). Frames still stay in flight, so the newest shown
+	// frame may be a few frames old.
+	void render();
+
+	// Waits for every frame in flight, and gets the newest frame's ARGB pixels and 
+	// traced dimensions. Only for headless programs.
+	void readFrame(std::vector<uint32_t> &pixels, int &width, int &height);
+
+	// Waits for every frame in flight, and saves the newest frame as a binary PPM 
+	// image. Returns whether it succeeded. Only for headless programs.
+	bool saveFrame(const std::string &filename);
 };
 
+#endif /* HAVE_OPENCL */
+
 #endif
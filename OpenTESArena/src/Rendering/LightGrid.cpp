@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "LightGrid.h"
+
+const int LightGrid::CELL_SIZE = 4;
+const int LightGrid::LIGHT_FLOATS = 8;
+const int LightGrid::CELL_VOXELS = LightGrid::CELL_SIZE * LightGrid::CELL_SIZE *
+	LightGrid::CELL_SIZE;
+const int LightGrid::VISIBILITY_SAMPLES = 8;
+const int LightGrid::MAX_VISIBILITY_SAMPLES = 255;
+
+LightGrid::LightGrid(int worldWidth, int worldHeight, int worldDepth)
+{
+	assert(worldWidth > 0);
+	assert(worldHeight > 0);
+	assert(worldDepth > 0);
+
+	// Cells on the far edges may hang over the world.
+	this->cellsX = (worldWidth + LightGrid::CELL_SIZE - 1) / LightGrid::CELL_SIZE;
+	this->cellsY = (worldHeight + LightGrid::CELL_SIZE - 1) / LightGrid::CELL_SIZE;
+	this->cellsZ = (worldDepth + LightGrid::CELL_SIZE - 1) / LightGrid::CELL_SIZE;
+
+	// Every cell starts with no lights. The grid starts dirty so the empty cells are
+	// still written by the first update.
+	this->cellRefs = std::vector<int>(this->getCellCount() * 2, 0);
+	this->dirty = true;
+	this->visibilityReset = true;
+}
+
+LightGrid::~LightGrid()
+{
+
+}
+
+int LightGrid::getCellCount() const
+{
+	return this->cellsX * this->cellsY * this->cellsZ;
+}
+
+int LightGrid::getCellIndex(int x, int y, int z) const
+{
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(z >= 0);
+
+	const int cellX = x / LightGrid::CELL_SIZE;
+	const int cellY = y / LightGrid::CELL_SIZE;
+	const int cellZ = z / LightGrid::CELL_SIZE;
+	assert(cellX < this->cellsX);
+	assert(cellY < this->cellsY);
+	assert(cellZ < this->cellsZ);
+
+	return cellX + (cellY * this->cellsX) + (cellZ * this->cellsX * this->cellsY);
+}
+
+std::vector<int> LightGrid::getCells(const Float3d &point, double radius) const
+{
+	std::vector<int> cells;
+	if (radius <= 0.0)
+	{
+		return cells;
+	}
+
+	const double cellSize = static_cast<double>(LightGrid::CELL_SIZE);
+	const double center[3] = { point.getX(), point.getY(), point.getZ() };
+	const int cellDims[3] = { this->cellsX, this->cellsY, this->cellsZ };
+	int minCell[3], maxCell[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		minCell[axis] = std::max(static_cast<int>(
+			std::floor((center[axis] - radius) / cellSize)), 0);
+		maxCell[axis] = std::min(static_cast<int>(
+			std::floor((center[axis] + radius) / cellSize)), cellDims[axis] - 1);
+	}
+
+	for (int k = minCell[2]; k <= maxCell[2]; ++k)
+	{
+		for (int j = minCell[1]; j <= maxCell[1]; ++j)
+		{
+			for (int i = minCell[0]; i <= maxCell[0]; ++i)
+			{
+				// Distance from the light to the nearest point in the cell.
+				const int cell[3] = { i, j, k };
+				double distanceSquared = 0.0;
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					const double low = cell[axis] * cellSize;
+					const double nearest = std::min(std::max(center[axis], low),
+						low + cellSize);
+					const double delta = center[axis] - nearest;
+					distanceSquared += delta * delta;
+				}
+
+				if (distanceSquared <= (radius * radius))
+				{
+					cells.push_back(i + (j * this->cellsX) +
+						(k * this->cellsX * this->cellsY));
+				}
+			}
+		}
+	}
+
+	return cells;
+}
+
+int LightGrid::getVisibilityIndex(int cellLight, int x, int y, int z) const
+{
+	const int cellVoxel = (x % LightGrid::CELL_SIZE) +
+		((y % LightGrid::CELL_SIZE) * LightGrid::CELL_SIZE) +
+		((z % LightGrid::CELL_SIZE) * LightGrid::CELL_SIZE * LightGrid::CELL_SIZE);
+	return (cellLight * LightGrid::CELL_VOXELS) + cellVoxel;
+}
+
+int LightGrid::getVisibilityCount() const
+{
+	return static_cast<int>(this->cellLights.size()) * LightGrid::CELL_VOXELS;
+}
+
+int LightGrid::getLightCount() const
+{
+	return static_cast<int>(this->radii.size());
+}
+
+const std::vector<float> &LightGrid::getLightData() const
+{
+	return this->lightData;
+}
+
+const std::vector<int> &LightGrid::getCellRefs() const
+{
+	return this->cellRefs;
+}
+
+const std::vector<int> &LightGrid::getCellLights() const
+{
+	return this->cellLights;
+}
+
+bool LightGrid::isDirty() const
+{
+	return this->dirty;
+}
+
+int LightGrid::addLight(const Float3d &point, const Float3d &color, double radius)
+{
+	int id = this->getLightCount();
+	if (this->freeIDs.size() > 0)
+	{
+		id = this->freeIDs.back();
+		this->freeIDs.pop_back();
+	}
+	else
+	{
+		this->points.push_back(Float3d());
+		this->colors.push_back(Float3d());
+		this->radii.push_back(0.0);
+	}
+
+	this->setLight(id, point, color, radius);
+	return id;
+}
+
+void LightGrid::setLight(int id, const Float3d &point, const Float3d &color,
+	double radius)
+{
+	assert(radius >= 0.0);
+
+	// Shadows change wherever the light was and wherever it is now.
+	const std::vector<int> oldCells = this->getCells(this->points.at(id),
+		this->radii.at(id));
+	const std::vector<int> newCells = this->getCells(point, radius);
+	this->staleCells.insert(this->staleCells.end(), oldCells.begin(), oldCells.end());
+	this->staleCells.insert(this->staleCells.end(), newCells.begin(), newCells.end());
+
+	this->points.at(id) = point;
+	this->colors.at(id) = color;
+	this->radii.at(id) = radius;
+	this->dirty = true;
+}
+
+void LightGrid::removeLight(int id)
+{
+	// A light with no radius doesn't reach any cells.
+	this->setLight(id, Float3d(), Float3d(), 0.0);
+	this->freeIDs.push_back(id);
+}
+
+void LightGrid::update()
+{
+	if (!this->dirty)
+	{
+		return;
+	}
+
+	const int lightCount = this->getLightCount();
+
+	// Pack the lights.
+	this->lightData.resize(lightCount * LightGrid::LIGHT_FLOATS);
+	for (int i = 0; i < lightCount; ++i)
+	{
+		const Float3d &point = this->points.at(i);
+		const Float3d &color = this->colors.at(i);
+		float *lightPtr = this->lightData.data() + (i * LightGrid::LIGHT_FLOATS);
+		*(lightPtr + 0) = static_cast<float>(point.getX());
+		*(lightPtr + 1) = static_cast<float>(point.getY());
+		*(lightPtr + 2) = static_cast<float>(point.getZ());
+		*(lightPtr + 3) = static_cast<float>(this->radii.at(i));
+		*(lightPtr + 4) = static_cast<float>(color.getX());
+		*(lightPtr + 5) = static_cast<float>(color.getY());
+		*(lightPtr + 6) = static_cast<float>(color.getZ());
+		*(lightPtr + 7) = 0.0f;
+	}
+
+	// Count the lights in each cell.
+	std::vector<std::vector<int>> lightCells(lightCount);
+	const std::vector<int> oldCellRefs = this->cellRefs;
+	std::fill(this->cellRefs.begin(), this->cellRefs.end(), 0);
+	for (int i = 0; i < lightCount; ++i)
+	{
+		lightCells.at(i) = this->getCells(this->points.at(i), this->radii.at(i));
+		for (const int cell : lightCells.at(i))
+		{
+			++this->cellRefs.at((cell * 2) + 1);
+		}
+	}
+
+	// Give each cell its range of the cell lights, then count again while filling.
+	int offset = 0;
+	for (int i = 0; i < this->getCellCount(); ++i)
+	{
+		this->cellRefs.at(i * 2) = offset;
+		offset += this->cellRefs.at((i * 2) + 1);
+		this->cellRefs.at((i * 2) + 1) = 0;
+	}
+
+	this->cellLights.resize(offset);
+	for (int i = 0; i < lightCount; ++i)
+	{
+		for (const int cell : lightCells.at(i))
+		{
+			int &count = this->cellRefs.at((cell * 2) + 1);
+			this->cellLights.at(this->cellRefs.at(cell * 2) + count) = i;
+			++count;
+		}
+	}
+
+	// If any cell's list moved or changed size, the visibility entries no longer line
+	// up with their lights.
+	if (this->cellRefs != oldCellRefs)
+	{
+		this->visibilityReset = true;
+	}
+
+	this->dirty = false;
+}
+
+void LightGrid::markVoxelChanged(int x, int y, int z)
+{
+	// Only lights whose sphere reaches the voxel can have their rays blocked by it,
+	// and those are the lights in the voxel's cell.
+	const int cellIndex = this->getCellIndex(x, y, z);
+	const int start = this->cellRefs.at(cellIndex * 2);
+	const int end = start + this->cellRefs.at((cellIndex * 2) + 1);
+	for (int i = start; i < end; ++i)
+	{
+		const int id = this->cellLights.at(i);
+		const std::vector<int> cells = this->getCells(this->points.at(id),
+			this->radii.at(id));
+		this->staleCells.insert(this->staleCells.end(), cells.begin(), cells.end());
+	}
+}
+
+std::vector<std::pair<int, int>> LightGrid::popStaleVisibility()
+{
+	std::vector<std::pair<int, int>> ranges;
+
+	if (this->visibilityReset)
+	{
+		if (this->getVisibilityCount() > 0)
+		{
+			ranges.push_back(std::make_pair(0, this->getVisibilityCount()));
+		}
+
+		this->visibilityReset = false;
+		this->staleCells.clear();
+		return ranges;
+	}
+
+	// Cells' entries are in cell order, so sorted cells give sorted ranges, and 
+	// neighboring ranges are merged.
+	std::sort(this->staleCells.begin(), this->staleCells.end());
+	this->staleCells.erase(std::unique(this->staleCells.begin(), this->staleCells.end()),
+		this->staleCells.end());
+
+	for (const int cell : this->staleCells)
+	{
+		const int begin = this->cellRefs.at(cell * 2) * LightGrid::CELL_VOXELS;
+		const int end = begin + (this->cellRefs.at((cell * 2) + 1) * LightGrid::CELL_VOXELS);
+		if (begin == end)
+		{
+			continue;
+		}
+
+		if ((ranges.size() > 0) && (ranges.back().second == begin))
+		{
+			ranges.back().second = end;
+		}
+		else
+		{
+			ranges.push_back(std::make_pair(begin, end));
+		}
+	}
+
+	this->staleCells.clear();
+	return ranges;
+}
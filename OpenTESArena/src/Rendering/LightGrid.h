@@ -0,0 +1,114 @@
+#ifndef LIGHT_GRID_H
+#define LIGHT_GRID_H
+
+#include <utility>
+#include <vector>
+
+#include "../Math/Float3.h"
+
+// The light grid assigns point lights (torches, held lights, spell projectiles) to
+// the cells of a coarse grid over the world, so shading only looks at the lights
+// that can reach the hit point's cell instead of every light in the world. A cell is
+// a cube of voxels, and a light is put in each cell its sphere of influence touches.
+
+// Lights are set at any time, and the cells are only built again by update() when a
+// light changed since the last update. The built data is laid out like the kernel's
+// buffers:
+// - Lights: two float4s per light ID (point and radius, then color and 0). Removed
+//   lights have a radius of 0.
+// - Cell references: two ints per cell (offset into the cell lights, light count).
+// - Cell lights: light IDs of each cell, one cell after another.
+
+// With shadows, the renderers also keep a visibility cache: one entry per cell light
+// per voxel in the cell, counting the shadow rays from that voxel to that light that
+// were lit or blocked. Once enough rays agree, the voxel's visibility of the light is
+// used without tracing. The grid tracks which entries go stale (when a light moves or
+// a voxel near a light changes) so only those are cleared, and the whole cache is
+// cleared when the cells' lists move around.
+
+class LightGrid
+{
+private:
+	std::vector<Float3d> points, colors;
+	std::vector<double> radii;
+	std::vector<int> freeIDs; // IDs of removed lights, for reuse.
+	std::vector<float> lightData;
+	std::vector<int> cellRefs, cellLights;
+	std::vector<int> staleCells; // Cells whose visibility entries need clearing.
+	int cellsX, cellsY, cellsZ;
+	bool dirty;
+	bool visibilityReset; // Whether every visibility entry needs clearing.
+
+	// Gets the cells a light's sphere touches. Cells in the light's bounding box are
+	// skipped if no part of them is in reach.
+	std::vector<int> getCells(const Float3d &point, double radius) const;
+public:
+	// Voxels along each side of a cell.
+	static const int CELL_SIZE;
+
+	// Floats per light in the built light data.
+	static const int LIGHT_FLOATS;
+
+	// Voxels in a cell, i.e., visibility entries per cell light.
+	static const int CELL_VOXELS;
+
+	// Most shadow rays per hit the options allow. Both renderers keep a fixed array of
+	// this many shadow candidates per hit.
+	static const int MAX_SHADOW_RAYS = 8;
+
+	// Shadow rays that must agree before a visibility entry is trusted, and the most
+	// rays an entry counts. Lit rays count in the low 16 bits of an entry and blocked
+	// rays in the high 16 bits.
+	static const int VISIBILITY_SAMPLES;
+	static const int MAX_VISIBILITY_SAMPLES;
+
+	LightGrid(int worldWidth, int worldHeight, int worldDepth);
+	~LightGrid();
+
+	// Gets the number of cells in the grid.
+	int getCellCount() const;
+
+	// Gets the index of the cell containing a voxel.
+	int getCellIndex(int x, int y, int z) const;
+
+	// Gets the visibility entry of a voxel for one of its cell's lights (an index 
+	// into the cell lights).
+	int getVisibilityIndex(int cellLight, int x, int y, int z) const;
+
+	// Gets the number of visibility entries, as of the last update.
+	int getVisibilityCount() const;
+
+	// Gets the number of light IDs in use or free, i.e., the lights in the light data.
+	int getLightCount() const;
+
+	// Gets the built data, as of the last update.
+	const std::vector<float> &getLightData() const;
+	const std::vector<int> &getCellRefs() const;
+	const std::vector<int> &getCellLights() const;
+
+	// Returns whether a light changed since the last update.
+	bool isDirty() const;
+
+	// Adds a light with the given color (where 1 is full brightness) and radius in
+	// voxels, and returns its ID.
+	int addLight(const Float3d &point, const Float3d &color, double radius);
+
+	// Changes a light, like when it moves.
+	void setLight(int id, const Float3d &point, const Float3d &color, double radius);
+
+	// Removes a light. Its ID may be given to a later light.
+	void removeLight(int id);
+
+	// Marks the visibility entries of every light that could be blocked by a voxel 
+	// as stale, like when a door opens.
+	void markVoxelChanged(int x, int y, int z);
+
+	// Builds the light data and the cells again if a light changed.
+	void update();
+
+	// Gets the [begin, end) ranges of visibility entries that need clearing since the 
+	// last call, and forgets them. This should be called after update().
+	std::vector<std::pair<int, int>> popStaleVisibility();
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+#include "RenderProfiler.h"
+
+#include "../Utilities/Debug.h"
+#include "../Utilities/File.h"
+
+namespace
+{
+	// Extension that makes save() write JSON instead of CSV.
+	const std::string JSON_EXTENSION = ".json";
+}
+
+RenderProfiler::RenderProfiler(int windowSize)
+{
+	assert(windowSize > 0);
+
+	this->windowSize = windowSize;
+}
+
+RenderProfiler::~RenderProfiler()
+{
+
+}
+
+const std::deque<double> &RenderProfiler::getSamples(const std::string &stageName) const
+{
+	const auto iter = this->samples.find(stageName);
+	Debug::check(iter != this->samples.end(), "RenderProfiler",
+		"No samples for stage \"" + stageName + "\".");
+
+	return iter->second;
+}
+
+std::string RenderProfiler::toCSV() const
+{
+	std::string text = "stage,samples,min_ms,avg_ms,p99_ms\n";
+	for (const auto &stageName : this->stageNames)
+	{
+		text += stageName + "," +
+			std::to_string(this->getSampleCount(stageName)) + "," +
+			std::to_string(this->getMinimum(stageName)) + "," +
+			std::to_string(this->getAverage(stageName)) + "," +
+			std::to_string(this->getPercentile(stageName, 99.0)) + "\n";
+	}
+
+	return text;
+}
+
+std::string RenderProfiler::toJSON() const
+{
+	std::string text = "{\n";
+	for (int i = 0; i < static_cast<int>(this->stageNames.size()); ++i)
+	{
+		const std::string &stageName = this->stageNames.at(i);
+		const bool isLast = i == (static_cast<int>(this->stageNames.size()) - 1);
+
+		text += "\t\"" + stageName + "\": { " +
+			"\"samples\": " + std::to_string(this->getSampleCount(stageName)) + ", " +
+			"\"min_ms\": " + std::to_string(this->getMinimum(stageName)) + ", " +
+			"\"avg_ms\": " + std::to_string(this->getAverage(stageName)) + ", " +
+			"\"p99_ms\": " + std::to_string(this->getPercentile(stageName, 99.0)) +
+			(isLast ? " }\n" : " },\n");
+	}
+
+	text += "}\n";
+	return text;
+}
+
+const std::vector<std::string> &RenderProfiler::getStageNames() const
+{
+	return this->stageNames;
+}
+
+int RenderProfiler::getSampleCount(const std::string &stageName) const
+{
+	const auto iter = this->samples.find(stageName);
+	return (iter != this->samples.end()) ? static_cast<int>(iter->second.size()) : 0;
+}
+
+double RenderProfiler::getMinimum(const std::string &stageName) const
+{
+	const auto &stageSamples = this->getSamples(stageName);
+	return *std::min_element(stageSamples.begin(), stageSamples.end());
+}
+
+double RenderProfiler::getAverage(const std::string &stageName) const
+{
+	const auto &stageSamples = this->getSamples(stageName);
+	return std::accumulate(stageSamples.begin(), stageSamples.end(), 0.0) /
+		static_cast<double>(stageSamples.size());
+}
+
+double RenderProfiler::getPercentile(const std::string &stageName, double percent) const
+{
+	assert(percent >= 0.0);
+	assert(percent <= 100.0);
+
+	// Nearest-rank percentile of a sorted copy of the window.
+	const auto &stageSamples = this->getSamples(stageName);
+	std::vector<double> sorted(stageSamples.begin(), stageSamples.end());
+	std::sort(sorted.begin(), sorted.end());
+
+	const int rank = static_cast<int>(std::ceil(
+		(percent / 100.0) * static_cast<double>(sorted.size())));
+	return sorted.at(std::max(rank - 1, 0));
+}
+
+void RenderProfiler::addSample(const std::string &stageName, double milliseconds)
+{
+	auto iter = this->samples.find(stageName);
+	if (iter == this->samples.end())
+	{
+		this->stageNames.push_back(stageName);
+		iter = this->samples.insert(std::make_pair(stageName, std::deque<double>())).first;
+	}
+
+	auto &stageSamples = iter->second;
+	stageSamples.push_back(milliseconds);
+	if (static_cast<int>(stageSamples.size()) > this->windowSize)
+	{
+		stageSamples.pop_front();
+	}
+}
+
+bool RenderProfiler::save(const std::string &filename) const
+{
+	const bool isJSON = (filename.size() >= JSON_EXTENSION.size()) &&
+		(filename.compare(filename.size() - JSON_EXTENSION.size(),
+			JSON_EXTENSION.size(), JSON_EXTENSION) == 0);
+
+	return File::fromString(filename, isJSON ? this->toJSON() : this->toCSV());
+}
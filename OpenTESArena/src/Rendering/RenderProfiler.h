@@ -0,0 +1,48 @@
+#ifndef RENDER_PROFILER_H
+#define RENDER_PROFILER_H
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The render profiler keeps the times of each stage of a frame (kernels, read back,
+// texture update) over the last few hundred frames, so a slow frame can be traced to
+// the stage that caused it. Times are in milliseconds.
+
+class RenderProfiler
+{
+private:
+	std::vector<std::string> stageNames; // In the order they were first seen.
+	std::unordered_map<std::string, std::deque<double>> samples; // Newest at the back.
+	int windowSize; // Samples kept for each stage.
+
+	// Gets the samples of a stage, which must have at least one.
+	const std::deque<double> &getSamples(const std::string &stageName) const;
+
+	std::string toCSV() const;
+	std::string toJSON() const;
+public:
+	RenderProfiler(int windowSize);
+	~RenderProfiler();
+
+	// Gets the names of all stages with samples.
+	const std::vector<std::string> &getStageNames() const;
+
+	// Gets the number of samples in a stage's window.
+	int getSampleCount(const std::string &stageName) const;
+
+	// Statistics over a stage's window.
+	double getMinimum(const std::string &stageName) const;
+	double getAverage(const std::string &stageName) const;
+	double getPercentile(const std::string &stageName, double percent) const;
+
+	// Adds a stage's time for one frame, dropping the oldest one if the window is full.
+	void addSample(const std::string &stageName, double milliseconds);
+
+	// Writes the statistics of each stage to a file, as JSON if the filename ends in
+	// ".json" and as CSV otherwise. Returns whether it succeeded.
+	bool save(const std::string &filename) const;
+};
+
+#endif
@@ -333,6 +333,20 @@ void Renderer::drawToNative(SDL_Texture *texture)
 	this->drawToNative(texture, 0, 0);
 }
 
+void Renderer::drawToNative(SDL_Texture *texture, const SDL_Rect &source, int x, int y,
+	int w, int h)
+{
+	SDL_SetRenderTarget(this->renderer, this->nativeTexture);
+
+	SDL_Rect rect;
+	rect.x = x;
+	rect.y = y;
+	rect.w = w;
+	rect.h = h;
+
+	SDL_RenderCopy(this->renderer, texture, &source, &rect);
+}
+
 void Renderer::drawToNative(SDL_Surface *surface, int x, int y, int w, int h)
 {
 	SDL_Texture *texture = SDL_CreateTextureFromSurface(this->renderer, surface);
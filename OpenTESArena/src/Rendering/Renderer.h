@@ -88,6 +88,7 @@ public:
 	void drawToNative(SDL_Texture *texture, int x, int y, int w, int h);
 	void drawToNative(SDL_Texture *texture, int x, int y);
 	void drawToNative(SDL_Texture *texture);
+	void drawToNative(SDL_Texture *texture, const SDL_Rect &source, int x, int y, int w, int h);
 	void drawToNative(SDL_Surface *surface, int x, int y, int w, int h);
 	void drawToNative(SDL_Surface *surface, int x, int y);
 	void drawToNative(SDL_Surface *surface);
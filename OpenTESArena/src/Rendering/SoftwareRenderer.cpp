@@ -0,0 +1,1076 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include "SDL.h"
+
+#include "SoftwareRenderer.h"
+
+#include "../Entities/Directable.h"
+#include "../Game/Options.h"
+#include "../Math/Constants.h"
+#include "../Math/Float2.h"
+#include "../Math/Triangle.h"
+#include "../Media/PaletteName.h"
+#include "../Media/TextureManager.h"
+#include "../Rendering/Renderer.h"
+#include "../Utilities/Debug.h"
+#include "../World/Voxel.h"
+#include "../World/VoxelType.h"
+
+namespace
+{
+	// Rows in each strip of work the render threads take.
+	const int STRIP_ROWS = 8;
+
+	// Fewest triangles the sprite triangle region is given.
+	const int MIN_SPRITE_TRIANGLES = 256;
+
+	// Length of a day in game time seconds. Game time zero is midnight.
+	const double DAY_LENGTH = 24.0 * 60.0;
+
+	// Sky colors at midnight and noon, until the sky is drawn from world data.
+	const Color NIGHT_SKY_COLOR(8, 8, 24);
+	const Color DAY_SKY_COLOR(112, 148, 196);
+
+	// Brightness of walls (surfaces facing sideways) compared to floors and ceilings,
+	// so corners are easy to see without any lights.
+	const float WALL_SHADE = 0.75f;
+
+	// Determinants and directions smaller than this are treated as zero.
+	const float RAY_EPSILON = 1.0e-6f;
+
+	// How far shadow rays start off the surface so they don't hit it.
+	const float SHADOW_BIAS = 1.0e-3f;
+
+	// Lit rays are counted in the low bits of a visibility entry, and blocked rays in
+	// the high bits.
+	const uint32_t VISIBILITY_LIT_MASK = 0xFFFF;
+	const int VISIBILITY_BLOCKED_SHIFT = 16;
+
+	// Blends two colors into an ARGB color. A percent of 0 is all the first color.
+	uint32_t blendColors(const Color &first, const Color &second, double percent)
+	{
+		auto blend = [percent](unsigned char a, unsigned char b)
+		{
+			return static_cast<uint32_t>(
+				static_cast<double>(a) + ((static_cast<double>(b) - a) * percent));
+		};
+
+		return 0xFF000000 |
+			(blend(first.getR(), second.getR()) << 16) |
+			(blend(first.getG(), second.getG()) << 8) |
+			blend(first.getB(), second.getB());
+	}
+
+	// Scales the red, green, and blue of an ARGB color, saturating at full brightness.
+	uint32_t shadeColor(uint32_t argb, float shadeR, float shadeG, float shadeB)
+	{
+		auto shade = [](uint32_t channel, float percent)
+		{
+			return std::min(static_cast<uint32_t>(channel * percent), 255u);
+		};
+
+		const uint32_t r = shade((argb >> 16) & 0xFF, shadeR);
+		const uint32_t g = shade((argb >> 8) & 0xFF, shadeG);
+		const uint32_t b = shade(argb & 0xFF, shadeB);
+		return 0xFF000000 | (r << 16) | (g << 8) | b;
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer(int width, int height, int worldWidth,
+	int worldHeight, int worldDepth, const Options &options,
+	TextureManager &textureManager, Renderer &renderer)
+	: lightGrid(worldWidth, worldHeight, worldDepth),
+	spriteGrid(worldWidth, worldHeight, worldDepth), spriteTriangleRun(0, 0),
+	textureManager(textureManager)
+{
+	assert(width > 0);
+	assert(height > 0);
+	assert(worldWidth > 0);
+	assert(worldHeight > 0);
+	assert(worldDepth > 0);
+
+	Debug::mention("SoftwareRenderer", "Initializing.");
+
+	this->width = width;
+	this->height = height;
+	this->worldWidth = worldWidth;
+	this->worldHeight = worldHeight;
+	this->worldDepth = worldDepth;
+	this->triangleCount = 0;
+	this->texture = nullptr;
+	this->eye = { 0.0f, 0.0f, 0.0f };
+	this->forward = { 1.0f, 0.0f, 0.0f };
+	this->right = { 0.0f, 0.0f, 1.0f };
+	this->up = { 0.0f, 1.0f, 0.0f };
+	this->zoom = 1.0f;
+	this->shadowRays = options.getShadowRayCount();
+	assert(this->shadowRays <= LightGrid::MAX_SHADOW_RAYS);
+
+	// Every voxel starts empty.
+	this->voxelRefs = std::vector<VoxelReference>(
+		worldWidth * worldHeight * worldDepth, VoxelReference(0, 0));
+
+	this->createFrameBuffer(renderer);
+
+	this->setPalette(PaletteName::Default);
+	this->updateGameTime(0.0);
+
+	// Start the render threads. The thread calling render() is one of the threads, so
+	// one fewer is started.
+	int threadCount = options.getRenderThreadCount();
+	if (threadCount == 0)
+	{
+		threadCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	}
+
+	Debug::mention("SoftwareRenderer", "Using " + std::to_string(threadCount) +
+		" render thread(s).");
+
+	this->nextStrip = 0;
+	this->frameNumber = 0;
+	this->threadsDone = 0;
+	this->stopping = false;
+	for (int i = 1; i < threadCount; ++i)
+	{
+		this->threads.push_back(std::thread(&SoftwareRenderer::runThread, this));
+	}
+
+	// --- TESTING PURPOSES ---
+	// The following code is for testing. Remove it once using actual world data.
+
+	this->makeTestWorld(worldWidth, worldHeight, worldDepth);
+
+	Debug::mention("SoftwareRenderer", "Test world has " +
+		std::to_string(this->triangleCount) + " shared triangles.");
+
+	// --- END TESTING ---
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+	// Wake the render threads so they can stop.
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+
+	this->startCondition.notify_all();
+
+	for (auto &thread : this->threads)
+	{
+		thread.join();
+	}
+
+	// Destroy the game world frame buffer.
+	// The SDL_Renderer destroys this itself with SDL_DestroyRenderer(), too.
+	SDL_DestroyTexture(this->texture);
+}
+
+int SoftwareRenderer::getVoxelIndex(int x, int y, int z) const
+{
+	assert(x >= 0);
+	assert(y >= 0);
+	assert(z >= 0);
+	assert(x < this->worldWidth);
+	assert(y < this->worldHeight);
+	assert(z < this->worldDepth);
+
+	return x + (y * this->worldWidth) + (z * this->worldWidth * this->worldHeight);
+}
+
+int SoftwareRenderer::allocateTriangles(int count)
+{
+	assert(count > 0);
+
+	const int offset = this->triangleCount;
+	this->triangleCount += count;
+
+	for (auto *values : { &this->p1X, &this->p1Y, &this->p1Z, &this->edge1X,
+		&this->edge1Y, &this->edge1Z, &this->edge2X, &this->edge2Y, &this->edge2Z,
+		&this->normalX, &this->normalY, &this->normalZ, &this->uv1X, &this->uv1Y,
+		&this->uvEdge1X, &this->uvEdge1Y, &this->uvEdge2X, &this->uvEdge2Y })
+	{
+		values->resize(this->triangleCount);
+	}
+
+	this->triangleTextures.resize(this->triangleCount);
+
+	return offset;
+}
+
+void SoftwareRenderer::writeTriangles(const std::vector<Triangle> &triangles,
+	int textureIndex, int offset)
+{
+	assert(textureIndex >= 0);
+	assert(textureIndex < static_cast<int>(this->textureRefs.size()));
+	assert((offset + static_cast<int>(triangles.size())) <= this->triangleCount);
+
+	for (int i = 0; i < static_cast<int>(triangles.size()); ++i)
+	{
+		const Triangle &triangle = triangles.at(i);
+		const Float3d edge1 = triangle.getP2() - triangle.getP1();
+		const Float3d edge2 = triangle.getP3() - triangle.getP1();
+		const Float2d uvEdge1 = triangle.getUV2() - triangle.getUV1();
+		const Float2d uvEdge2 = triangle.getUV3() - triangle.getUV1();
+		const int index = offset + i;
+
+		this->p1X.at(index) = static_cast<float>(triangle.getP1().getX());
+		this->p1Y.at(index) = static_cast<float>(triangle.getP1().getY());
+		this->p1Z.at(index) = static_cast<float>(triangle.getP1().getZ());
+		this->edge1X.at(index) = static_cast<float>(edge1.getX());
+		this->edge1Y.at(index) = static_cast<float>(edge1.getY());
+		this->edge1Z.at(index) = static_cast<float>(edge1.getZ());
+		this->edge2X.at(index) = static_cast<float>(edge2.getX());
+		this->edge2Y.at(index) = static_cast<float>(edge2.getY());
+		this->edge2Z.at(index) = static_cast<float>(edge2.getZ());
+		const Float3d normal = triangle.getNormal();
+		this->normalX.at(index) = static_cast<float>(normal.getX());
+		this->normalY.at(index) = static_cast<float>(normal.getY());
+		this->normalZ.at(index) = static_cast<float>(normal.getZ());
+		this->uv1X.at(index) = static_cast<float>(triangle.getUV1().getX());
+		this->uv1Y.at(index) = static_cast<float>(triangle.getUV1().getY());
+		this->uvEdge1X.at(index) = static_cast<float>(uvEdge1.getX());
+		this->uvEdge1Y.at(index) = static_cast<float>(uvEdge1.getY());
+		this->uvEdge2X.at(index) = static_cast<float>(uvEdge2.getX());
+		this->uvEdge2Y.at(index) = static_cast<float>(uvEdge2.getY());
+		this->triangleTextures.at(index) = textureIndex;
+	}
+}
+
+VoxelReference SoftwareRenderer::getVoxelTemplate(VoxelType voxelType, int textureIndex)
+{
+	assert(textureIndex >= 0);
+
+	auto key = std::make_pair(voxelType, textureIndex);
+	auto templateIter = this->voxelTemplates.find(key);
+	if (templateIter != this->voxelTemplates.end())
+	{
+		return templateIter->second;
+	}
+
+	// Add the voxel type's triangles to the triangle arrays.
+	std::vector<Triangle> geometry = Voxel(voxelType).getGeometry();
+	const int count = static_cast<int>(geometry.size());
+	const int offset = (count > 0) ? this->allocateTriangles(count) : 0;
+
+	if (count > 0)
+	{
+		this->writeTriangles(geometry, textureIndex, offset);
+	}
+
+	VoxelReference voxelRef(offset, count);
+	this->voxelTemplates.insert(std::make_pair(key, voxelRef));
+	return voxelRef;
+}
+
+void SoftwareRenderer::updateSprites()
+{
+	// The render threads read the host sprite lists directly, so the dirty ranges 
+	// aren't needed.
+	this->spriteGrid.popDirtyRefs();
+	this->spriteGrid.popDirtyIndices();
+
+	if (!this->spriteGrid.isDirty())
+	{
+		return;
+	}
+
+	this->spriteGrid.update();
+
+	// Each sprite slot has two triangles in the sprite triangle region. If the region
+	// is too small, move every slot to a bigger one at the end of the triangle arrays.
+	// The old region isn't reused, but the region grows geometrically, so that's at
+	// most as many triangles as the region has.
+	const int slotCount = this->spriteGrid.getSlotCount();
+	const int triangleCount = slotCount * 2;
+	if (triangleCount > this->spriteTriangleRun.getTriangleCount())
+	{
+		int newCount = std::max(this->spriteTriangleRun.getTriangleCount(),
+			MIN_SPRITE_TRIANGLES);
+		while (newCount < triangleCount)
+		{
+			newCount *= 2;
+		}
+
+		this->spriteTriangleRun = VoxelReference(this->allocateTriangles(newCount),
+			newCount);
+
+		for (int i = 0; i < slotCount; ++i)
+		{
+			this->writeTriangles(this->spriteGrid.getTriangles(i),
+				this->spriteGrid.getTextureIndex(i),
+				this->spriteTriangleRun.getOffset() + (i * 2));
+		}
+	}
+	else
+	{
+		for (const int slot : this->spriteGrid.getUpdatedSlots())
+		{
+			this->writeTriangles(this->spriteGrid.getTriangles(slot),
+				this->spriteGrid.getTextureIndex(slot),
+				this->spriteTriangleRun.getOffset() + (slot * 2));
+		}
+	}
+}
+
+void SoftwareRenderer::clearStaleVisibility()
+{
+	// Stale ranges are still popped without shadows, so they don't pile up.
+	const std::vector<std::pair<int, int>> ranges = this->lightGrid.popStaleVisibility();
+	if (this->shadowRays == 0)
+	{
+		return;
+	}
+
+	// Growing means the cell lists moved, so everything is cleared anyway.
+	const int visibilityCount = this->lightGrid.getVisibilityCount();
+	if (visibilityCount > static_cast<int>(this->visibility.size()))
+	{
+		this->visibility = std::vector<std::atomic<uint32_t>>(visibilityCount);
+	}
+
+	for (const auto &range : ranges)
+	{
+		for (int i = range.first; i < range.second; ++i)
+		{
+			this->visibility.at(i).store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+void SoftwareRenderer::createFrameBuffer(Renderer &renderer)
+{
+	this->texture = renderer.createTexture(SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING, this->width, this->height);
+	Debug::check(this->texture != nullptr, "SoftwareRenderer", "SDL_CreateTexture");
+
+	this->frameBuffer = std::vector<uint32_t>(this->width * this->height);
+}
+
+void SoftwareRenderer::loadTextures(const std::vector<std::string> &filenames)
+{
+	assert(this->triangleCount == 0);
+
+	// Pack each texture's palette indices one after another.
+	this->texels.clear();
+	this->textureRefs.clear();
+	for (const auto &filename : filenames)
+	{
+		int width, height;
+		const auto indices = this->textureManager.getIndices(filename, width, height);
+		this->textureRefs.push_back(TextureReference(
+			static_cast<int>(this->texels.size()), width, height));
+		this->texels.insert(this->texels.end(), indices.begin(), indices.end());
+	}
+}
+
+void SoftwareRenderer::runThread()
+{
+	int lastFrame = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->startCondition.wait(lock, [this, lastFrame]()
+			{
+				return this->stopping || (this->frameNumber != lastFrame);
+			});
+
+			if (this->stopping)
+			{
+				return;
+			}
+
+			lastFrame = this->frameNumber;
+		}
+
+		this->renderStrips();
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			++this->threadsDone;
+		}
+
+		this->doneCondition.notify_one();
+	}
+}
+
+void SoftwareRenderer::renderStrips()
+{
+	const int stripCount = (this->height + STRIP_ROWS - 1) / STRIP_ROWS;
+	while (true)
+	{
+		const int strip = this->nextStrip.fetch_add(1);
+		if (strip >= stripCount)
+		{
+			break;
+		}
+
+		const int startRow = strip * STRIP_ROWS;
+		this->renderRows(startRow, std::min(startRow + STRIP_ROWS, this->height));
+	}
+}
+
+void SoftwareRenderer::renderRows(int startRow, int endRow)
+{
+	const float aspect = static_cast<float>(this->width) /
+		static_cast<float>(this->height);
+	const float widthReal = static_cast<float>(this->width);
+	const float heightReal = static_cast<float>(this->height);
+
+	for (int y = startRow; y < endRow; ++y)
+	{
+		// Rays aren't normalized. Distances are only compared along the same ray.
+		const float screenY = 1.0f - ((2.0f * (static_cast<float>(y) + 0.5f)) / heightReal);
+		const float rowX = (this->forward[0] * this->zoom) + (this->up[0] * screenY);
+		const float rowY = (this->forward[1] * this->zoom) + (this->up[1] * screenY);
+		const float rowZ = (this->forward[2] * this->zoom) + (this->up[2] * screenY);
+
+		uint32_t *pixels = this->frameBuffer.data() + (y * this->width);
+		for (int x = 0; x < this->width; ++x)
+		{
+			const float screenX = aspect *
+				(((2.0f * (static_cast<float>(x) + 0.5f)) / widthReal) - 1.0f);
+			pixels[x] = this->castRay(
+				rowX + (this->right[0] * screenX),
+				rowY + (this->right[1] * screenX),
+				rowZ + (this->right[2] * screenX));
+		}
+	}
+}
+
+uint32_t SoftwareRenderer::castRay(float dirX, float dirY, float dirZ) const
+{
+	const std::array<float, 3> direction = { dirX, dirY, dirZ };
+	const std::array<int, 3> worldSize =
+	{
+		this->worldWidth, this->worldHeight, this->worldDepth
+	};
+
+	// Clip the ray to the world's box, so only cells that exist are visited.
+	float tStart = 0.0f;
+	float tEnd = std::numeric_limits<float>::infinity();
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float origin = this->eye[axis];
+		const float dir = direction[axis];
+		const float size = static_cast<float>(worldSize[axis]);
+
+		if (std::fabs(dir) < RAY_EPSILON)
+		{
+			if ((origin < 0.0f) || (origin >= size))
+			{
+				return this->skyColor;
+			}
+		}
+		else
+		{
+			const float t1 = -origin / dir;
+			const float t2 = (size - origin) / dir;
+			tStart = std::max(tStart, std::min(t1, t2));
+			tEnd = std::min(tEnd, std::max(t1, t2));
+		}
+	}
+
+	if (tStart >= tEnd)
+	{
+		return this->skyColor;
+	}
+
+	// Start in the cell where the ray enters the world, and get how far along the
+	// ray each axis's next cell boundary is.
+	std::array<int, 3> cell, step;
+	std::array<float, 3> tNext, tDelta;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float origin = this->eye[axis];
+		const float dir = direction[axis];
+		const float start = origin + (dir * tStart);
+		cell[axis] = std::min(std::max(static_cast<int>(std::floor(start)), 0),
+			worldSize[axis] - 1);
+
+		if (dir > RAY_EPSILON)
+		{
+			step[axis] = 1;
+			tNext[axis] = (static_cast<float>(cell[axis] + 1) - origin) / dir;
+			tDelta[axis] = 1.0f / dir;
+		}
+		else if (dir < -RAY_EPSILON)
+		{
+			step[axis] = -1;
+			tNext[axis] = (static_cast<float>(cell[axis]) - origin) / dir;
+			tDelta[axis] = -1.0f / dir;
+		}
+		else
+		{
+			step[axis] = 0;
+			tNext[axis] = std::numeric_limits<float>::infinity();
+			tDelta[axis] = std::numeric_limits<float>::infinity();
+		}
+	}
+
+	// Step through the cells until something is hit or the ray leaves the world.
+	const std::vector<int> &spriteRefs = this->spriteGrid.getSpriteRefs();
+	const std::vector<int> &spriteIndices = this->spriteGrid.getSpriteIndices();
+	while (true)
+	{
+		const int voxelIndex = this->getVoxelIndex(cell[0], cell[1], cell[2]);
+		const VoxelReference &voxelRef = this->voxelRefs[voxelIndex];
+		const int spriteStart = spriteRefs[voxelIndex * 2];
+		const int spriteEnd = spriteStart + spriteRefs[(voxelIndex * 2) + 1];
+
+		if ((voxelRef.getTriangleCount() > 0) || (spriteEnd > spriteStart))
+		{
+			float hitT = std::numeric_limits<float>::infinity();
+			int hitTriangle = 0;
+			uint8_t hitIndex = 0;
+			bool hit = (voxelRef.getTriangleCount() > 0) && this->intersectVoxel(voxelRef,
+				this->eye[0] - static_cast<float>(cell[0]),
+				this->eye[1] - static_cast<float>(cell[1]),
+				this->eye[2] - static_cast<float>(cell[2]),
+				dirX, dirY, dirZ, hitT, hitTriangle, hitIndex);
+
+			// Sprites are in world coordinates. A sprite hit only counts in the voxel
+			// it's in, since the sprite is also tested in the other voxels it reaches.
+			const float tExit = std::min(tNext[0], std::min(tNext[1], tNext[2]));
+			for (int i = spriteStart; i < spriteEnd; ++i)
+			{
+				const VoxelReference spriteRef(
+					this->spriteTriangleRun.getOffset() + (spriteIndices[i] * 2), 2);
+
+				float spriteT;
+				int spriteTriangle;
+				uint8_t spriteIndex;
+				const bool spriteHit = this->intersectVoxel(spriteRef, this->eye[0],
+					this->eye[1], this->eye[2], dirX, dirY, dirZ, spriteT,
+					spriteTriangle, spriteIndex);
+
+				if (spriteHit && (spriteT <= tExit) && (spriteT < hitT))
+				{
+					hit = true;
+					hitT = spriteT;
+					hitTriangle = spriteTriangle;
+					hitIndex = spriteIndex;
+				}
+			}
+
+			if (hit)
+			{
+				return this->shadeHit(cell[0], cell[1], cell[2],
+					this->eye[0] + (dirX * hitT), this->eye[1] + (dirY * hitT),
+					this->eye[2] + (dirZ * hitT), dirX, dirY, dirZ, hitTriangle, hitIndex);
+			}
+		}
+
+		const int axis = (tNext[0] < tNext[1]) ?
+			((tNext[0] < tNext[2]) ? 0 : 2) :
+			((tNext[1] < tNext[2]) ? 1 : 2);
+
+		if (tNext[axis] > tEnd)
+		{
+			break;
+		}
+
+		cell[axis] += step[axis];
+		if ((cell[axis] < 0) || (cell[axis] >= worldSize[axis]))
+		{
+			break;
+		}
+
+		tNext[axis] += tDelta[axis];
+	}
+
+	return this->skyColor;
+}
+
+bool SoftwareRenderer::intersectVoxel(const VoxelReference &voxelRef, float originX,
+	float originY, float originZ, float dirX, float dirY, float dirZ, float &hitT,
+	int &hitTriangle, uint8_t &hitIndex) const
+{
+	float nearestT = std::numeric_limits<float>::infinity();
+	int nearestTriangle = 0;
+	uint8_t nearestIndex = 0;
+
+	// Moller-Trumbore intersection with each triangle. Operator[] is used instead of
+	// at() since this is the innermost loop.
+	const int start = voxelRef.getOffset();
+	const int end = start + voxelRef.getTriangleCount();
+	for (int i = start; i < end; ++i)
+	{
+		const float e1X = this->edge1X[i];
+		const float e1Y = this->edge1Y[i];
+		const float e1Z = this->edge1Z[i];
+		const float e2X = this->edge2X[i];
+		const float e2Y = this->edge2Y[i];
+		const float e2Z = this->edge2Z[i];
+
+		const float pX = (dirY * e2Z) - (dirZ * e2Y);
+		const float pY = (dirZ * e2X) - (dirX * e2Z);
+		const float pZ = (dirX * e2Y) - (dirY * e2X);
+		const float det = (e1X * pX) + (e1Y * pY) + (e1Z * pZ);
+		if (std::fabs(det) < RAY_EPSILON)
+		{
+			continue;
+		}
+
+		const float invDet = 1.0f / det;
+		const float sX = originX - this->p1X[i];
+		const float sY = originY - this->p1Y[i];
+		const float sZ = originZ - this->p1Z[i];
+		const float u = ((sX * pX) + (sY * pY) + (sZ * pZ)) * invDet;
+		if ((u < 0.0f) || (u > 1.0f))
+		{
+			continue;
+		}
+
+		const float qX = (sY * e1Z) - (sZ * e1Y);
+		const float qY = (sZ * e1X) - (sX * e1Z);
+		const float qZ = (sX * e1Y) - (sY * e1X);
+		const float v = ((dirX * qX) + (dirY * qY) + (dirZ * qZ)) * invDet;
+		if ((v < 0.0f) || ((u + v) > 1.0f))
+		{
+			continue;
+		}
+
+		const float t = ((e2X * qX) + (e2Y * qY) + (e2Z * qZ)) * invDet;
+		if ((t <= RAY_EPSILON) || (t >= nearestT))
+		{
+			continue;
+		}
+
+		// Sample the texture with wrapped texture coordinates. Index 0 is transparent,
+		// so the ray goes on to the triangles behind it.
+		float texU = this->uv1X[i] + (this->uvEdge1X[i] * u) + (this->uvEdge2X[i] * v);
+		float texV = this->uv1Y[i] + (this->uvEdge1Y[i] * u) + (this->uvEdge2Y[i] * v);
+		texU -= std::floor(texU);
+		texV -= std::floor(texV);
+
+		const TextureReference &textureRef = this->textureRefs[this->triangleTextures[i]];
+		const int textureWidth = textureRef.getWidth();
+		const int textureHeight = textureRef.getHeight();
+		const int texelX = std::min(static_cast<int>(texU * textureWidth), textureWidth - 1);
+		const int texelY = std::min(static_cast<int>(texV * textureHeight), textureHeight - 1);
+		const uint8_t index = this->texels[textureRef.getOffset() + texelX +
+			(texelY * textureWidth)];
+
+		if (index != 0)
+		{
+			nearestT = t;
+			nearestTriangle = i;
+			nearestIndex = index;
+		}
+	}
+
+	if (nearestIndex == 0)
+	{
+		return false;
+	}
+
+	hitT = nearestT;
+	hitTriangle = nearestTriangle;
+	hitIndex = nearestIndex;
+	return true;
+}
+
+bool SoftwareRenderer::isOccluded(float originX, float originY, float originZ,
+	float dirX, float dirY, float dirZ, float distance) const
+{
+	const std::array<float, 3> origin = { originX, originY, originZ };
+	const std::array<float, 3> direction = { dirX, dirY, dirZ };
+	const std::array<int, 3> worldSize =
+	{
+		this->worldWidth, this->worldHeight, this->worldDepth
+	};
+
+	// Step through the cells from the origin's cell like a camera ray, but only as far
+	// as the light.
+	std::array<int, 3> cell, step;
+	std::array<float, 3> tNext, tDelta;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		cell[axis] = static_cast<int>(std::floor(origin[axis]));
+		if ((cell[axis] < 0) || (cell[axis] >= worldSize[axis]))
+		{
+			return false;
+		}
+
+		const float dir = direction[axis];
+		if (dir > RAY_EPSILON)
+		{
+			step[axis] = 1;
+			tNext[axis] = (static_cast<float>(cell[axis] + 1) - origin[axis]) / dir;
+			tDelta[axis] = 1.0f / dir;
+		}
+		else if (dir < -RAY_EPSILON)
+		{
+			step[axis] = -1;
+			tNext[axis] = (static_cast<float>(cell[axis]) - origin[axis]) / dir;
+			tDelta[axis] = -1.0f / dir;
+		}
+		else
+		{
+			step[axis] = 0;
+			tNext[axis] = std::numeric_limits<float>::infinity();
+			tDelta[axis] = std::numeric_limits<float>::infinity();
+		}
+	}
+
+	while (true)
+	{
+		const VoxelReference &voxelRef =
+			this->voxelRefs[this->getVoxelIndex(cell[0], cell[1], cell[2])];
+
+		if (voxelRef.getTriangleCount() > 0)
+		{
+			float hitT;
+			int hitTriangle;
+			uint8_t hitIndex;
+			const bool hit = this->intersectVoxel(voxelRef,
+				originX - static_cast<float>(cell[0]),
+				originY - static_cast<float>(cell[1]),
+				originZ - static_cast<float>(cell[2]),
+				dirX, dirY, dirZ, hitT, hitTriangle, hitIndex);
+
+			if (hit && (hitT < distance))
+			{
+				return true;
+			}
+		}
+
+		const int axis = (tNext[0] < tNext[1]) ?
+			((tNext[0] < tNext[2]) ? 0 : 2) :
+			((tNext[1] < tNext[2]) ? 1 : 2);
+
+		if (tNext[axis] > distance)
+		{
+			return false;
+		}
+
+		cell[axis] += step[axis];
+		if ((cell[axis] < 0) || (cell[axis] >= worldSize[axis]))
+		{
+			return false;
+		}
+
+		tNext[axis] += tDelta[axis];
+	}
+}
+
+uint32_t SoftwareRenderer::shadeHit(int x, int y, int z, float pointX, float pointY,
+	float pointZ, float dirX, float dirY, float dirZ, int triangle, uint8_t index) const
+{
+	// Light the side of the triangle that the ray sees.
+	float normalX = this->normalX[triangle];
+	float normalY = this->normalY[triangle];
+	float normalZ = this->normalZ[triangle];
+	if (((normalX * dirX) + (normalY * dirY) + (normalZ * dirZ)) > 0.0f)
+	{
+		normalX = -normalX;
+		normalY = -normalY;
+		normalZ = -normalZ;
+	}
+
+	const float shade = WALL_SHADE + ((1.0f - WALL_SHADE) * std::fabs(normalY));
+	float shadeR = shade;
+	float shadeG = shade;
+	float shadeB = shade;
+
+	// Lights whose visibility from this voxel isn't settled yet, most important first,
+	// with what they added to the shade using the cache's guess.
+	struct ShadowCandidate
+	{
+		float weight, lightX, lightY, lightZ, addR, addG, addB, guess;
+		int entry;
+	};
+
+	std::array<ShadowCandidate, LightGrid::MAX_SHADOW_RAYS> candidates;
+	int candidateCount = 0;
+
+	// Add each light in the hit's cell. Light fades to nothing at its radius.
+	const std::vector<int> &cellRefs = this->lightGrid.getCellRefs();
+	const std::vector<int> &cellLights = this->lightGrid.getCellLights();
+	const float *lightData = this->lightGrid.getLightData().data();
+	const int cellIndex = this->lightGrid.getCellIndex(x, y, z);
+	const int start = cellRefs[cellIndex * 2];
+	const int end = start + cellRefs[(cellIndex * 2) + 1];
+	for (int i = start; i < end; ++i)
+	{
+		const float *light = lightData + (cellLights[i] * LightGrid::LIGHT_FLOATS);
+		const float toLightX = light[0] - pointX;
+		const float toLightY = light[1] - pointY;
+		const float toLightZ = light[2] - pointZ;
+		const float radius = light[3];
+		const float distanceSquared = (toLightX * toLightX) + (toLightY * toLightY) +
+			(toLightZ * toLightZ);
+		if ((distanceSquared >= (radius * radius)) || (distanceSquared < RAY_EPSILON))
+		{
+			continue;
+		}
+
+		const float distance = std::sqrt(distanceSquared);
+		const float facing = ((normalX * toLightX) + (normalY * toLightY) +
+			(normalZ * toLightZ)) / distance;
+		if (facing <= 0.0f)
+		{
+			continue;
+		}
+
+		const float falloff = 1.0f - (distance / radius);
+		const float intensity = facing * falloff * falloff;
+		const float addR = light[4] * intensity;
+		const float addG = light[5] * intensity;
+		const float addB = light[6] * intensity;
+
+		// Use the share of lit shadow rays so far. A light the cache is sure about 
+		// doesn't need tracing, and the others compete for the shadow ray budget.
+		float guess = 1.0f;
+		if (this->shadowRays > 0)
+		{
+			const int entry = this->lightGrid.getVisibilityIndex(i, x, y, z);
+			const uint32_t samples = this->visibility[entry].load(std::memory_order_relaxed);
+			const int litCount = static_cast<int>(samples & VISIBILITY_LIT_MASK);
+			const int blockedCount = static_cast<int>(samples >> VISIBILITY_BLOCKED_SHIFT);
+			if ((litCount + blockedCount) > 0)
+			{
+				guess = static_cast<float>(litCount) /
+					static_cast<float>(litCount + blockedCount);
+			}
+
+			const bool settled =
+				((litCount >= LightGrid::VISIBILITY_SAMPLES) && (blockedCount == 0)) ||
+				((blockedCount >= LightGrid::VISIBILITY_SAMPLES) && (litCount == 0));
+			const float weight = addR + addG + addB;
+			if (!settled && ((candidateCount < this->shadowRays) ||
+				(weight > candidates[candidateCount - 1].weight)))
+			{
+				// Insertion into the few candidates kept, dropping the least important.
+				int slot = std::min(candidateCount, this->shadowRays - 1);
+				while ((slot > 0) && (candidates[slot - 1].weight < weight))
+				{
+					candidates[slot] = candidates[slot - 1];
+					--slot;
+				}
+
+				candidates[slot] = { weight, light[0], light[1], light[2], addR, addG,
+					addB, guess, entry };
+				candidateCount = std::min(candidateCount + 1, this->shadowRays);
+			}
+		}
+
+		shadeR += addR * guess;
+		shadeG += addG * guess;
+		shadeB += addB * guess;
+	}
+
+	// Trace the candidates' shadow rays, replacing their guesses, and count what each
+	// ray saw in the cache.
+	const float originX = pointX + (normalX * SHADOW_BIAS);
+	const float originY = pointY + (normalY * SHADOW_BIAS);
+	const float originZ = pointZ + (normalZ * SHADOW_BIAS);
+	for (int i = 0; i < candidateCount; ++i)
+	{
+		const ShadowCandidate &candidate = candidates[i];
+		const float toLightX = candidate.lightX - originX;
+		const float toLightY = candidate.lightY - originY;
+		const float toLightZ = candidate.lightZ - originZ;
+		const float distance = std::sqrt((toLightX * toLightX) + (toLightY * toLightY) +
+			(toLightZ * toLightZ));
+		const bool blocked = (distance > RAY_EPSILON) && this->isOccluded(originX,
+			originY, originZ, toLightX / distance, toLightY / distance,
+			toLightZ / distance, distance);
+
+		const float change = (blocked ? 0.0f : 1.0f) - candidate.guess;
+		shadeR += candidate.addR * change;
+		shadeG += candidate.addG * change;
+		shadeB += candidate.addB * change;
+
+		std::atomic<uint32_t> &samples = this->visibility[candidate.entry];
+		const uint32_t oldSamples = samples.load(std::memory_order_relaxed);
+		if (static_cast<int>((oldSamples & VISIBILITY_LIT_MASK) +
+			(oldSamples >> VISIBILITY_BLOCKED_SHIFT)) < LightGrid::MAX_VISIBILITY_SAMPLES)
+		{
+			samples.fetch_add(blocked ? (1u << VISIBILITY_BLOCKED_SHIFT) : 1u,
+				std::memory_order_relaxed);
+		}
+	}
+
+	return shadeColor(this->framePalette[index], shadeR, shadeG, shadeB);
+}
+
+void SoftwareRenderer::setPalette(PaletteName paletteName)
+{
+	this->setPalettes(paletteName, paletteName);
+}
+
+void SoftwareRenderer::setPalettes(PaletteName nightPalette, PaletteName dayPalette)
+{
+	this->nightPalette = this->textureManager.getPalette(nightPalette);
+	this->dayPalette = this->textureManager.getPalette(dayPalette);
+}
+
+void SoftwareRenderer::resize(int width, int height, Renderer &renderer)
+{
+	assert(width > 0);
+	assert(height > 0);
+
+	if ((width == this->width) && (height == this->height))
+	{
+		return;
+	}
+
+	// No frame is being rendered here, since render() waits for its threads.
+	SDL_DestroyTexture(this->texture);
+
+	this->width = width;
+	this->height = height;
+
+	this->createFrameBuffer(renderer);
+}
+
+void SoftwareRenderer::setVoxel(int x, int y, int z, VoxelType voxelType,
+	int textureIndex)
+{
+	const int voxelIndex = this->getVoxelIndex(x, y, z);
+
+	// The voxel's own triangles (if any) are left where they are, so their space can
+	// be reused if the voxel gets its own triangles again.
+	this->voxelRefs.at(voxelIndex) = (voxelType == VoxelType::Air) ?
+		VoxelReference(0, 0) : this->getVoxelTemplate(voxelType, textureIndex);
+	this->lightGrid.markVoxelChanged(x, y, z);
+}
+
+void SoftwareRenderer::setVoxelTriangles(int x, int y, int z,
+	const std::vector<Triangle> &triangles, int textureIndex)
+{
+	const int voxelIndex = this->getVoxelIndex(x, y, z);
+	const int count = static_cast<int>(triangles.size());
+	int offset = 0;
+
+	// Reuse the voxel's own triangles if there's room. Otherwise, add new ones.
+	auto runIter = this->voxelTriangleRuns.find(voxelIndex);
+	if ((runIter != this->voxelTriangleRuns.end()) &&
+		(runIter->second.getTriangleCount() >= count))
+	{
+		offset = runIter->second.getOffset();
+	}
+	else if (count > 0)
+	{
+		offset = this->allocateTriangles(count);
+		this->voxelTriangleRuns.erase(voxelIndex);
+		this->voxelTriangleRuns.insert(std::make_pair(
+			voxelIndex, VoxelReference(offset, count)));
+	}
+
+	if (count > 0)
+	{
+		this->writeTriangles(triangles, textureIndex, offset);
+	}
+
+	this->voxelRefs.at(voxelIndex) = VoxelReference(offset, count);
+	this->lightGrid.markVoxelChanged(x, y, z);
+}
+
+int SoftwareRenderer::addLight(const Float3d &point, const Float3d &color, double radius)
+{
+	return this->lightGrid.addLight(point, color, radius);
+}
+
+void SoftwareRenderer::setLight(int id, const Float3d &point, const Float3d &color,
+	double radius)
+{
+	this->lightGrid.setLight(id, point, color, radius);
+}
+
+void SoftwareRenderer::removeLight(int id)
+{
+	this->lightGrid.removeLight(id);
+}
+
+void SoftwareRenderer::setSprite(int id, const Float3d &position, double width,
+	double height, int textureIndex)
+{
+	this->spriteGrid.setSprite(id, position, width, height, textureIndex);
+}
+
+void SoftwareRenderer::removeSprite(int id)
+{
+	this->spriteGrid.removeSprite(id);
+}
+
+void SoftwareRenderer::updateCamera(const Float3d &eye, const Float3d &direction,
+	double fovY)
+{
+	// Do not scale the direction beforehand.
+	assert(direction.isNormalized());
+
+	this->spriteGrid.setFacing(direction);
+
+	const Float3d right = direction.cross(Directable::getGlobalUp()).normalized();
+	const Float3d up = right.cross(direction).normalized();
+
+	this->eye = { static_cast<float>(eye.getX()), static_cast<float>(eye.getY()),
+		static_cast<float>(eye.getZ()) };
+	this->forward = { static_cast<float>(direction.getX()),
+		static_cast<float>(direction.getY()), static_cast<float>(direction.getZ()) };
+	this->right = { static_cast<float>(right.getX()), static_cast<float>(right.getY()),
+		static_cast<float>(right.getZ()) };
+	this->up = { static_cast<float>(up.getX()), static_cast<float>(up.getY()),
+		static_cast<float>(up.getZ()) };
+
+	// Zoom is a function of field of view.
+	this->zoom = static_cast<float>(1.0 / std::tan(fovY * 0.5 * DEG_TO_RAD));
+}
+
+void SoftwareRenderer::updateGameTime(double gameTime)
+{
+	assert(gameTime >= 0.0);
+
+	// Blend from the night palette at midnight to the day palette at noon.
+	const double dayPercent = std::fmod(gameTime, DAY_LENGTH) / DAY_LENGTH;
+	this->daylight = 0.5 - (0.5 * std::cos(dayPercent * 2.0 * PI));
+}
+
+void SoftwareRenderer::render(Renderer &renderer)
+{
+	// Get this frame's colors for the time of day.
+	for (int i = 0; i < static_cast<int>(this->framePalette.size()); ++i)
+	{
+		this->framePalette.at(i) = blendColors(this->nightPalette.at(i),
+			this->dayPalette.at(i), this->daylight);
+	}
+
+	this->skyColor = blendColors(NIGHT_SKY_COLOR, DAY_SKY_COLOR, this->daylight);
+
+	// Put sprites and lights that changed since the last frame in their voxels and
+	// cells, and forget shadows that might have changed.
+	this->updateSprites();
+	this->lightGrid.update();
+	this->clearStaleVisibility();
+
+	// Start the render threads on this frame's strips, and help with them.
+	this->nextStrip = 0;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		++this->frameNumber;
+		this->threadsDone = 0;
+	}
+
+	this->startCondition.notify_all();
+	this->renderStrips();
+
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->doneCondition.wait(lock, [this]()
+		{
+			return this->threadsDone == static_cast<int>(this->threads.size());
+		});
+	}
+
+	// Update the frame buffer texture and draw it to the renderer.
+	SDL_UpdateTexture(this->texture, nullptr, this->frameBuffer.data(),
+		this->width * sizeof(uint32_t));
+	renderer.drawToNative(this->texture);
+}
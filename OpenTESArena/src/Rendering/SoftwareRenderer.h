@@ -0,0 +1,181 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LightGrid.h"
+#include "SpriteGrid.h"
+#include "TextureReference.h"
+#include "WorldRenderer.h"
+#include "../Media/Color.h"
+#include "../World/VoxelReference.h"
+
+// The software renderer draws the same world as the OpenCL program, but in plain C++
+// on the CPU, so the game still runs without an OpenCL platform, and there's a
+// baseline to compare the kernels against.
+
+// Each frame, the screen is cut into strips of rows that a pool of threads take turns
+// rendering. A ray steps through the voxel grid one cell at a time and is tested
+// against the triangles of each non-empty voxel it enters, in voxel-local coordinates.
+// Triangles are kept as a structure of arrays of floats, with their edges already
+// worked out, so the intersection loop only does float math on contiguous data.
+
+// Sprites' triangles are kept in a region of the triangle arrays in world coordinates,
+// and each voxel the ray visits has its sprites tested along with its own triangles.
+
+// Hits are lit by the point lights in their cell of the light grid, on top of the
+// flat shading of walls and floors. With shadows, each hit traces shadow rays to its
+// most important lights, up to a budget, and keeps the light grid's visibility cache
+// like the kernels do. Sprites don't cast shadows.
+
+class Options;
+class Renderer;
+class TextureManager;
+class Triangle;
+
+enum class PaletteName;
+enum class VoxelType;
+
+struct SDL_Texture;
+
+class SoftwareRenderer : public WorldRenderer
+{
+private:
+	// Each triangle's first point, its two edges from the first point, its normal, and
+	// its texture coordinates at the first point and along each edge.
+	std::vector<float> p1X, p1Y, p1Z, edge1X, edge1Y, edge1Z, edge2X, edge2Y, edge2Z,
+		normalX, normalY, normalZ, uv1X, uv1Y, uvEdge1X, uvEdge1Y, uvEdge2X, uvEdge2Y;
+	std::vector<int> triangleTextures; // Index into textureRefs of each triangle.
+	int triangleCount; // Triangles used in the arrays above.
+
+	std::vector<VoxelReference> voxelRefs; // Triangles of each voxel.
+	std::map<std::pair<VoxelType, int>, VoxelReference> voxelTemplates; // Shared triangles.
+	std::unordered_map<int, VoxelReference> voxelTriangleRuns; // Space for voxels' own triangles.
+	std::vector<uint8_t> texels; // Palette indices of every texture, one after another.
+	std::vector<TextureReference> textureRefs; // Where each texture is in texels.
+	LightGrid lightGrid;
+	SpriteGrid spriteGrid;
+	VoxelReference spriteTriangleRun; // Sprite triangle region in the triangle arrays.
+	// The light grid's visibility cache. Render threads count shadow rays into it 
+	// while shading, so it's mutable.
+	mutable std::vector<std::atomic<uint32_t>> visibility;
+	int shadowRays; // Most shadow rays each hit may trace. 0 for no shadows.
+
+	std::array<Color, 256> nightPalette, dayPalette;
+	std::array<uint32_t, 256> framePalette; // ARGB colors for the current time of day.
+	uint32_t skyColor; // ARGB color of rays that hit nothing.
+	double daylight; // 0 at midnight, 1 at noon.
+
+	// Camera, in floats for the ray loops.
+	std::array<float, 3> eye, forward, right, up;
+	float zoom;
+
+	std::vector<uint32_t> frameBuffer; // ARGB pixels of the current frame.
+	SDL_Texture *texture; // Streaming texture the frame buffer is copied to.
+	TextureManager &textureManager;
+	int width, height, worldWidth, worldHeight, worldDepth;
+
+	// The render threads wait for the frame number to change, then take strips until
+	// there are none left. The thread calling render() takes strips too.
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable startCondition, doneCondition;
+	std::atomic<int> nextStrip;
+	int frameNumber, threadsDone;
+	bool stopping;
+
+	// Gets the index of a voxel in the 1D voxel reference array.
+	int getVoxelIndex(int x, int y, int z) const;
+
+	// Makes room for the given number of triangles at the end of the triangle arrays,
+	// and returns the offset of the first one.
+	int allocateTriangles(int count);
+
+	// Writes triangles into the triangle arrays at the given offset.
+	void writeTriangles(const std::vector<Triangle> &triangles, int textureIndex,
+		int offset);
+
+	// Gets a voxel reference to the shared triangles of a voxel type with the given
+	// texture, adding the triangles the first time they're needed.
+	VoxelReference getVoxelTemplate(VoxelType voxelType, int textureIndex);
+
+	// Moves and turns changed sprites, and writes their triangles to the sprite 
+	// triangle region, which grows as needed.
+	void updateSprites();
+
+	// Clears the visibility entries that went stale since the last frame, after the
+	// light grid is updated. The cache grows with the cell lights.
+	void clearStaleVisibility();
+
+	// Creates the frame buffer and its texture for the current screen dimensions.
+	void createFrameBuffer(Renderer &renderer);
+
+	virtual void loadTextures(const std::vector<std::string> &filenames) override;
+
+	// Body of each render thread.
+	void runThread();
+
+	// Renders strips of the frame until there are none left.
+	void renderStrips();
+
+	// Renders the rows in [startRow, endRow) to the frame buffer.
+	void renderRows(int startRow, int endRow);
+
+	// Gets the color of a ray from the eye in the given direction.
+	uint32_t castRay(float dirX, float dirY, float dirZ) const;
+
+	// Tests a ray (in the voxel's local coordinates) against a voxel's triangles. If
+	// it hits something that isn't transparent, the distance along the ray, the
+	// triangle, and the texel's palette index are set and true is returned.
+	bool intersectVoxel(const VoxelReference &voxelRef, float originX, float originY,
+		float originZ, float dirX, float dirY, float dirZ, float &hitT, int &hitTriangle,
+		uint8_t &hitIndex) const;
+
+	// Returns whether a ray from a point in the world hits a voxel's triangles before
+	// the given distance.
+	bool isOccluded(float originX, float originY, float originZ, float dirX, float dirY,
+		float dirZ, float distance) const;
+
+	// Gets the color of a hit point in a voxel, lit by the lights in its cell.
+	uint32_t shadeHit(int x, int y, int z, float pointX, float pointY, float pointZ,
+		float dirX, float dirY, float dirZ, int triangle, uint8_t index) const;
+public:
+	SoftwareRenderer(int width, int height, int worldWidth, int worldHeight,
+		int worldDepth, const Options &options, TextureManager &textureManager,
+		Renderer &renderer);
+	SoftwareRenderer(const SoftwareRenderer&) = delete;
+	virtual ~SoftwareRenderer();
+
+	SoftwareRenderer &operator=(const SoftwareRenderer&) = delete;
+
+	virtual void setPalette(PaletteName paletteName) override;
+	virtual void setPalettes(PaletteName nightPalette, PaletteName dayPalette) override;
+	virtual void resize(int width, int height, Renderer &renderer) override;
+	virtual void setVoxel(int x, int y, int z, VoxelType voxelType,
+		int textureIndex) override;
+	virtual void setVoxelTriangles(int x, int y, int z,
+		const std::vector<Triangle> &triangles, int textureIndex) override;
+	virtual int addLight(const Float3d &point, const Float3d &color,
+		double radius) override;
+	virtual void setLight(int id, const Float3d &point, const Float3d &color,
+		double radius) override;
+	virtual void removeLight(int id) override;
+	virtual void setSprite(int id, const Float3d &position, double width, double height,
+		int textureIndex) override;
+	virtual void removeSprite(int id) override;
+	virtual void updateCamera(const Float3d &eye, const Float3d &direction,
+		double fovY) override;
+	virtual void updateGameTime(double gameTime) override;
+	virtual void render(Renderer &renderer) override;
+};
+
+#endif
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "SpriteGrid.h"
+
+#include "../Entities/Directable.h"
+#include "../Math/Float2.h"
+
+namespace
+{
+	// Sprites are turned again when the camera turns more than about a degree, since
+	// turning them writes every sprite's triangles.
+	const double MIN_FACING_COS = 0.9998;
+}
+
+SpriteGrid::SpriteGrid(int worldWidth, int worldHeight, int worldDepth)
+	: right(1.0, 0.0, 0.0)
+{
+	assert(worldWidth > 0);
+	assert(worldHeight > 0);
+	assert(worldDepth > 0);
+
+	this->worldWidth = worldWidth;
+	this->worldHeight = worldHeight;
+	this->worldDepth = worldDepth;
+
+	// Every voxel starts with no sprites.
+	const int voxelCount = worldWidth * worldHeight * worldDepth;
+	this->spriteRefs = std::vector<int>(voxelCount * 2, 0);
+	this->dirtyRefs.push_back(std::make_pair(0, voxelCount));
+}
+
+SpriteGrid::~SpriteGrid()
+{
+
+}
+
+void SpriteGrid::markSlotDirty(int slot)
+{
+	if (!this->slotsDirty.at(slot))
+	{
+		this->slotsDirty.at(slot) = true;
+		this->dirtySlots.push_back(slot);
+	}
+}
+
+std::vector<int> SpriteGrid::getVoxels(const Float3d &position, double width,
+	double height) const
+{
+	std::vector<int> voxels;
+	if ((width <= 0.0) || (height <= 0.0))
+	{
+		return voxels;
+	}
+
+	// The quad's horizontal reach is the same whichever way it faces.
+	const double halfWidth = width * 0.5;
+	const int minX = std::max(static_cast<int>(std::floor(position.getX() - halfWidth)), 0);
+	const int maxX = std::min(static_cast<int>(std::floor(position.getX() + halfWidth)),
+		this->worldWidth - 1);
+	const int minY = std::max(static_cast<int>(std::floor(position.getY())), 0);
+	const int maxY = std::min(static_cast<int>(std::floor(position.getY() + height)),
+		this->worldHeight - 1);
+	const int minZ = std::max(static_cast<int>(std::floor(position.getZ() - halfWidth)), 0);
+	const int maxZ = std::min(static_cast<int>(std::floor(position.getZ() + halfWidth)),
+		this->worldDepth - 1);
+
+	// The voxel indices come out sorted.
+	for (int k = minZ; k <= maxZ; ++k)
+	{
+		for (int j = minY; j <= maxY; ++j)
+		{
+			for (int i = minX; i <= maxX; ++i)
+			{
+				voxels.push_back(i + (j * this->worldWidth) +
+					(k * this->worldWidth * this->worldHeight));
+			}
+		}
+	}
+
+	return voxels;
+}
+
+void SpriteGrid::writeVoxelRun(int voxelIndex)
+{
+	auto spritesIter = this->voxelSprites.find(voxelIndex);
+	const int count = (spritesIter != this->voxelSprites.end()) ?
+		static_cast<int>(spritesIter->second.size()) : 0;
+
+	// Give the voxel's run back if it's no longer needed or is too small.
+	auto runIter = this->voxelRuns.find(voxelIndex);
+	if ((runIter != this->voxelRuns.end()) &&
+		((count == 0) || (count > runIter->second.second)))
+	{
+		int level = 0;
+		while ((1 << level) < runIter->second.second)
+		{
+			level++;
+		}
+
+		this->freeRuns.at(level).push_back(runIter->second.first);
+		this->voxelRuns.erase(runIter);
+		runIter = this->voxelRuns.end();
+	}
+
+	// Get a run with room for the sprites, rounded up to a power of two so runs can
+	// be reused by other voxels.
+	if ((count > 0) && (runIter == this->voxelRuns.end()))
+	{
+		int level = 0;
+		while ((1 << level) < count)
+		{
+			level++;
+		}
+
+		if (static_cast<int>(this->freeRuns.size()) <= level)
+		{
+			this->freeRuns.resize(level + 1);
+		}
+
+		int offset = static_cast<int>(this->spriteIndices.size());
+		if (this->freeRuns.at(level).size() > 0)
+		{
+			offset = this->freeRuns.at(level).back();
+			this->freeRuns.at(level).pop_back();
+		}
+		else
+		{
+			this->spriteIndices.resize(offset + (1 << level), 0);
+		}
+
+		runIter = this->voxelRuns.insert(std::make_pair(
+			voxelIndex, std::make_pair(offset, 1 << level))).first;
+	}
+
+	int offset = 0;
+	if (count > 0)
+	{
+		offset = runIter->second.first;
+		std::copy(spritesIter->second.begin(), spritesIter->second.end(),
+			this->spriteIndices.begin() + offset);
+		this->dirtyIndices.push_back(std::make_pair(offset, offset + count));
+	}
+
+	this->spriteRefs.at(voxelIndex * 2) = offset;
+	this->spriteRefs.at((voxelIndex * 2) + 1) = count;
+	this->dirtyRefs.push_back(std::make_pair(voxelIndex, voxelIndex + 1));
+}
+
+bool SpriteGrid::isDirty() const
+{
+	return this->dirtySlots.size() > 0;
+}
+
+int SpriteGrid::getSlotCount() const
+{
+	return static_cast<int>(this->positions.size());
+}
+
+std::vector<Triangle> SpriteGrid::getTriangles(int slot) const
+{
+	const Float3d &position = this->positions.at(slot);
+	const Float3d halfRight = this->right * (this->widths.at(slot) * 0.5);
+	const Float3d up = Directable::getGlobalUp() * this->heights.at(slot);
+
+	const Float3d bottomLeft = position - halfRight;
+	const Float3d bottomRight = position + halfRight;
+	const Float3d topLeft = bottomLeft + up;
+	const Float3d topRight = bottomRight + up;
+
+	// The top of the texture is at V = 0, like voxel faces.
+	return std::vector<Triangle>
+	{
+		Triangle(bottomLeft, bottomRight, topRight,
+			Float2d(0.0, 1.0), Float2d(1.0, 1.0), Float2d(1.0, 0.0)),
+		Triangle(bottomLeft, topRight, topLeft,
+			Float2d(0.0, 1.0), Float2d(1.0, 0.0), Float2d(0.0, 0.0))
+	};
+}
+
+int SpriteGrid::getTextureIndex(int slot) const
+{
+	return this->textureIndices.at(slot);
+}
+
+const std::vector<int> &SpriteGrid::getUpdatedSlots() const
+{
+	return this->updatedSlots;
+}
+
+const std::vector<int> &SpriteGrid::getSpriteRefs() const
+{
+	return this->spriteRefs;
+}
+
+const std::vector<int> &SpriteGrid::getSpriteIndices() const
+{
+	return this->spriteIndices;
+}
+
+std::vector<std::pair<int, int>> SpriteGrid::popDirtyRefs()
+{
+	std::vector<std::pair<int, int>> ranges;
+	ranges.swap(this->dirtyRefs);
+	return ranges;
+}
+
+std::vector<std::pair<int, int>> SpriteGrid::popDirtyIndices()
+{
+	std::vector<std::pair<int, int>> ranges;
+	ranges.swap(this->dirtyIndices);
+	return ranges;
+}
+
+void SpriteGrid::setSprite(int id, const Float3d &position, double width, double height,
+	int textureIndex)
+{
+	assert(width > 0.0);
+	assert(height > 0.0);
+	assert(textureIndex >= 0);
+
+	int slot = 0;
+	auto slotIter = this->slots.find(id);
+	if (slotIter != this->slots.end())
+	{
+		slot = slotIter->second;
+
+		// Most sprites don't change most frames.
+		const Float3d &oldPosition = this->positions.at(slot);
+		if ((oldPosition.getX() == position.getX()) &&
+			(oldPosition.getY() == position.getY()) &&
+			(oldPosition.getZ() == position.getZ()) &&
+			(this->widths.at(slot) == width) && (this->heights.at(slot) == height) &&
+			(this->textureIndices.at(slot) == textureIndex))
+		{
+			return;
+		}
+	}
+	else if (this->freeSlots.size() > 0)
+	{
+		slot = this->freeSlots.back();
+		this->freeSlots.pop_back();
+		this->slots.insert(std::make_pair(id, slot));
+	}
+	else
+	{
+		slot = this->getSlotCount();
+		this->positions.push_back(Float3d());
+		this->widths.push_back(0.0);
+		this->heights.push_back(0.0);
+		this->textureIndices.push_back(0);
+		this->slotVoxels.push_back(std::vector<int>());
+		this->slotsDirty.push_back(false);
+		this->slots.insert(std::make_pair(id, slot));
+	}
+
+	this->positions.at(slot) = position;
+	this->widths.at(slot) = width;
+	this->heights.at(slot) = height;
+	this->textureIndices.at(slot) = textureIndex;
+	this->markSlotDirty(slot);
+}
+
+void SpriteGrid::removeSprite(int id)
+{
+	auto slotIter = this->slots.find(id);
+	if (slotIter == this->slots.end())
+	{
+		return;
+	}
+
+	// A sprite with no size isn't in any voxel, so the slot's triangles are left alone
+	// until the slot is used again.
+	const int slot = slotIter->second;
+	this->widths.at(slot) = 0.0;
+	this->heights.at(slot) = 0.0;
+	this->markSlotDirty(slot);
+	this->freeSlots.push_back(slot);
+	this->slots.erase(slotIter);
+}
+
+void SpriteGrid::setFacing(const Float3d &direction)
+{
+	const Float3d newRight = direction.cross(Directable::getGlobalUp()).normalized();
+
+	// Looking straight up or down has no facing, so keep the old one.
+	if (!std::isfinite(newRight.length()) ||
+		(newRight.dot(this->right) >= MIN_FACING_COS))
+	{
+		return;
+	}
+
+	this->right = newRight;
+
+	for (int i = 0; i < this->getSlotCount(); ++i)
+	{
+		if (this->widths.at(i) > 0.0)
+		{
+			this->markSlotDirty(i);
+		}
+	}
+}
+
+void SpriteGrid::update()
+{
+	this->updatedSlots.clear();
+
+	// Move each changed sprite out of the voxels it left and into the ones it entered.
+	std::vector<int> changedVoxels;
+	for (const int slot : this->dirtySlots)
+	{
+		this->slotsDirty.at(slot) = false;
+
+		std::vector<int> &oldVoxels = this->slotVoxels.at(slot);
+		const std::vector<int> newVoxels = this->getVoxels(this->positions.at(slot),
+			this->widths.at(slot), this->heights.at(slot));
+
+		if (newVoxels != oldVoxels)
+		{
+			for (const int voxelIndex : oldVoxels)
+			{
+				if (!std::binary_search(newVoxels.begin(), newVoxels.end(), voxelIndex))
+				{
+					std::vector<int> &sprites = this->voxelSprites.at(voxelIndex);
+					sprites.erase(std::find(sprites.begin(), sprites.end(), slot));
+					if (sprites.size() == 0)
+					{
+						this->voxelSprites.erase(voxelIndex);
+					}
+
+					changedVoxels.push_back(voxelIndex);
+				}
+			}
+
+			for (const int voxelIndex : newVoxels)
+			{
+				if (!std::binary_search(oldVoxels.begin(), oldVoxels.end(), voxelIndex))
+				{
+					this->voxelSprites[voxelIndex].push_back(slot);
+					changedVoxels.push_back(voxelIndex);
+				}
+			}
+
+			oldVoxels = newVoxels;
+		}
+
+		if (this->widths.at(slot) > 0.0)
+		{
+			this->updatedSlots.push_back(slot);
+		}
+	}
+
+	this->dirtySlots.clear();
+
+	// Write the sprite lists of voxels that changed.
+	std::sort(changedVoxels.begin(), changedVoxels.end());
+	changedVoxels.erase(std::unique(changedVoxels.begin(), changedVoxels.end()),
+		changedVoxels.end());
+
+	for (const int voxelIndex : changedVoxels)
+	{
+		this->writeVoxelRun(voxelIndex);
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef SPRITE_GRID_H
+#define SPRITE_GRID_H
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../Math/Float3.h"
+#include "../Math/Triangle.h"
+
+// The sprite grid keeps the camera-facing sprites of entities (NPCs, items, doodads)
+// as quads of two triangles in world coordinates, and lists which sprites are in each
+// voxel, so a ray only tests the sprites of the voxels it visits. A sprite is listed
+// in every voxel its quad could reach at any facing.
+
+// Sprites are kept in slots, and each slot's triangles have a fixed place in the
+// renderer's sprite triangle region (two triangles per slot), so a sprite that moves
+// only rewrites its own two triangles. All sprites turn together to face the camera,
+// and are only turned again when the camera turns noticeably.
+
+// Each voxel with sprites has a run of the sprite indices (slots, one after another)
+// with room to grow, and its sprite reference (offset, count) points at the run.
+// Changes to the references and indices are tracked as dirty ranges, so only what
+// changed needs writing to the device.
+
+class SpriteGrid
+{
+private:
+	std::vector<Float3d> positions; // Bottom middle of each slot's sprite.
+	std::vector<double> widths, heights;
+	std::vector<int> textureIndices;
+	std::vector<std::vector<int>> slotVoxels; // Voxels each slot is listed in.
+	std::vector<bool> slotsDirty; // Whether each slot's triangles need writing.
+	std::vector<int> dirtySlots, updatedSlots, freeSlots;
+	std::unordered_map<int, int> slots; // Sprite ID -> slot.
+	std::unordered_map<int, std::vector<int>> voxelSprites; // Voxel -> slots.
+	std::unordered_map<int, std::pair<int, int>> voxelRuns; // Voxel -> (offset, room).
+	std::vector<std::vector<int>> freeRuns; // Offsets of free runs, by log2 of room.
+	std::vector<int> spriteRefs, spriteIndices;
+	std::vector<std::pair<int, int>> dirtyRefs, dirtyIndices; // [begin, end) ranges.
+	Float3d right; // Direction from the left to the right side of every sprite.
+	int worldWidth, worldHeight, worldDepth;
+
+	// Marks a slot's sprite as needing its triangles and voxels updated.
+	void markSlotDirty(int slot);
+
+	// Gets the voxels a sprite could reach.
+	std::vector<int> getVoxels(const Float3d &position, double width,
+		double height) const;
+
+	// Writes a voxel's sprite list to its run of the sprite indices, moving it to a
+	// bigger run if it doesn't fit.
+	void writeVoxelRun(int voxelIndex);
+public:
+	SpriteGrid(int worldWidth, int worldHeight, int worldDepth);
+	~SpriteGrid();
+
+	// Returns whether a sprite changed or the sprites turned since the last update.
+	bool isDirty() const;
+
+	// Gets the number of slots, including free ones. The sprite triangle region needs
+	// room for two triangles per slot.
+	int getSlotCount() const;
+
+	// Gets a slot's sprite triangles, facing the camera.
+	std::vector<Triangle> getTriangles(int slot) const;
+
+	// Gets the texture index of a slot's sprite.
+	int getTextureIndex(int slot) const;
+
+	// Gets the slots whose triangles changed in the last update.
+	const std::vector<int> &getUpdatedSlots() const;
+
+	// Gets the two ints (offset into the sprite indices, sprite count) of each voxel.
+	const std::vector<int> &getSpriteRefs() const;
+
+	// Gets the sprite slots of every voxel's run.
+	const std::vector<int> &getSpriteIndices() const;
+
+	// Gets the [begin, end) ranges of sprite references (in voxels) and sprite indices
+	// changed since the last call, and forgets them. At first, every reference is
+	// dirty, so the device starts with every voxel empty.
+	std::vector<std::pair<int, int>> popDirtyRefs();
+	std::vector<std::pair<int, int>> popDirtyIndices();
+
+	// Adds or changes the sprite with the given ID (i.e., an entity ID). The position
+	// is the bottom middle of the sprite, and the size is in voxels.
+	void setSprite(int id, const Float3d &position, double width, double height,
+		int textureIndex);
+
+	// Removes the sprite with the given ID, if there is one.
+	void removeSprite(int id);
+
+	// Turns the sprites to face a camera looking in the given direction, if it turned
+	// enough since they were last turned.
+	void setFacing(const Float3d &direction);
+
+	// Moves changed sprites between voxels and gets which slots need new triangles.
+	void update();
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <cassert>
+#include <cstdint>
+
+#include "TrianglePacker.h"
+
+#include "TextureReference.h"
+#include "../Math/Triangle.h"
+#include "../Utilities/Debug.h"
+
+namespace
+{
+	// Writes a point or direction into a stream at the given pointer as a float4.
+	void writeFloat4(const Float3d &v, char *ptr)
+	{
+		float *floatPtr = reinterpret_cast<float*>(ptr);
+		*(floatPtr + 0) = static_cast<float>(v.getX());
+		*(floatPtr + 1) = static_cast<float>(v.getY());
+		*(floatPtr + 2) = static_cast<float>(v.getZ());
+		*(floatPtr + 3) = 0.0f;
+	}
+
+	// Writes a texture coordinate into a stream at the given pointer as a float2.
+	void writeFloat2(const Float2d &v, char *ptr)
+	{
+		float *floatPtr = reinterpret_cast<float*>(ptr);
+		*(floatPtr + 0) = static_cast<float>(v.getX());
+		*(floatPtr + 1) = static_cast<float>(v.getY());
+	}
+
+	const int SIZEOF_FLOAT2 = sizeof(float) * 2;
+	const int SIZEOF_FLOAT4 = sizeof(float) * 4;
+}
+
+const std::array<TriangleStream, 5> TrianglePacker::STREAMS =
+{
+	TriangleStream::Positions,
+	TriangleStream::Edges,
+	TriangleStream::Normals,
+	TriangleStream::UVs,
+	TriangleStream::Textures
+};
+
+TrianglePacker::TrianglePacker()
+{
+	this->count = 0;
+}
+
+TrianglePacker::~TrianglePacker()
+{
+
+}
+
+int TrianglePacker::getStride(TriangleStream stream)
+{
+	if (stream == TriangleStream::Positions)
+	{
+		return SIZEOF_FLOAT4;
+	}
+	else if (stream == TriangleStream::Edges)
+	{
+		return SIZEOF_FLOAT4 * 2;
+	}
+	else if (stream == TriangleStream::Normals)
+	{
+		return SIZEOF_FLOAT4;
+	}
+	else if (stream == TriangleStream::UVs)
+	{
+		return SIZEOF_FLOAT2 * 3;
+	}
+	else if (stream == TriangleStream::Textures)
+	{
+		return sizeof(int32_t) + (sizeof(int16_t) * 2);
+	}
+	else
+	{
+		Debug::crash("TrianglePacker", "Invalid triangle stream.");
+		return 0;
+	}
+}
+
+int TrianglePacker::getCount() const
+{
+	return this->count;
+}
+
+const std::vector<char> &TrianglePacker::getData(TriangleStream stream) const
+{
+	return this->streams.at(static_cast<int>(stream));
+}
+
+void TrianglePacker::resize(int count)
+{
+	assert(count >= 0);
+
+	for (const auto stream : TrianglePacker::STREAMS)
+	{
+		this->streams.at(static_cast<int>(stream)).resize(
+			TrianglePacker::getStride(stream) * count);
+	}
+
+	this->count = count;
+}
+
+void TrianglePacker::write(int index, const Triangle &triangle,
+	const TextureReference &textureRef)
+{
+	assert(index >= 0);
+	assert(index < this->count);
+
+	auto getPtr = [this, index](TriangleStream stream)
+	{
+		return this->streams.at(static_cast<int>(stream)).data() +
+			(TrianglePacker::getStride(stream) * index);
+	};
+
+	writeFloat4(triangle.getP1(), getPtr(TriangleStream::Positions));
+
+	// The edges are all the intersection test needs besides the first point, so
+	// they're stored instead of the other two points.
+	char *edgePtr = getPtr(TriangleStream::Edges);
+	writeFloat4(triangle.getP2() - triangle.getP1(), edgePtr);
+	writeFloat4(triangle.getP3() - triangle.getP1(), edgePtr + SIZEOF_FLOAT4);
+
+	writeFloat4(triangle.getNormal(), getPtr(TriangleStream::Normals));
+
+	char *uvPtr = getPtr(TriangleStream::UVs);
+	writeFloat2(triangle.getUV1(), uvPtr);
+	writeFloat2(triangle.getUV2(), uvPtr + SIZEOF_FLOAT2);
+	writeFloat2(triangle.getUV3(), uvPtr + (SIZEOF_FLOAT2 * 2));
+
+	char *texturePtr = getPtr(TriangleStream::Textures);
+	*reinterpret_cast<int32_t*>(texturePtr) = textureRef.getOffset(); // Texels to skip.
+
+	int16_t *dimPtr = reinterpret_cast<int16_t*>(texturePtr + sizeof(int32_t));
+	*(dimPtr + 0) = static_cast<int16_t>(textureRef.getWidth());
+	*(dimPtr + 1) = static_cast<int16_t>(textureRef.getHeight());
+}
@@ -0,0 +1,54 @@
+#ifndef TRIANGLE_PACKER_H
+#define TRIANGLE_PACKER_H
+
+#include <array>
+#include <vector>
+
+#include "TriangleStream.h"
+
+// The triangle packer keeps the host copy of the renderer's triangles as a structure
+// of arrays, with one byte stream per group of fields, so the kernels only read the
+// fields they need. The edges from each triangle's first point are worked out here
+// once, instead of for every intersection test.
+
+// Each stream's element layout matches the kernel's:
+// - Positions: float4 (first point, w unused).
+// - Edges: two float4s (second and third points minus the first, w unused).
+// - Normals: float4 (w unused).
+// - UVs: three float2s.
+// - Textures: int texel offset, then short width and height.
+
+class TextureReference;
+class Triangle;
+
+class TrianglePacker
+{
+private:
+	static const int STREAM_COUNT = 5;
+
+	std::array<std::vector<char>, STREAM_COUNT> streams;
+	int count;
+public:
+	// Every stream, in the order their device buffers are given to the kernels.
+	static const std::array<TriangleStream, STREAM_COUNT> STREAMS;
+
+	TrianglePacker();
+	~TrianglePacker();
+
+	// Gets the number of bytes each triangle takes in a stream.
+	static int getStride(TriangleStream stream);
+
+	// Gets the number of triangles each stream has room for.
+	int getCount() const;
+
+	// Gets the bytes of a stream, for writing to the device.
+	const std::vector<char> &getData(TriangleStream stream) const;
+
+	// Changes the number of triangles in every stream. New triangles are zeroed.
+	void resize(int count);
+
+	// Writes a triangle's fields into each stream at the given index.
+	void write(int index, const Triangle &triangle, const TextureReference &textureRef);
+};
+
+#endif
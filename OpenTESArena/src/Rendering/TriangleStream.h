@@ -0,0 +1,19 @@
+#ifndef TRIANGLE_STREAM_H
+#define TRIANGLE_STREAM_H
+
+// A unique identifier for each group of triangle fields that is stored on its own.
+
+// Positions are each triangle's first point, and edges are the two edges from the
+// first point. They're all that's needed to test a ray against a triangle. Normals,
+// texture coordinates, and textures are only needed once a hit is found.
+
+enum class TriangleStream
+{
+	Positions,
+	Edges,
+	Normals,
+	UVs,
+	Textures
+};
+
+#endif
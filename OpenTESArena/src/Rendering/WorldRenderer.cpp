@@ -0,0 +1,128 @@
+#include <array>
+#include <map>
+
+#include "WorldRenderer.h"
+
+#include "../Math/Random.h"
+#include "../Media/PaletteName.h"
+#include "../Utilities/Debug.h"
+#include "../World/VoxelType.h"
+
+WorldRenderer::~WorldRenderer()
+{
+
+}
+
+void WorldRenderer::makeTestWorld(int worldWidth, int worldHeight, int worldDepth)
+{
+	Debug::mention("WorldRenderer", "Making test world.");
+
+	// This method builds a simple test city with some blocks around, a few torches,
+	// and a few sprites.
+
+	const int voxelCount = worldWidth * worldHeight * worldDepth;
+	auto getVoxelIndex = [worldWidth, worldHeight](int x, int y, int z)
+	{
+		return x + (y * worldWidth) + (z * worldWidth * worldHeight);
+	};
+
+	// Voxel type of each voxel in the test world.
+	std::vector<VoxelType> voxelTypes(voxelCount, VoxelType::Air);
+
+	// Texture indices of the voxel types in the test world. The actual mapping would
+	// depend on the climate and season.
+	const std::map<VoxelType, int> voxelTypeTextures =
+	{
+		{ VoxelType::Ground1, 1 },
+		{ VoxelType::Ground2, 2 },
+		{ VoxelType::Ground3, 3 },
+		{ VoxelType::Wall1, 0 },
+		{ VoxelType::Wall2, 4 }
+	};
+
+	// Load the textures (in the order of the indices above) and the palette.
+	this->loadTextures({ "T_CITYWL.IMG", "T_NGRASS.IMG", "T_NROAD.IMG", "T_NSDWLK.IMG",
+		"T_GARDEN.IMG" });
+	this->setPalette(PaletteName::Default);
+
+	// Use the same seed so it's not a new city on every screen resize.
+	Random random(2);
+
+	// Make the ground.
+	const std::array<VoxelType, 3> groundTypes =
+	{
+		VoxelType::Ground1, VoxelType::Ground2, VoxelType::Ground3
+	};
+
+	for (int k = 0; k < worldDepth; ++k)
+	{
+		for (int i = 0; i < worldWidth; ++i)
+		{
+			voxelTypes.at(getVoxelIndex(i, 0, k)) = groundTypes.at(random.next(3));
+		}
+	}
+
+	// Make the near X and far X walls.
+	for (int j = 1; j < worldHeight; ++j)
+	{
+		for (int k = 0; k < worldDepth; ++k)
+		{
+			voxelTypes.at(getVoxelIndex(0, j, k)) = VoxelType::Wall1;
+			voxelTypes.at(getVoxelIndex(worldWidth - 1, j, k)) = VoxelType::Wall1;
+		}
+	}
+
+	// Make the near Z and far Z walls (ignoring existing corners).
+	for (int j = 1; j < worldHeight; ++j)
+	{
+		for (int i = 1; i < (worldWidth - 1); ++i)
+		{
+			voxelTypes.at(getVoxelIndex(i, j, 0)) = VoxelType::Wall1;
+			voxelTypes.at(getVoxelIndex(i, j, worldDepth - 1)) = VoxelType::Wall1;
+		}
+	}
+
+	// Add some random blocks around, with a torch over some of them.
+	const Float3d torchColor(1.0, 0.65, 0.3);
+	const double torchRadius = 4.0;
+	for (int count = 0; count < 32; ++count)
+	{
+		int x = 1 + random.next(worldWidth - 2);
+		int y = 1;
+		int z = 1 + random.next(worldDepth - 2);
+
+		voxelTypes.at(getVoxelIndex(x, y, z)) = VoxelType::Wall2;
+
+		if ((count % 4) == 0)
+		{
+			const Float3d point(static_cast<double>(x) + 0.5, static_cast<double>(y) + 1.5,
+				static_cast<double>(z) + 0.5);
+			this->addLight(point, torchColor, torchRadius);
+		}
+	}
+
+	// Stand some sprites around, until there are entities to draw. Negative IDs don't
+	// clash with entity IDs.
+	for (int id = -1; id >= -16; --id)
+	{
+		const Float3d position(1.5 + random.nextReal() * (worldWidth - 3), 1.0,
+			1.5 + random.nextReal() * (worldDepth - 3));
+		this->setSprite(id, position, 0.6, 0.9, voxelTypeTextures.at(VoxelType::Wall2));
+	}
+
+	// Point each non-air voxel at the shared triangles of its voxel type.
+	for (int k = 0; k < worldDepth; ++k)
+	{
+		for (int j = 0; j < worldHeight; ++j)
+		{
+			for (int i = 0; i < worldWidth; ++i)
+			{
+				const VoxelType voxelType = voxelTypes.at(getVoxelIndex(i, j, k));
+				if (voxelType != VoxelType::Air)
+				{
+					this->setVoxel(i, j, k, voxelType, voxelTypeTextures.at(voxelType));
+				}
+			}
+		}
+	}
+}
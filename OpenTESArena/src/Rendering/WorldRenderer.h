@@ -0,0 +1,85 @@
+#ifndef WORLD_RENDERER_H
+#define WORLD_RENDERER_H
+
+#include <string>
+#include <vector>
+
+#include "../Math/Float3.h"
+
+// A world renderer draws the 3D game world. The game only talks to this interface, so
+// it doesn't need to know whether the world is drawn with OpenCL or in software. Both
+// use the same model: voxels point at triangles in voxel-local coordinates, and
+// triangles are textured with 8-bit palette indices that are colored by blending a
+// night and a day palette.
+
+// The world renderer should be kept alive while the game data object is alive, for
+// the same reason as the OpenCL program.
+
+class Renderer;
+class Triangle;
+
+enum class PaletteName;
+enum class VoxelType;
+
+class WorldRenderer
+{
+protected:
+	// Packs the palette indices of the given IMG files for the renderer to sample.
+	// Texture indices given to setVoxel() are positions in this list.
+	virtual void loadTextures(const std::vector<std::string> &filenames) = 0;
+
+	// For testing purposes before using actual world data. Builds a simple test city
+	// with the renderer's own methods.
+	void makeTestWorld(int worldWidth, int worldHeight, int worldDepth);
+public:
+	virtual ~WorldRenderer();
+
+	// Changes the palette that textures are drawn with at all times of day.
+	virtual void setPalette(PaletteName paletteName) = 0;
+
+	// Changes the palettes that textures are blended between over the course of a day
+	// (i.e., Dreary during the day when it's raining).
+	virtual void setPalettes(PaletteName nightPalette, PaletteName dayPalette) = 0;
+
+	// Changes the screen dimensions. The world stays as it is.
+	virtual void resize(int width, int height, Renderer &renderer) = 0;
+
+	// Changes a voxel to use the shared triangles of a voxel type. If the voxel had
+	// its own triangles, they are freed.
+	virtual void setVoxel(int x, int y, int z, VoxelType voxelType, int textureIndex) = 0;
+
+	// Gives a voxel its own triangles (in voxel-local coordinates), like when it
+	// starts fading due to Passwall.
+	virtual void setVoxelTriangles(int x, int y, int z,
+		const std::vector<Triangle> &triangles, int textureIndex) = 0;
+
+	// Adds a point light (a torch, a held light, a spell projectile) with the given
+	// color (where 1 is full brightness) and radius in voxels, and returns its ID.
+	virtual int addLight(const Float3d &point, const Float3d &color, double radius) = 0;
+
+	// Changes a light, like when it moves.
+	virtual void setLight(int id, const Float3d &point, const Float3d &color,
+		double radius) = 0;
+
+	// Removes a light. Its ID may be given to a later light.
+	virtual void removeLight(int id) = 0;
+
+	// Adds or changes the camera-facing sprite with the given ID (i.e., an entity ID).
+	// The position is the bottom middle of the sprite, and the size is in voxels.
+	virtual void setSprite(int id, const Float3d &position, double width, double height,
+		int textureIndex) = 0;
+
+	// Removes the sprite with the given ID, if there is one.
+	virtual void removeSprite(int id) = 0;
+
+	virtual void updateCamera(const Float3d &eye, const Float3d &direction,
+		double fovY) = 0;
+
+	// Give this method total ticks instead of delta time so the renderer doesn't need
+	// a "start time". The palette blend for the time of day is updated here, too.
+	virtual void updateGameTime(double gameTime) = 0;
+
+	virtual void render(Renderer &renderer) = 0;
+};
+
+#endif
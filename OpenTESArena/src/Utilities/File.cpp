@@ -5,6 +5,12 @@
 
 #include "Debug.h"
 
+bool File::exists(const std::string &filename)
+{
+	std::ifstream ifs(filename.c_str());
+	return ifs.good();
+}
+
 std::string File::toString(const std::string &filename)
 {
 	std::ifstream ifs(filename.c_str(), std::ios::in |
@@ -15,9 +21,28 @@ std::string File::toString(const std::string &filename)
 	auto fileSize = ifs.tellg();
 	ifs.seekg(0, std::ios::beg);
 
+	if (fileSize == 0)
+	{
+		return std::string();
+	}
+
 	std::vector<char> bytes(fileSize);
 	ifs.read(&bytes.at(0), fileSize);
 	ifs.close();
 
 	return std::string(&bytes.at(0), fileSize);
 }
+
+bool File::fromString(const std::string &filename, const std::string &text)
+{
+	std::ofstream ofs(filename.c_str(), std::ios::out |
+		std::ios::binary | std::ios::trunc);
+
+	if (!ofs.is_open())
+	{
+		return false;
+	}
+
+	ofs.write(text.data(), text.size());
+	return ofs.good();
+}
@@ -10,8 +10,15 @@ private:
 	File(const File&) = delete;
 	~File() = delete;
 public:
+	// Returns whether a file exists and can be opened for reading.
+	static bool exists(const std::string &filename);
+
 	// Reads a file into a string.
 	static std::string toString(const std::string &filename);
+
+	// Writes a string to a file, replacing anything that was there. Returns whether
+	// it succeeded.
+	static bool fromString(const std::string &filename, const std::string &text);
 };
 
 #endif
@@ -62,6 +62,11 @@ const std::string &KvpTextMap::getValue(const std::string &key) const
 	return pairs.at(key);
 }
 
+bool KvpTextMap::hasKey(const std::string &key) const
+{
+	return this->pairs.find(key) != this->pairs.end();
+}
+
 bool KvpTextMap::getBoolean(const std::string &key) const
 {
 	const std::string &value = this->getValue(key);
@@ -88,3 +93,24 @@ std::string KvpTextMap::getString(const std::string &key) const
 	const std::string &value = this->getValue(key);
 	return value;
 }
+
+bool KvpTextMap::getBoolean(const std::string &key, bool defaultValue) const
+{
+	return this->hasKey(key) ? this->getBoolean(key) : defaultValue;
+}
+
+int KvpTextMap::getInteger(const std::string &key, int defaultValue) const
+{
+	return this->hasKey(key) ? this->getInteger(key) : defaultValue;
+}
+
+double KvpTextMap::getDouble(const std::string &key, double defaultValue) const
+{
+	return this->hasKey(key) ? this->getDouble(key) : defaultValue;
+}
+
+std::string KvpTextMap::getString(const std::string &key,
+	const std::string &defaultValue) const
+{
+	return this->hasKey(key) ? this->getString(key) : defaultValue;
+}
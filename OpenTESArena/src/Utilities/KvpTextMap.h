@@ -22,10 +22,20 @@ public:
 	KvpTextMap(const std::string &filename);
 	~KvpTextMap();
 
+	// Returns whether the file has a pair with the given key.
+	bool hasKey(const std::string &key) const;
+
 	bool getBoolean(const std::string &key) const;
 	int getInteger(const std::string &key) const;
 	double getDouble(const std::string &key) const;
 	std::string getString(const std::string &key) const;
+
+	// Same as above, but the given default is returned if the key isn't in the file
+	// (i.e., for keys added after a user's file was written).
+	bool getBoolean(const std::string &key, bool defaultValue) const;
+	int getInteger(const std::string &key, int defaultValue) const;
+	double getDouble(const std::string &key, double defaultValue) const;
+	std::string getString(const std::string &key, const std::string &defaultValue) const;
 };
 
 #endif
@@ -29,12 +29,131 @@ const std::map<VoxelType, VoxelMaterialType> VoxelTypeMaterials =
 	// etc.
 };
 
+namespace
+{
+	// Makes the twelve triangles of a unit cube in voxel-local coordinates (that is,
+	// from (0, 0, 0) to (1, 1, 1)). The renderer moves rays into a voxel's space, so
+	// the same triangles can be shared by every voxel of a type.
+	std::vector<Triangle> makeCube()
+	{
+		const double sideLength = 1.0;
+
+		return std::vector<Triangle>
+		{
+			// Front.
+			Triangle(
+				Float3d(sideLength, sideLength, 0.0),
+				Float3d(sideLength, 0.0, 0.0),
+				Float3d(0.0, 0.0, 0.0),
+				Float2d(0.0, 0.0),
+				Float2d(0.0, 1.0),
+				Float2d(1.0, 1.0)),
+			Triangle(
+				Float3d(0.0, 0.0, 0.0),
+				Float3d(0.0, sideLength, 0.0),
+				Float3d(sideLength, sideLength, 0.0),
+				Float2d(1.0, 1.0),
+				Float2d(1.0, 0.0),
+				Float2d(0.0, 0.0)),
+
+			// Back.
+			Triangle(
+				Float3d(0.0, sideLength, sideLength),
+				Float3d(0.0, 0.0, sideLength),
+				Float3d(sideLength, 0.0, sideLength),
+				Float2d(0.0, 0.0),
+				Float2d(0.0, 1.0),
+				Float2d(1.0, 1.0)),
+			Triangle(
+				Float3d(sideLength, 0.0, sideLength),
+				Float3d(sideLength, sideLength, sideLength),
+				Float3d(0.0, sideLength, sideLength),
+				Float2d(1.0, 1.0),
+				Float2d(1.0, 0.0),
+				Float2d(0.0, 0.0)),
+
+			// Top.
+			Triangle(
+				Float3d(sideLength, sideLength, sideLength),
+				Float3d(sideLength, sideLength, 0.0),
+				Float3d(0.0, sideLength, 0.0),
+				Float2d(0.0, 0.0),
+				Float2d(0.0, 1.0),
+				Float2d(1.0, 1.0)),
+			Triangle(
+				Float3d(0.0, sideLength, 0.0),
+				Float3d(0.0, sideLength, sideLength),
+				Float3d(sideLength, sideLength, sideLength),
+				Float2d(1.0, 1.0),
+				Float2d(1.0, 0.0),
+				Float2d(0.0, 0.0)),
+
+			// Bottom.
+			Triangle(
+				Float3d(sideLength, 0.0, 0.0),
+				Float3d(sideLength, 0.0, sideLength),
+				Float3d(0.0, 0.0, sideLength),
+				Float2d(0.0, 0.0),
+				Float2d(0.0, 1.0),
+				Float2d(1.0, 1.0)),
+			Triangle(
+				Float3d(0.0, 0.0, sideLength),
+				Float3d(0.0, 0.0, 0.0),
+				Float3d(sideLength, 0.0, 0.0),
+				Float2d(1.0, 1.0),
+				Float2d(1.0, 0.0),
+				Float2d(0.0, 0.0)),
+
+			// Right.
+			Triangle(
+				Float3d(0.0, sideLength, 0.0),
+				Float3d(0.0, 0.0, 0.0),
+				Float3d(0.0, 0.0, sideLength),
+				Float2d(0.0, 0.0),
+				Float2d(0.0, 1.0),
+				Float2d(1.0, 1.0)),
+			Triangle(
+				Float3d(0.0, 0.0, sideLength),
+				Float3d(0.0, sideLength, sideLength),
+				Float3d(0.0, sideLength, 0.0),
+				Float2d(1.0, 1.0),
+				Float2d(1.0, 0.0),
+				Float2d(0.0, 0.0)),
+
+			// Left.
+			Triangle(
+				Float3d(sideLength, sideLength, sideLength),
+				Float3d(sideLength, 0.0, sideLength),
+				Float3d(sideLength, 0.0, 0.0),
+				Float2d(0.0, 0.0),
+				Float2d(0.0, 1.0),
+				Float2d(1.0, 1.0)),
+			Triangle(
+				Float3d(sideLength, 0.0, 0.0),
+				Float3d(sideLength, sideLength, 0.0),
+				Float3d(sideLength, sideLength, sideLength),
+				Float2d(1.0, 1.0),
+				Float2d(1.0, 0.0),
+				Float2d(0.0, 0.0))
+		};
+	}
+}
+
 // Each voxel type has a set of triangles (with texture coordinates) that define
 // its contents. These essentially replace "voxel templates", and are intended for 
-// rendering, but could really be used anywhere.
+// rendering, but could really be used anywhere. Triangles are in voxel-local 
+// coordinates so the renderer only needs one copy of them per voxel type.
 const std::map<VoxelType, std::vector<Triangle>> VoxelTypeGeometries =
 {
-
+	{ VoxelType::Air, std::vector<Triangle>() },
+	{ VoxelType::Ground1, makeCube() },
+	{ VoxelType::Ground2, makeCube() },
+	{ VoxelType::Ground3, makeCube() },
+	{ VoxelType::Ground4, makeCube() },
+	{ VoxelType::Wall1, makeCube() },
+	{ VoxelType::Wall2, makeCube() },
+	{ VoxelType::Wall3, makeCube() },
+	{ VoxelType::Wall4, makeCube() }
 };
 
 Voxel::Voxel(VoxelType voxelType)
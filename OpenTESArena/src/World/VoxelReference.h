@@ -6,6 +6,8 @@
 // voxel reference can point to the same triangles if they are the same voxel, but 
 // once a voxel starts to fade due to Passwall for example, it obtains its own list
 // of triangles. If a voxel is empty, its voxel reference's triangle count is zero.
+// Since voxel triangles are in voxel-local coordinates, sharing them only requires
+// the same offset and count; the renderer moves rays into each voxel's space.
 
 // Every voxel reference has triangles for voxels only. A sprite reference will take 
 // care of the offset for sprite triangles (since a sprite is always two triangles).